@@ -1,3 +1,6 @@
+import gzip
+import os
+
 Import("env")
 
 producer = env.GetProjectOption("custom_producer_name")
@@ -7,4 +10,21 @@ prog_version = env.GetProjectOption("custom_version")
 
 firmware_name = f"firmware_{producer}_{garge_type}_{sensor_type}_{prog_version}"
 
-env.Replace(PROGNAME=firmware_name)
\ No newline at end of file
+env.Replace(PROGNAME=firmware_name)
+
+
+def gzip_firmware(source, target, env):
+    """Write a gzip copy of the firmware for compressed OTA downloads."""
+    bin_path = str(target[0])
+    gz_path = bin_path + ".gz"
+    with open(bin_path, "rb") as f_in:
+        data = f_in.read()
+    with gzip.open(gz_path, "wb", compresslevel=9) as f_out:
+        f_out.write(data)
+    print(
+        f"Compressed firmware: {os.path.basename(gz_path)} "
+        f"size={len(data)} compressed_size={os.path.getsize(gz_path)}"
+    )
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", gzip_firmware)
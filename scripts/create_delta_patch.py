@@ -0,0 +1,81 @@
+"""Create a delta OTA patch between two firmware images.
+
+Usage: python create_delta_patch.py <old.bin> <new.bin> <out.patch.gz>
+
+Requires the bsdiff4 package. The bsdiff control triples, diff and extra
+blocks are interleaved into the streaming format read by
+src/helpers/DeltaPatcher.cpp and gzip compressed. The printed values go
+into the manifest entry for the new version.
+"""
+
+import gzip
+import hashlib
+import struct
+import sys
+
+import bsdiff4.core
+
+MAGIC = b"GDP1"
+
+
+def create_patch(old: bytes, new: bytes) -> bytes:
+    control, diff_block, extra_block = bsdiff4.core.diff(old, new)
+    out = bytearray(MAGIC + struct.pack("<I", len(new)))
+    diff_pos = 0
+    extra_pos = 0
+    for diff_len, extra_len, seek in control:
+        out += struct.pack("<IIi", diff_len, extra_len, seek)
+        out += diff_block[diff_pos : diff_pos + diff_len]
+        out += extra_block[extra_pos : extra_pos + extra_len]
+        diff_pos += diff_len
+        extra_pos += extra_len
+    return bytes(out)
+
+
+def apply_patch(old: bytes, patch: bytes) -> bytes:
+    """Reference implementation of the device side, used to verify output."""
+    assert patch[:4] == MAGIC
+    (target_size,) = struct.unpack_from("<I", patch, 4)
+    pos = 8
+    old_pos = 0
+    new = bytearray()
+    while len(new) < target_size:
+        diff_len, extra_len, seek = struct.unpack_from("<IIi", patch, pos)
+        pos += 12
+        for i in range(diff_len):
+            new.append((old[old_pos + i] + patch[pos + i]) & 0xFF)
+        pos += diff_len
+        old_pos += diff_len
+        new += patch[pos : pos + extra_len]
+        pos += extra_len
+        old_pos += seek
+    return bytes(new)
+
+
+def main() -> None:
+    if len(sys.argv) != 4:
+        print(__doc__)
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        old = f.read()
+    with open(sys.argv[2], "rb") as f:
+        new = f.read()
+
+    patch = create_patch(old, new)
+    if apply_patch(old, patch) != new:
+        raise SystemExit("Patch verification failed")
+
+    with gzip.open(sys.argv[3], "wb", compresslevel=9) as f:
+        f.write(patch)
+
+    # The running partition hash reported by the device is the SHA-256 that
+    # the build appends to the image, i.e. the hash of all but the last 32 bytes
+    print(f"size={len(new)}")
+    print(f"sha256={hashlib.sha256(new).hexdigest()}")
+    print(f"from_sha256={hashlib.sha256(old[:-32]).hexdigest()}")
+    print(f"patch_bytes={len(patch)}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+"""Decode a binary backfill batch published to garge/devices/<device>/backfill.
+
+Usage: python decode_backfill.py <file>   (or pipe the payload on stdin)
+
+Mirrors src/helpers/ReadingCodec.cpp and prints one JSON object per reading.
+"""
+
+import json
+import sys
+from typing import Iterator, List, Tuple
+
+CODEC_VERSION = 1
+FIXED_POINT_SCALE = 1000
+READING_TYPES = {0: "temperature", 1: "humidity", 2: "voltage"}
+
+
+class Reader:
+    def __init__(self, data: bytes):
+        self.data = data
+        self.pos = 0
+
+    def byte(self) -> int:
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self) -> int:
+        result = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            result |= (b & 0x7F) << shift
+            if b < 0x80:
+                return result
+            shift += 7
+
+    def zigzag(self) -> int:
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+    def done(self) -> bool:
+        return self.pos >= len(self.data)
+
+
+def decode(data: bytes) -> Iterator[Tuple[str, int, float]]:
+    reader = Reader(data)
+    version = reader.byte()
+    if version != CODEC_VERSION:
+        raise ValueError(f"Unsupported codec version {version}")
+
+    while not reader.done():
+        type_name = READING_TYPES.get(reader.byte(), "unknown")
+        count = reader.varint()
+        timestamp = reader.varint()
+        value = reader.zigzag()
+        delta = 0
+        yield type_name, timestamp, value / FIXED_POINT_SCALE
+        for _ in range(count - 1):
+            delta += reader.zigzag()
+            timestamp = (timestamp + delta) & 0xFFFFFFFF
+            value += reader.zigzag()
+            yield type_name, timestamp, value / FIXED_POINT_SCALE
+
+
+def main() -> None:
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    readings: List[dict] = [
+        {"type": t, "timestamp": ts, "value": v} for t, ts, v in decode(data)
+    ]
+    for reading in readings:
+        print(json.dumps(reading))
+
+
+if __name__ == "__main__":
+    main()
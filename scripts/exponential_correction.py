@@ -1,5 +1,6 @@
 """Calculate exponential calibration constants for voltage sensor readings."""
 
+import json
 import math
 
 CURRENT_A = 0.91406
@@ -42,3 +43,33 @@ for RAW, actual in zip(raw_voltages, actual_voltages):
     print(
         f"Raw: {RAW:.5f}V → Corrected: {corrected:.5f}V (Actual: {actual}V, Error: {error:.5f}V)"
     )
+
+# Calibration table for the device (see src/helpers/VoltageCalibration.h).
+# Inputs are raw ADC codes. Publish the JSON retained to
+# garge/devices/garge_<mac>/calibration and the device stores it in NVS.
+ANALOG_VOLTAGE = 3.32
+ANALOG_RESOLUTION = 4096
+DIVIDER = (33000.0 + 10000.0) / 10000.0
+TABLE_POINTS = 16
+
+
+def code_to_millivolts(code):
+    vin = code * ANALOG_VOLTAGE / ANALOG_RESOLUTION * DIVIDER
+    return 1000 * a * vin**b
+
+
+points = []
+for i in range(TABLE_POINTS):
+    code = round(i * (ANALOG_RESOLUTION - 1) / (TABLE_POINTS - 1))
+    points.append([code, min(round(code_to_millivolts(code)), 65535)])
+
+# Largest deviation of the piecewise-linear table from the fitted curve
+max_error = 0.0
+for (x0, y0), (x1, y1) in zip(points, points[1:]):
+    for code in range(x0, x1 + 1):
+        linear = y0 + (y1 - y0) * (code - x0) / (x1 - x0)
+        max_error = max(max_error, abs(linear - code_to_millivolts(code)))
+
+print()
+print(f"Calibration table (max interpolation error {max_error:.1f} mV):")
+print(json.dumps({"points": points}, separators=(",", ":")))
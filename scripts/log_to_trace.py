@@ -0,0 +1,38 @@
+"""Turn a captured sensor log stream into a CSV trace for the replay harness.
+
+Usage: python log_to_trace.py <log file> > trace.csv   (or pipe the log on stdin)
+
+Picks up the "Raw reading" lines SensorController logs for every sample (build
+with -D SENSOR_LOG_RAW_READINGS) and writes one temperature,humidity row per
+sample, keeping nan for failed reads.
+Replay the result with REPLAY_TRACE=trace.csv pio test -e native -f test_replay.
+"""
+
+import re
+import sys
+from typing import Iterable, Iterator, Tuple
+
+RAW_READING = re.compile(r"Raw reading: (\S+) °C, (\S+) %")
+
+
+def samples(lines: Iterable[str]) -> Iterator[Tuple[str, str]]:
+    for line in lines:
+        match = RAW_READING.search(line)
+        if match:
+            yield match.group(1), match.group(2)
+
+
+def main() -> None:
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], encoding="utf-8", errors="replace") as f:
+            lines = f.readlines()
+    else:
+        lines = sys.stdin.readlines()
+
+    print("temperature,humidity")
+    for temperature, humidity in samples(lines):
+        print(f"{temperature},{humidity}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_CONTROLLERS_DEVICE_H_
+#define SRC_CONTROLLERS_DEVICE_H_
+
+#include <type_traits>
+
+#include "HardwareProbe.h"
+#include "SensorBusController.h"
+#include "SensorController.h"
+#include "SensorDrivers.h"
+#include "VoltmeterController.h"
+#include "helpers/MQTTHelper.h"
+#include "helpers/ReadingHistory.h"
+#include "helpers/VoltageCalibration.h"
+
+#ifndef SENSOR_TYPE
+#define SENSOR_TYPE "bme"  // "bme", "dht" or "bus"
+#endif
+
+#ifndef GARGE_TYPE
+#define GARGE_TYPE "sensor"  // "voltmeter", "sensor" or "universal"
+#endif
+
+// The device personality is fixed by the build flags, so it is composed at
+// compile time from a sensor policy (SensorDrivers.h, VoltageSensor or
+// SensorBus) and a bridge policy. setup(), loop() and the MQTT layer branch on
+// it with if constexpr: the personalities a build is not, and the drivers they
+// use, are never compiled in or are dropped by the linker. The exception is the
+// universal image, UniversalDevice, which carries all of them and picks one
+// at boot.
+
+// The voltmeter, which has a controller of its own
+struct VoltageSensor {
+  static constexpr const char *NAME = "voltage";
+};
+
+// Every BME280 on the I2C bus, directly and behind a TCA9548A, each with
+// entities of its own. Also a controller of its own, SensorBusController.h.
+struct SensorBus {
+  static constexpr const char *NAME = "bus";
+};
+
+// WiZ lights and sockets on the LAN, discovered over UDP and switched through
+// MQTT. Defined in WIZHelper.cpp.
+struct WizBridge {
+  static constexpr bool ENABLED = true;
+  static void setup();
+  static void loop();
+};
+
+struct NoBridge {
+  static constexpr bool ENABLED = false;
+  static void setup() {}
+  static void loop() {}
+};
+
+template <typename SensorPolicy, typename BridgePolicy>
+struct Device {
+  typedef SensorPolicy Sensor;
+  typedef BridgePolicy Bridge;
+
+  static constexpr bool VOLTMETER =
+      std::is_same<Sensor, VoltageSensor>::value;
+  static constexpr bool BUS = std::is_same<Sensor, SensorBus>::value;
+  // Whether the build contains the voltmeter, for if constexpr
+  static constexpr bool CAN_BE_VOLTMETER = VOLTMETER;
+
+  static constexpr bool isVoltmeter() { return VOLTMETER; }
+
+  static void setupSensor() {
+    if constexpr (VOLTMETER) {
+      voltageSensorSetup(CHIP_ID);
+    } else if constexpr (BUS) {
+      sensorBusSetup();
+      historySetup();
+    } else {
+      environmentalSensorSetup<Sensor>();
+      historySetup();
+    }
+  }
+
+  // Home Assistant discovery, on every MQTT connect
+  static void publishDiscovery() {
+    if constexpr (VOLTMETER) {
+      publishGargeSensorConfig(
+          CHIP_ID.c_str(), "voltage", "V", "voltage",
+          "{{value_json.voltage | round(3) | default(0)}}");
+      // Retained calibration points, see VoltageCalibration.h
+      mqttClient->subscribe(getCalibrationTopic(CHIP_ID).c_str());
+    } else if constexpr (BUS) {
+      publishSensorBusDiscovery();
+    } else {
+      publishGargeSensorConfig(
+          CHIP_ID.c_str(), "temperature", "°C", "temperature",
+          "{{value_json.temperature | round(3) | default(0)}}");
+      publishGargeSensorConfig(
+          CHIP_ID.c_str(), "humidity", "%", "humidity",
+          "{{value_json.humidity | round(3) | default(0)}}");
+    }
+  }
+
+  static void loop() {
+    if constexpr (VOLTMETER) {
+      readAndWriteVoltageSensor();
+    } else if constexpr (BUS) {
+      readAndWriteSensorBus();
+    } else {
+      readAndWriteEnvironmentalSensors<Sensor>();
+    }
+    Bridge::loop();
+  }
+};
+
+// One image for every board: the hardware is detected at boot (see
+// HardwareProbe.h) and the matching personality above takes over. Costs the
+// flash of all of them, and one predictable branch per call.
+struct UniversalDevice {
+  typedef Device<VoltageSensor, NoBridge> Voltmeter;
+  typedef Device<AutoSensor, WizBridge> Sensor;
+  typedef WizBridge Bridge;
+
+  static constexpr bool CAN_BE_VOLTMETER = true;
+
+  static bool isVoltmeter() {
+    return detectedHardware() == HARDWARE_VOLTMETER;
+  }
+
+  static void setupSensor() {
+    if (isVoltmeter()) {
+      Voltmeter::setupSensor();
+    } else {
+      Sensor::setupSensor();
+    }
+  }
+
+  static void publishDiscovery() {
+    if (isVoltmeter()) {
+      Voltmeter::publishDiscovery();
+    } else {
+      Sensor::publishDiscovery();
+    }
+  }
+
+  static void loop() {
+    if (isVoltmeter()) {
+      Voltmeter::loop();
+    } else {
+      Sensor::loop();
+    }
+  }
+};
+
+constexpr bool buildFlagIs(const char *flag, const char *value) {
+  return *flag == *value && (*flag == '\0' || buildFlagIs(flag + 1, value + 1));
+}
+
+static_assert(buildFlagIs(GARGE_TYPE, "sensor") ||
+                  buildFlagIs(GARGE_TYPE, "voltmeter") ||
+                  buildFlagIs(GARGE_TYPE, "universal"),
+              "GARGE_TYPE must be \"sensor\", \"voltmeter\" or \"universal\"");
+static_assert(!buildFlagIs(GARGE_TYPE, "sensor") ||
+                  buildFlagIs(SENSOR_TYPE, "bme") ||
+                  buildFlagIs(SENSOR_TYPE, "dht") ||
+                  buildFlagIs(SENSOR_TYPE, "bus"),
+              "SENSOR_TYPE must be \"bme\", \"dht\" or \"bus\"");
+
+typedef std::conditional<
+    buildFlagIs(SENSOR_TYPE, "dht"), DhtSensor,
+    std::conditional<buildFlagIs(SENSOR_TYPE, "bus"), SensorBus,
+                     BmeSensor>::type>::type GargeSensor;
+
+typedef std::conditional<
+    buildFlagIs(GARGE_TYPE, "universal"), UniversalDevice,
+    std::conditional<buildFlagIs(GARGE_TYPE, "voltmeter"),
+                     Device<VoltageSensor, NoBridge>,
+                     Device<GargeSensor, WizBridge>>::type>::type GargeDevice;
+
+#endif  // SRC_CONTROLLERS_DEVICE_H_
@@ -0,0 +1,117 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_CONTROLLERS_FILTERCHAIN_H_
+#define SRC_CONTROLLERS_FILTERCHAIN_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+// Outlier threshold of the Hampel stage: 3 standard deviations, estimated as
+// 1.4826 * MAD, in thousandths
+constexpr int64_t HAMPEL_THRESHOLD_MILLI = 4448;
+
+// Streaming filter for one sensor quantity, in two stages:
+//  1. Hampel: a sample further than the threshold from the median of the last
+//     N raw samples, itself included, is replaced by that median. Raw samples
+//     are kept even when replaced, so a real step change gets through once it
+//     is the majority.
+//  2. Mean of the last N samples that left stage 1.
+// Samples are stored as fixed point T in 1/SCALE units and summed as integers,
+// so the mean is exact and cannot drift. NaN samples are dropped on the way in
+// and never reach the window.
+template <typename T, size_t N, int32_t SCALE = 100>
+class FilterChain {
+  static_assert(N >= 3, "the Hampel stage needs at least three samples");
+
+ public:
+  // minDeviation is in sensor units: deviations up to it always pass, so a
+  // quiet sensor whose MAD is zero does not reject its own resolution steps
+  explicit FilterChain(float minDeviation)
+      : minDeviation_(toFixed(minDeviation)) {}
+
+  void reset() {
+    count_ = 0;
+    next_ = 0;
+    sum_ = 0;
+  }
+
+  // Returns false if the sample was NaN and left out.
+  bool add(float sample) {
+    if (std::isnan(sample)) {
+      return false;
+    }
+
+    if (count_ == N) {
+      sum_ -= window_[next_];
+    } else {
+      count_++;
+    }
+    T value = toFixed(sample);
+    raw_[next_] = value;
+
+    T accepted = value;
+    if (count_ >= 3) {
+      T median = medianOf(raw_, count_);
+      int32_t deviations[N];
+      for (size_t i = 0; i < count_; i++) {
+        deviations[i] = std::abs(static_cast<int32_t>(raw_[i]) - median);
+      }
+      int64_t threshold = std::max<int64_t>(
+          minDeviation_,
+          medianOf(deviations, count_) * HAMPEL_THRESHOLD_MILLI / 1000);
+      if (std::abs(static_cast<int64_t>(value) - median) > threshold) {
+        accepted = median;
+        rejected_++;
+      }
+    }
+
+    window_[next_] = accepted;
+    sum_ += accepted;
+    next_ = (next_ + 1) % N;
+    return true;
+  }
+
+  // False until the first sample that was not NaN
+  bool ready() const { return count_ > 0; }
+
+  // Mean of the window in sensor units, NaN before the first sample
+  float value() const {
+    return count_ > 0 ? static_cast<float>(sum_) / count_ / SCALE : NAN;
+  }
+
+  uint32_t rejected() const { return rejected_; }
+
+ private:
+  T raw_[N];
+  T window_[N];
+  int64_t sum_ = 0;
+  size_t count_ = 0;
+  size_t next_ = 0;
+  T minDeviation_;
+  uint32_t rejected_ = 0;
+
+  static T toFixed(float value) {
+    float scaled = roundf(value * SCALE);
+    if (scaled >= std::numeric_limits<T>::max()) {
+      return std::numeric_limits<T>::max();
+    }
+    if (scaled <= std::numeric_limits<T>::min()) {
+      return std::numeric_limits<T>::min();
+    }
+    return static_cast<T>(scaled);
+  }
+
+  template <typename V>
+  static V medianOf(const V *values, size_t count) {
+    V sorted[N];
+    std::copy(values, values + count, sorted);
+    std::nth_element(sorted, sorted + count / 2, sorted + count);
+    return sorted[count / 2];
+  }
+};
+
+#endif  // SRC_CONTROLLERS_FILTERCHAIN_H_
@@ -0,0 +1,170 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include "HardwareProbe.h"
+
+#include <Preferences.h>
+#include <Wire.h>
+
+#include <algorithm>
+
+#include "SensorDrivers.h"
+#include "VoltmeterController.h"
+
+static const char *HARDWARE_PREFS_NAMESPACE = "hardware";
+
+static DetectedHardware detected = HARDWARE_NONE;
+static bool detectionDone = false;
+
+const char *hardwareName(DetectedHardware hardware) {
+  switch (hardware) {
+    case HARDWARE_NONE:
+      return "none";
+    case HARDWARE_BME280_76:
+      return "bme280@0x76";
+    case HARDWARE_BME280_77:
+      return "bme280@0x77";
+    case HARDWARE_DHT:
+      return "dht";
+    case HARDWARE_VOLTMETER:
+      return "voltmeter";
+  }
+  return "unknown";
+}
+
+bool probeBme280(uint8_t address) {
+  Wire.beginTransmission(address);
+  Wire.write(BME280_CHIP_ID_REGISTER);
+  if (Wire.endTransmission(false) != 0) {
+    return false;
+  }
+  if (Wire.requestFrom(address, static_cast<uint8_t>(1)) != 1) {
+    return false;
+  }
+  return Wire.read() == BME280_CHIP_ID;
+}
+
+static bool probeDht() {
+  if (millis() < DHT_STARTUP_MS) {
+    delay(DHT_STARTUP_MS - millis());
+  }
+  DhtSensor::device().begin();
+  return DhtSensor::device().read(true);
+}
+
+static bool probeVoltmeter() {
+  uint32_t low = UINT32_MAX;
+  uint32_t high = 0;
+  for (int i = 0; i < VOLTMETER_PROBE_SAMPLES; i++) {
+    uint32_t millivolts = analogReadMilliVolts(ANALOG_IN_PIN);
+    low = std::min(low, millivolts);
+    high = std::max(high, millivolts);
+  }
+  return low >= VOLTMETER_PROBE_MIN_MV &&
+         high - low <= VOLTMETER_PROBE_MAX_SPREAD_MV;
+}
+
+// A board that once had a BME280 or DHT on it is a sensor board: a floating
+// ANALOG_IN_PIN on it must not make it a voltmeter when its sensor misses a
+// boot, since the voltmeter deep-sleeps and would never find the sensor again
+static bool isSensor(DetectedHardware hardware) {
+  return hardware == HARDWARE_BME280_76 || hardware == HARDWARE_BME280_77 ||
+         hardware == HARDWARE_DHT;
+}
+
+static DetectedHardware probeHardware(bool sensorBoard) {
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+  if (probeBme280(0x76)) {
+    return HARDWARE_BME280_76;
+  }
+  if (probeBme280(0x77)) {
+    return HARDWARE_BME280_77;
+  }
+  if (probeDht()) {
+    return HARDWARE_DHT;
+  }
+  if (sensorBoard) {
+    return HARDWARE_NONE;
+  }
+  pinMode(ANALOG_IN_PIN, INPUT);
+  if (probeVoltmeter()) {
+    return HARDWARE_VOLTMETER;
+  }
+  return HARDWARE_NONE;
+}
+
+// A cached BME280 is cheap to confirm, and so is the divider (a few ms of
+// ADC reads); the DHT is not, and is trusted until it stops answering (see
+// AutoSensor)
+static bool confirmCached(DetectedHardware hardware) {
+  switch (hardware) {
+    case HARDWARE_BME280_76:
+    case HARDWARE_BME280_77:
+      Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+      return probeBme280(hardware == HARDWARE_BME280_76 ? 0x76 : 0x77);
+    case HARDWARE_VOLTMETER:
+      pinMode(ANALOG_IN_PIN, INPUT);
+      return probeVoltmeter();
+    case HARDWARE_DHT:
+      return true;
+    case HARDWARE_NONE:
+      break;
+  }
+  return false;
+}
+
+DetectedHardware detectHardware() {
+  uint32_t start = millis();
+  Preferences prefs;
+  bool prefsOpen = prefs.begin(HARDWARE_PREFS_NAMESPACE, false);
+  DetectedHardware cached = prefsOpen ? static_cast<DetectedHardware>(
+                                            prefs.getUChar("detected"))
+                                      : HARDWARE_NONE;
+  bool sensorBoard = prefsOpen && prefs.getBool("sensor_board");
+
+  if (cached != HARDWARE_NONE && confirmCached(cached)) {
+    detected = cached;
+  } else {
+    if (cached != HARDWARE_NONE) {
+      printHelper.log("WARN", "Cached hardware %s not found, probing",
+                      hardwareName(cached));
+    }
+    detected = probeHardware(sensorBoard || isSensor(cached));
+    if (prefsOpen) {
+      if (detected != HARDWARE_NONE) {
+        prefs.putUChar("detected", detected);
+      } else {
+        prefs.remove("detected");
+      }
+      if (isSensor(detected) && !sensorBoard) {
+        prefs.putBool("sensor_board", true);
+      }
+    }
+  }
+  if (prefsOpen) {
+    prefs.end();
+  }
+  detectionDone = true;
+
+  if (detected == HARDWARE_NONE) {
+    printHelper.log("ERROR", "No sensor found, check wiring!");
+  } else {
+    printHelper.log("INFO", "Hardware: %s (%s, %u ms)", hardwareName(detected),
+                    detected == cached ? "cached" : "probed",
+                    static_cast<unsigned>(millis() - start));
+  }
+  return detected;
+}
+
+DetectedHardware detectedHardware() {
+  return detectionDone ? detected : detectHardware();
+}
+
+void forgetDetectedHardware() {
+  Preferences prefs;
+  if (prefs.begin(HARDWARE_PREFS_NAMESPACE, false)) {
+    prefs.remove("detected");
+    prefs.end();
+  }
+  printHelper.log("WARN", "Forgot detected hardware %s, probing next boot",
+                  hardwareName(detected));
+}
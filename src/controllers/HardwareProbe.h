@@ -0,0 +1,49 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_CONTROLLERS_HARDWAREPROBE_H_
+#define SRC_CONTROLLERS_HARDWAREPROBE_H_
+
+#include <Arduino.h>
+
+#include <cstdint>
+
+#include "helpers/PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+// What the universal image found on the board. Stored in NVS, so the values
+// must not change.
+enum DetectedHardware : uint8_t {
+  HARDWARE_NONE = 0,
+  HARDWARE_BME280_76 = 1,
+  HARDWARE_BME280_77 = 2,
+  HARDWARE_DHT = 3,
+  HARDWARE_VOLTMETER = 4,
+};
+
+constexpr uint8_t BME280_CHIP_ID_REGISTER = 0xD0;
+constexpr uint8_t BME280_CHIP_ID = 0x60;
+// The DHT11 does not answer during its first second after power-up
+constexpr uint32_t DHT_STARTUP_MS = 1000;
+// A divider with a battery on it reads steady; a floating pin wanders
+constexpr int VOLTMETER_PROBE_SAMPLES = 16;
+constexpr uint32_t VOLTMETER_PROBE_MIN_MV = 1000;
+constexpr uint32_t VOLTMETER_PROBE_MAX_SPREAD_MV = 100;
+
+// Probes in order: BME280 at 0x76 and 0x77, a DHT response, a divider voltage
+// on ANALOG_IN_PIN. The result is cached in NVS, and later boots only confirm
+// a cached BME280 by its chip ID (well under a millisecond) or a cached
+// divider by its voltage instead of probing everything again. Nothing found
+// is not cached. A board that has had a sensor is never probed for the
+// divider again; making it a voltmeter takes an NVS erase.
+DetectedHardware detectHardware();
+// The result of this boot's detectHardware(), which runs on first use
+DetectedHardware detectedHardware();
+// Clears the cache so the next boot probes again, e.g. after the sensor
+// stopped answering
+void forgetDetectedHardware();
+const char *hardwareName(DetectedHardware hardware);
+// Whether a BME280 at address answers with its chip ID
+bool probeBme280(uint8_t address);
+
+#endif  // SRC_CONTROLLERS_HARDWAREPROBE_H_
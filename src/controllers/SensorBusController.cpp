@@ -0,0 +1,300 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include "SensorBusController.h"
+
+#include <Wire.h>
+
+#include <cstdio>
+#include <ctime>
+
+#include "HardwareProbe.h"
+#include "../helpers/MQTTHelper.h"
+#include "../helpers/ReadingHistory.h"
+#include "../helpers/ReadingLog.h"
+
+uint32_t busCycleMicros = 0;
+
+static BusSensor sensors[SENSOR_BUS_MAX_SENSORS];
+static size_t sensorCount = 0;
+static bool muxPresent = false;
+static uint8_t selectedChannel = SENSOR_BUS_DIRECT;
+static bool converting = false;
+static uint32_t cycleStart = 0;
+// When the last conversion of the cycle was started, the one finishing last
+static uint32_t conversionsStarted = 0;
+
+static uint32_t lastSampleTime = 0;
+static uint32_t lastReportTime = 0;
+
+// A TCA9548A reads back the channel mask written to it
+static bool probeMux() {
+  Wire.beginTransmission(TCA9548A_ADDRESS);
+  Wire.write(0);
+  if (Wire.endTransmission() != 0) {
+    return false;
+  }
+  if (Wire.requestFrom(TCA9548A_ADDRESS, static_cast<uint8_t>(1)) != 1) {
+    return false;
+  }
+  return Wire.read() == 0;
+}
+
+// Only writes to the mux when the channel changes; SENSOR_BUS_DIRECT turns
+// every channel off so the sensors behind it do not answer for direct ones
+static void selectChannel(uint8_t channel) {
+  if (!muxPresent || channel == selectedChannel) {
+    return;
+  }
+  Wire.beginTransmission(TCA9548A_ADDRESS);
+  Wire.write(channel == SENSOR_BUS_DIRECT ? 0 : 1 << channel);
+  Wire.endTransmission();
+  selectedChannel = channel;
+}
+
+static void addSensor(uint8_t channel, uint8_t address) {
+  BusSensor &sensor = sensors[sensorCount];
+  sensor.channel = channel;
+  sensor.address = address;
+  sensor.tempFilter.reset();
+  sensor.humidFilter.reset();
+  if (channel != SENSOR_BUS_DIRECT) {
+    snprintf(sensor.suffix, sizeof(sensor.suffix), "_ch%u_%x",
+             static_cast<unsigned>(channel), static_cast<unsigned>(address));
+  } else if (address != BME280_I2C_ADDRESS) {
+    snprintf(sensor.suffix, sizeof(sensor.suffix), "_%x",
+             static_cast<unsigned>(address));
+  } else {
+    sensor.suffix[0] = '\0';
+  }
+
+  if (!sensor.driver.begin(address, &Wire)) {
+    printHelper.log("ERROR", "BME280%s found but did not start",
+                    sensor.suffix);
+    return;
+  }
+  // Forced mode, see BmeSensor::begin; conversions are started by the
+  // scheduler below rather than by takeForcedMeasurement(), which blocks
+  sensor.driver.setSampling(Adafruit_BME280::MODE_FORCED,
+                            Adafruit_BME280::SAMPLING_X1,    // temperature
+                            Adafruit_BME280::SAMPLING_NONE,  // pressure
+                            Adafruit_BME280::SAMPLING_X1,    // humidity
+                            Adafruit_BME280::FILTER_OFF);
+  printHelper.log("INFO", "BME280 at 0x%02x, channel %d, entity suffix '%s'",
+                  address, channel == SENSOR_BUS_DIRECT ? -1 : channel,
+                  sensor.suffix);
+  sensorCount++;
+}
+
+// Direct sensors first, then channel by channel, so a cycle selects each
+// channel once. An address taken directly cannot be told apart behind the
+// mux and is skipped there.
+static void enumerateSensors() {
+  sensorCount = 0;
+  muxPresent = probeMux();
+  selectedChannel = SENSOR_BUS_DIRECT;
+
+  const uint8_t addresses[] = {0x76, 0x77};
+  bool direct[2] = {false, false};
+  for (int i = 0; i < 2; i++) {
+    direct[i] = probeBme280(addresses[i]);
+    if (direct[i]) {
+      addSensor(SENSOR_BUS_DIRECT, addresses[i]);
+    }
+  }
+  if (!muxPresent) {
+    return;
+  }
+  for (uint8_t channel = 0; channel < TCA9548A_CHANNELS; channel++) {
+    selectChannel(channel);
+    for (int i = 0; i < 2; i++) {
+      if (!direct[i] && probeBme280(addresses[i])) {
+        addSensor(channel, addresses[i]);
+      }
+    }
+  }
+}
+
+// Phase one: a ctrl_meas write per sensor, the conversions run in parallel
+static void startConversions() {
+  cycleStart = micros();
+  for (size_t i = 0; i < sensorCount; i++) {
+    BusSensor &sensor = sensors[i];
+    selectChannel(sensor.channel);
+    Wire.beginTransmission(sensor.address);
+    Wire.write(BME280_CTRL_MEAS_REGISTER);
+    Wire.write(BME280_CTRL_MEAS_FORCED);
+    sensor.converting = Wire.endTransmission() == 0;
+  }
+  conversionsStarted = micros();
+  converting = true;
+}
+
+// Phase two, BME280_CONVERSION_MS later: the results of all of them
+static void readConversions() {
+  for (size_t i = 0; i < sensorCount; i++) {
+    BusSensor &sensor = sensors[i];
+    float temperature = NAN;
+    float humidity = NAN;
+    if (sensor.converting) {
+      selectChannel(sensor.channel);
+      temperature = sensor.driver.readTemperature();
+      humidity = sensor.driver.readHumidity();
+    }
+#ifdef SENSOR_LOG_RAW_READINGS
+    printHelper.log("DEBUG", "Raw reading%s: %.2f °C, %.2f %%", sensor.suffix,
+                    temperature, humidity);
+#endif
+
+    // NaN samples are left out of the filters and the aggregates
+    if (sensor.tempFilter.add(temperature + BMEtempOffset)) {
+      sensor.tempAggregate.add(sensor.tempFilter.value());
+    }
+    if (sensor.humidFilter.add(humidity + BMEhumidOffset)) {
+      sensor.humidAggregate.add(sensor.humidFilter.value());
+    }
+  }
+  converting = false;
+  busCycleMicros = micros() - cycleStart;
+}
+
+size_t sensorBusSetup() {
+  printHelper.log("INFO", "Sensor type is: bus");
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+  enumerateSensors();
+  if (sensorCount == 0) {
+    printHelper.log("ERROR",
+                    "Could not find a valid BME280 sensor, check wiring!");
+  }
+  printHelper.log("INFO", "%u BME280 sensor(s)%s",
+                  static_cast<unsigned>(sensorCount),
+                  muxPresent ? ", TCA9548A present" : "");
+
+  for (int i = 0; i < READING_BUFFER; i++) {
+    startConversions();
+    delay(BME280_CONVERSION_MS);
+    readConversions();
+  }
+  // The first report covers a full interval of samples
+  for (size_t i = 0; i < sensorCount; i++) {
+    sensors[i].tempAggregate.reset();
+    sensors[i].humidAggregate.reset();
+  }
+  lastSampleTime = millis();
+  lastReportTime = millis();
+  return sensorCount;
+}
+
+size_t sensorBusCount() { return sensorCount; }
+
+BusSensor &busSensor(size_t index) { return sensors[index]; }
+
+void publishSensorBusDiscovery() {
+  for (size_t i = 0; i < sensorCount; i++) {
+    String temperature = String("temperature") + sensors[i].suffix;
+    String humidity = String("humidity") + sensors[i].suffix;
+    publishGargeSensorConfig(
+        CHIP_ID.c_str(), temperature.c_str(), "°C", "temperature",
+        "{{value_json.temperature | round(3) | default(0)}}");
+    publishGargeSensorConfig(
+        CHIP_ID.c_str(), humidity.c_str(), "%", "humidity",
+        "{{value_json.humidity | round(3) | default(0)}}");
+  }
+}
+
+// Publishes one sensor's interval. Each flag is false when that quantity
+// had no samples or did not go out.
+static void reportSensor(BusSensor &sensor, bool *tempPublished,
+                         bool *humidPublished) {
+  *tempPublished = false;
+  *humidPublished = false;
+  char buffer[192];
+  if (sensor.tempAggregate.count() > 0) {
+    serializeAggregate(sensor.tempAggregate, buffer, sizeof(buffer));
+    String type = String("temperature") + sensor.suffix;
+    *tempPublished = mqttStatus() &&
+                     publishGargeSensorState(CHIP_ID, type.c_str(), buffer);
+  }
+  if (sensor.humidAggregate.count() > 0) {
+    serializeAggregate(sensor.humidAggregate, buffer, sizeof(buffer));
+    String type = String("humidity") + sensor.suffix;
+    *humidPublished = mqttStatus() &&
+                      publishGargeSensorState(CHIP_ID, type.c_str(), buffer);
+  }
+  printHelper.log("INFO",
+                  "Temperature%s: %.2f °C, Humidity%s: %.2f %%, %u samples",
+                  sensor.suffix, sensor.tempAggregate.mean(), sensor.suffix,
+                  sensor.humidAggregate.mean(),
+                  static_cast<unsigned>(sensor.tempAggregate.count()));
+}
+
+void readAndWriteSensorBus() {
+  if (!converting && millis() - lastSampleTime >= SENSOR_SAMPLE_INTERVAL_MS) {
+    lastSampleTime = millis();
+    startConversions();
+  }
+  if (converting &&
+      micros() - conversionsStarted >= BME280_CONVERSION_MS * 1000) {
+    readConversions();
+  }
+
+  // A cycle in flight is read first, its samples belong to this interval
+  if (!converting && millis() - lastReportTime >= READ_DELAY) {
+    lastReportTime = millis();
+
+    // The backfill log and /history hold one sensor, the first found
+    BusSensor *primary = sensorCount > 0 ? &sensors[0] : nullptr;
+    averageTemp = primary ? primary->tempAggregate.mean() : NAN;
+    averageHumid = primary ? primary->humidAggregate.mean() : NAN;
+
+    // Only an interval without a good sample from any sensor counts as a
+    // failed reading; one sensor gone stops its own entities only
+    float anyReading = NAN;
+    for (size_t i = 0; i < sensorCount && std::isnan(anyReading); i++) {
+      anyReading = sensors[i].tempAggregate.mean();
+    }
+    checkAndRestartIfFailed(&anyReading, &failedTempReadings);
+
+    // Only the primary's publishes decide what goes to the backfill log and
+    // whether it is flushed, as in SensorController; another sensor's failed
+    // publish is not the primary's reading to log
+    bool tempPublished = false;
+    bool humidPublished = false;
+    for (size_t i = 0; i < sensorCount; i++) {
+      bool sensorTempPublished;
+      bool sensorHumidPublished;
+      reportSensor(sensors[i], &sensorTempPublished, &sensorHumidPublished);
+      if (&sensors[i] == primary) {
+        tempPublished = sensorTempPublished;
+        humidPublished = sensorHumidPublished;
+      }
+    }
+    if (primary) {
+      if (primary->tempAggregate.count() > 0 && !tempPublished) {
+        logReading(READING_TEMPERATURE, averageTemp);
+      }
+      if (primary->humidAggregate.count() > 0 && !humidPublished) {
+        logReading(READING_HUMIDITY, averageHumid);
+      }
+      if (tempPublished && humidPublished) {
+        flushReadingLog(CHIP_ID);
+      }
+    }
+    printHelper.log("DEBUG", "Bus cycle: %u us for %u sensors",
+                    static_cast<unsigned>(busCycleMicros),
+                    static_cast<unsigned>(sensorCount));
+
+    if (primary) {
+      float record[HISTORY_COLUMN_COUNT] = {
+          primary->tempAggregate.mean(),  primary->tempAggregate.min(),
+          primary->tempAggregate.max(),   primary->humidAggregate.mean(),
+          primary->humidAggregate.min(),  primary->humidAggregate.max(),
+      };
+      recordHistory(static_cast<uint32_t>(time(nullptr)), record);
+    }
+
+    for (size_t i = 0; i < sensorCount; i++) {
+      sensors[i].tempAggregate.reset();
+      sensors[i].humidAggregate.reset();
+    }
+  }
+}
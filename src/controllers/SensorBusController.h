@@ -0,0 +1,69 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_CONTROLLERS_SENSORBUSCONTROLLER_H_
+#define SRC_CONTROLLERS_SENSORBUSCONTROLLER_H_
+
+#include <Adafruit_BME280.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SensorController.h"
+
+// Several BME280s on one node: the two addresses directly on the bus, and the
+// same two on each channel of a TCA9548A multiplexer, e.g. one sensor inside
+// and one outside, or one per room.
+//
+// Sampling is split in two phases so the conversions overlap: every sensor is
+// put into forced mode first, and all of them are read once the slowest
+// conversion is done. A cycle costs one conversion time plus a few bytes of
+// bus traffic per sensor instead of one conversion per sensor, and the wait
+// is spent in loop() rather than blocking it.
+
+constexpr uint8_t TCA9548A_ADDRESS = 0x70;  // A0-A2 low, the board default
+constexpr uint8_t TCA9548A_CHANNELS = 8;
+// Channel of the sensors directly on the bus
+constexpr uint8_t SENSOR_BUS_DIRECT = 0xFF;
+// Every sensor the bus can tell apart: 0x76 and 0x77 on each channel. An
+// address taken directly is taken on all of them.
+constexpr size_t SENSOR_BUS_MAX_SENSORS = 2 * TCA9548A_CHANNELS;
+
+constexpr uint8_t BME280_CTRL_MEAS_REGISTER = 0xF4;
+// Temperature x1, pressure skipped, forced mode, as set by BmeSensor::begin;
+// humidity x1 stays in ctrl_hum from setSampling()
+constexpr uint8_t BME280_CTRL_MEAS_FORCED = 0x21;
+// Datasheet maximum for that setting: 1.25 + 2.3 + 2.3 + 0.575 ms
+constexpr uint32_t BME280_CONVERSION_MS = 7;
+
+struct BusSensor {
+  BusSensor()
+      : tempFilter(TEMP_FILTER_MIN_DEVIATION),
+        humidFilter(HUMID_FILTER_MIN_DEVIATION) {}
+
+  uint8_t channel = SENSOR_BUS_DIRECT;
+  uint8_t address = 0;
+  // Sub-entity suffix. Empty for the sensor directly at 0x76, which keeps
+  // the entity names a single-sensor node has, "_77" or e.g. "_ch3_76".
+  char suffix[12] = "";
+  Adafruit_BME280 driver;
+  SensorFilter tempFilter;
+  SensorFilter humidFilter;
+  WindowAggregate tempAggregate;
+  WindowAggregate humidAggregate;
+  // Whether this cycle's conversion was started
+  bool converting = false;
+};
+
+// Microseconds from starting the conversions to the last read of a cycle
+extern uint32_t busCycleMicros;
+
+// Enumerates the sensors and primes their filters. Returns how many were
+// found; none found restarts after the failure limit, like a single sensor.
+size_t sensorBusSetup();
+size_t sensorBusCount();
+BusSensor &busSensor(size_t index);
+// Home Assistant discovery, a temperature and a humidity entity per sensor
+void publishSensorBusDiscovery();
+void readAndWriteSensorBus();
+
+#endif  // SRC_CONTROLLERS_SENSORBUSCONTROLLER_H_
@@ -1,141 +1,168 @@
 // Copyright (c) 2023-2025 Sondre Sjølyst
 
 #include "SensorController.h"
-#include "../helpers/MQTTHelper.h"
-
-#ifndef I2C_SDA_PIN
-#define I2C_SDA_PIN 18
-#endif
 
-#ifndef I2C_SCL_PIN
-#define I2C_SCL_PIN 17
-#endif
+#include <algorithm>
+#include <ctime>
 
-float BMEtempOffset = -3.49;
-float BMEhumidOffset = 15;
-
-float DHTtempOffset = -3;
-float DHThumidOffset = 6;
+#include "../helpers/MQTTHelper.h"
+#include "../helpers/ReadingHistory.h"
+#include "../helpers/ReadingLog.h"
 
 float averageHumid = 0;
 float averageTemp = 0;
-float humidReadings[READING_BUFFER];
-float tempReadings[READING_BUFFER];
-float totalHumid = 0;
-float totalTemp = 0;
-int readIndex = 0;
+SensorFilter tempFilter(TEMP_FILTER_MIN_DEVIATION);
+SensorFilter humidFilter(HUMID_FILTER_MIN_DEVIATION);
+WindowAggregate tempAggregate;
+WindowAggregate humidAggregate;
 
 float currentTempReadings = 0;
 float currentHumidReadings = 0;
 int32_t failedTempReadings = 0;
 int32_t failedHumidReadings = 0;
 
-void environmentalSensorSetup(const char *sensorType) {
-  if (strcmp(sensorType, "dht") == 0) {
-    printHelper.log("INFO", "Sensor type is: %s", sensorType);
-    dht.begin();
-
-    for (int i = 0; i < READING_BUFFER; i++) {
-      tempReadings[i] = dht.readTemperature() + DHTtempOffset;
-      humidReadings[i] = dht.readHumidity() + DHThumidOffset;
-      totalTemp += tempReadings[i];
-      totalHumid += humidReadings[i];
-    }
-  } else if (strcmp(sensorType, "bme") == 0) {
-    printHelper.log("INFO", "Sensor type is: %s", sensorType);
-    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
-    if (!bme.begin(0x76)) {
-      printHelper.log("ERROR",
-                      "Could not find a valid BME280 sensor, check wiring!");
-      // while (1) {
-      // }
-    }
-    for (int i = 0; i < READING_BUFFER; i++) {
-      tempReadings[i] = bme.readTemperature() + BMEtempOffset;
-      humidReadings[i] = bme.readHumidity() + BMEhumidOffset;
-      totalTemp += tempReadings[i];
-      totalHumid += humidReadings[i];
-    }
-  } else {
-    printHelper.log("ERROR", "No sensor type selected!");
+static uint32_t lastSampleTime = 0;
+static uint32_t lastReportTime = 0;
+
+template <typename Sensor>
+void environmentalSensorSetup() {
+  printHelper.log("INFO", "Sensor type is: %s", Sensor::NAME);
+  Sensor::begin();
+  for (int i = 0; i < READING_BUFFER; i++) {
+    float temperature;
+    float humidity;
+    Sensor::read(&temperature, &humidity);
+    tempFilter.add(temperature + Sensor::temperatureOffset());
+    humidFilter.add(humidity + Sensor::humidityOffset());
   }
+
+  // The first report covers a full interval of samples
+  tempAggregate.reset();
+  humidAggregate.reset();
+  lastSampleTime = millis();
+  lastReportTime = millis();
 }
 
 void checkAndRestartIfFailed(float *reading, int32_t *failedReadings) {
   printHelper.log("INFO", "Checking if reading failed");
   if (reading == nullptr || std::isnan(*reading)) {
     (*failedReadings) += 1;
-    printHelper.log("ERROR", "Reading: %s, Failed count: %s", String(*reading),
-                    String(*failedReadings));
+    printHelper.log("ERROR", "Reading: %.2f, Failed count: %d", *reading,
+                    *failedReadings);
     if (*failedReadings >= 10) {
       ESP.restart();
     }
   } else {
     printHelper.log("INFO", "Reading OK");
-    printHelper.log("INFO", "Reading: %s", String(*reading));
+    printHelper.log("INFO", "Reading: %.2f", *reading);
     *failedReadings = 0;
   }
 }
 
-void readAndWriteEnvironmentalSensors(const char *sensorType) {
-  static uint32_t lastToggleTime = 0;
+// Reads one sample into the filters and the aggregates of this interval.
+template <typename Sensor>
+static void sampleEnvironmentalSensors() {
+  Sensor::read(&currentTempReadings, &currentHumidReadings);
 
-  if (millis() - lastToggleTime >= READ_DELAY) {
-    int arrayLength = sizeof(tempReadings) / sizeof(tempReadings[0]);
+#ifdef SENSOR_LOG_RAW_READINGS
+  // Raw samples, scripts/log_to_trace.py turns these into replay traces
+  printHelper.log("DEBUG", "Raw reading: %.2f °C, %.2f %%",
+                  currentTempReadings, currentHumidReadings);
+#endif
 
-    lastToggleTime = millis();
+  // NaN samples are left out of the filters and the aggregates
+  if (tempFilter.add(currentTempReadings + Sensor::temperatureOffset())) {
+    tempAggregate.add(tempFilter.value());
+  }
+  if (humidFilter.add(currentHumidReadings + Sensor::humidityOffset())) {
+    humidAggregate.add(humidFilter.value());
+  }
+}
 
-    totalTemp -= tempReadings[readIndex];
-    totalHumid -= humidReadings[readIndex];
+size_t serializeAggregate(const WindowAggregate &aggregate, char *buffer,
+                          size_t size) {
+  DynamicJsonDocument doc(256);
+  doc["value"] = aggregate.mean();
+  doc["min"] = aggregate.min();
+  doc["max"] = aggregate.max();
+  doc["stddev"] = aggregate.stddev();
+  doc["count"] = aggregate.count();
+  return serializeJson(doc, buffer, size);
+}
 
-    if (strcmp(sensorType, "dht") == 0) {
-      currentTempReadings = dht.readTemperature();
-      currentHumidReadings = dht.readHumidity();
+template <typename Sensor>
+void readAndWriteEnvironmentalSensors() {
+  uint32_t sampleInterval = std::max<uint32_t>(SENSOR_SAMPLE_INTERVAL_MS,
+                                               Sensor::minSampleIntervalMs());
+  if (millis() - lastSampleTime >= sampleInterval) {
+    lastSampleTime = millis();
+    sampleEnvironmentalSensors<Sensor>();
+  }
 
-      tempReadings[readIndex] = currentTempReadings + DHTtempOffset;
-      humidReadings[readIndex] = currentHumidReadings + DHThumidOffset;
+  if (millis() - lastReportTime >= READ_DELAY) {
+    lastReportTime = millis();
+
+    averageTemp = tempAggregate.mean();
+    averageHumid = humidAggregate.mean();
+
+    // An interval without a single good sample counts as a failed reading
+    checkAndRestartIfFailed(&averageTemp, &failedTempReadings);
+    checkAndRestartIfFailed(&averageHumid, &failedHumidReadings);
+
+    printHelper.log("DEBUG", "Outliers rejected: %u temperature, %u humidity",
+                    static_cast<unsigned>(tempFilter.rejected()),
+                    static_cast<unsigned>(humidFilter.rejected()));
+
+    bool tempPublished = false;
+    if (tempAggregate.count() > 0) {
+      char tempBuffer[192];
+      serializeAggregate(tempAggregate, tempBuffer, sizeof(tempBuffer));
+      tempPublished =
+          mqttStatus() &&
+          publishGargeSensorState(CHIP_ID, "temperature", String(tempBuffer));
+      if (!tempPublished) {
+        logReading(READING_TEMPERATURE, averageTemp);
+      }
     }
-    if (strcmp(sensorType, "bme") == 0) {
-      currentTempReadings = bme.readTemperature();
-      currentHumidReadings = bme.readHumidity();
 
-      tempReadings[readIndex] = currentTempReadings + BMEtempOffset;
-      humidReadings[readIndex] = currentHumidReadings + BMEhumidOffset;
+    bool humidPublished = false;
+    if (humidAggregate.count() > 0) {
+      char humidBuffer[192];
+      serializeAggregate(humidAggregate, humidBuffer, sizeof(humidBuffer));
+      humidPublished =
+          mqttStatus() &&
+          publishGargeSensorState(CHIP_ID, "humidity", String(humidBuffer));
+      if (!humidPublished) {
+        logReading(READING_HUMIDITY, averageHumid);
+      }
+    }
+    if (tempPublished && humidPublished) {
+      flushReadingLog(CHIP_ID);
     }
 
-    totalTemp += tempReadings[readIndex];
-    totalHumid += humidReadings[readIndex];
-
-    checkAndRestartIfFailed(&totalTemp, &failedTempReadings);
-    checkAndRestartIfFailed(&currentHumidReadings, &failedHumidReadings);
-
-    printHelper.log("INFO", "tempReadings; %.2f °C, humidReadings: %.2f %%",
-        tempReadings[readIndex],
-        humidReadings[readIndex]);
-    printHelper.log("INFO", "totalTemp: %.2f °C, totalHumid: %.2f %%",
-        totalTemp, totalHumid);
-
-    readIndex = (readIndex + 1) % arrayLength;
-
-    printHelper.log("INFO", "readIndex: %d, arrayLength: %d", readIndex,
-                    arrayLength);
-
-    averageTemp = totalTemp / arrayLength;
-    averageHumid = totalHumid / arrayLength;
-
-    DynamicJsonDocument tempDoc(256);
-    char tempBuffer[128];
-    tempDoc["value"] = averageTemp;
-    size_t tempN = serializeJson(tempDoc, tempBuffer);
-    publishGargeSensorState(CHIP_ID, "temperature", String(tempBuffer));
-
-    DynamicJsonDocument humidDoc(256);
-    char humidBuffer[128];
-    humidDoc["value"] = averageHumid;
-    size_t humidN = serializeJson(humidDoc, humidBuffer);
-    publishGargeSensorState(CHIP_ID, "humidity", String(humidBuffer));
-
-    printHelper.log("INFO", "Temperature: %.2f °C, Humidity: %.2f %%",
-                    averageTemp, averageHumid);
+    printHelper.log("INFO",
+                    "Temperature: %.2f °C (%.2f..%.2f), Humidity: %.2f %% "
+                    "(%.2f..%.2f), %u samples",
+                    averageTemp, tempAggregate.min(), tempAggregate.max(),
+                    averageHumid, humidAggregate.min(), humidAggregate.max(),
+                    static_cast<unsigned>(tempAggregate.count()));
+
+    // Kept whether or not the broker took it, for the local /history page
+    float record[HISTORY_COLUMN_COUNT] = {
+        tempAggregate.mean(),  tempAggregate.min(),  tempAggregate.max(),
+        humidAggregate.mean(), humidAggregate.min(), humidAggregate.max(),
+    };
+    recordHistory(static_cast<uint32_t>(time(nullptr)), record);
+
+    tempAggregate.reset();
+    humidAggregate.reset();
   }
 }
+
+// One per sensor policy; the linker drops the ones a build does not call
+template void environmentalSensorSetup<BmeSensor>();
+template void environmentalSensorSetup<DhtSensor>();
+template void environmentalSensorSetup<AutoSensor>();
+template void readAndWriteEnvironmentalSensors<BmeSensor>();
+template void readAndWriteEnvironmentalSensors<DhtSensor>();
+template void readAndWriteEnvironmentalSensors<AutoSensor>();
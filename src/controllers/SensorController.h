@@ -3,49 +3,65 @@
 #ifndef SRC_CONTROLLERS_SENSORCONTROLLER_H_
 #define SRC_CONTROLLERS_SENSORCONTROLLER_H_
 
-#include <Adafruit_BME280.h>
-#include <Adafruit_Sensor.h>
 #include <ArduinoJson.h>
-#include <DHT.h>
 #include <PubSubClient.h>
-#include <WiFiClientSecure.h>
-#include <Wire.h>
 
 #include <cmath>
 #include <cstdint>
 
+#include "FilterChain.h"
+#include "SensorDrivers.h"
+#include "WindowAggregate.h"
 #include "helpers/PRINTHelper.h"
+#include "helpers/TLSClient.h"
 
-extern DHT dht;
-extern Adafruit_BME280 bme;
-extern WiFiClientSecure *secureClient;
+extern TLSClient *secureClient;
 extern PubSubClient *mqttClient;
 extern String CHIP_ID;
 extern PRINTHelper printHelper;
 
-extern float BMEtempOffset;
-extern float BMEhumidOffset;
-extern float DHTtempOffset;
-extern float DHThumidOffset;
-
+// Reporting interval: one aggregate record per quantity
 const int READ_DELAY = 60000;
 const int READING_BUFFER = 5;
 
+// Sampling interval, 1 Hz unless set from the build flags. The BME280 runs in
+// forced mode and manages 10 Hz; DHT builds are held to
+// DHT_MIN_SAMPLE_INTERVAL_MS, see SensorDrivers.h.
+#ifndef SENSOR_SAMPLE_INTERVAL_MS
+#define SENSOR_SAMPLE_INTERVAL_MS 1000
+#endif
+
+// Build with SENSOR_LOG_RAW_READINGS to log every raw sample, the input of
+// scripts/log_to_trace.py. Off by default: at 1 Hz it is a line a second.
+
+// Changes smaller than these always pass the outlier stage, see FilterChain
+constexpr float TEMP_FILTER_MIN_DEVIATION = 1.0;
+constexpr float HUMID_FILTER_MIN_DEVIATION = 3.0;
+
+// Hundredths of a degree or percent, the BME280 and DHT resolution
+typedef FilterChain<int16_t, READING_BUFFER> SensorFilter;
+
 extern float averageHumid;
 extern float averageTemp;
-extern float humidReadings[READING_BUFFER];
-extern float tempReadings[READING_BUFFER];
-extern float totalHumid;
-extern float totalTemp;
-extern int readIndex;
+extern SensorFilter tempFilter;
+extern SensorFilter humidFilter;
+extern WindowAggregate tempAggregate;
+extern WindowAggregate humidAggregate;
 
 extern float currentTempReadings;
 extern float currentHumidReadings;
 extern int32_t failedTempReadings;
 extern int32_t failedHumidReadings;
 
-void environmentalSensorSetup(const char *sensorType);
+// Sensor is one of the policies in SensorDrivers.h; SensorController.cpp
+// instantiates these for each of them.
+template <typename Sensor>
+void environmentalSensorSetup();
 void checkAndRestartIfFailed(float *reading, int32_t *failedReadings);
-void readAndWriteEnvironmentalSensors(const char *sensorType);
+template <typename Sensor>
+void readAndWriteEnvironmentalSensors();
+// The state payload: mean as value, with min, max, stddev and count
+size_t serializeAggregate(const WindowAggregate &aggregate, char *buffer,
+                          size_t size);
 
 #endif  // SRC_CONTROLLERS_SENSORCONTROLLER_H_
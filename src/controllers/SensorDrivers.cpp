@@ -0,0 +1,100 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include "SensorDrivers.h"
+
+#include <cmath>
+
+#include "HardwareProbe.h"
+#include "helpers/PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+float BMEtempOffset = -3.49;
+float BMEhumidOffset = 15;
+
+float DHTtempOffset = -3;
+float DHThumidOffset = 6;
+
+bool BmeSensor::begin(uint8_t address) {
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+  if (!device().begin(address)) {
+    printHelper.log("ERROR",
+                    "Could not find a valid BME280 sensor, check wiring!");
+    return false;
+  }
+  // Forced mode: one conversion per sample, then back to sleep, which
+  // keeps self-heating down at higher sample rates
+  device().setSampling(Adafruit_BME280::MODE_FORCED,
+                       Adafruit_BME280::SAMPLING_X1,    // temperature
+                       Adafruit_BME280::SAMPLING_NONE,  // pressure
+                       Adafruit_BME280::SAMPLING_X1,    // humidity
+                       Adafruit_BME280::FILTER_OFF);
+  return true;
+}
+
+void BmeSensor::read(float *temperature, float *humidity) {
+  device().takeForcedMeasurement();
+  *temperature = device().readTemperature();
+  *humidity = device().readHumidity();
+}
+
+bool DhtSensor::begin() {
+  device().begin();
+  return true;
+}
+
+void DhtSensor::read(float *temperature, float *humidity) {
+  *temperature = device().readTemperature();
+  *humidity = device().readHumidity();
+}
+
+bool AutoSensor::begin() {
+  switch (detectedHardware()) {
+    case HARDWARE_BME280_76:
+      return BmeSensor::begin(0x76);
+    case HARDWARE_BME280_77:
+      return BmeSensor::begin(0x77);
+    case HARDWARE_DHT:
+      return DhtSensor::begin();
+    default:
+      return false;
+  }
+}
+
+void AutoSensor::read(float *temperature, float *humidity) {
+  static uint32_t failedSamples = 0;
+
+  switch (detectedHardware()) {
+    case HARDWARE_BME280_76:
+    case HARDWARE_BME280_77:
+      BmeSensor::read(temperature, humidity);
+      break;
+    case HARDWARE_DHT:
+      DhtSensor::read(temperature, humidity);
+      break;
+    default:
+      *temperature = NAN;
+      *humidity = NAN;
+      break;
+  }
+
+  if (!std::isnan(*temperature) || !std::isnan(*humidity)) {
+    failedSamples = 0;
+  } else if (++failedSamples == AUTO_SENSOR_FORGET_SAMPLES) {
+    forgetDetectedHardware();
+  }
+}
+
+float AutoSensor::temperatureOffset() {
+  return detectedHardware() == HARDWARE_DHT ? DHTtempOffset : BMEtempOffset;
+}
+
+float AutoSensor::humidityOffset() {
+  return detectedHardware() == HARDWARE_DHT ? DHThumidOffset : BMEhumidOffset;
+}
+
+uint32_t AutoSensor::minSampleIntervalMs() {
+  return detectedHardware() == HARDWARE_DHT
+             ? DhtSensor::minSampleIntervalMs()
+             : BmeSensor::minSampleIntervalMs();
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_CONTROLLERS_SENSORDRIVERS_H_
+#define SRC_CONTROLLERS_SENSORDRIVERS_H_
+
+#include <Adafruit_BME280.h>
+#include <DHT.h>
+#include <Wire.h>
+
+#include <cstdint>
+
+#ifndef I2C_SDA_PIN
+#define I2C_SDA_PIN 18
+#endif
+
+#ifndef I2C_SCL_PIN
+#define I2C_SCL_PIN 17
+#endif
+
+constexpr uint8_t BME280_I2C_ADDRESS = 0x76;
+constexpr uint8_t DHTTYPE = DHT11;
+constexpr int DHT_SENSOR_PIN = 2;
+
+// The DHT library caches a reading for 2 s and returns the cached one to any
+// read sooner than that, which the aggregates would count twice
+constexpr uint32_t DHT_MIN_SAMPLE_INTERVAL_MS = 2000;
+
+extern float BMEtempOffset;
+extern float BMEhumidOffset;
+extern float DHTtempOffset;
+extern float DHThumidOffset;
+
+// Sensor policies for the environmental controller, chosen at compile time
+// (see Device.h). Each one owns its driver as a function-local static, so the
+// driver of a sensor that is not built in is never constructed and the linker
+// drops it.
+//
+// read() returns the raw values, offsets are added by the controller.
+// minSampleIntervalMs() is the shortest interval at which read() returns a new
+// sample; the controller never samples faster than that.
+
+struct BmeSensor {
+  static constexpr const char *NAME = "bme";
+
+  static Adafruit_BME280 &device() {
+    static Adafruit_BME280 bme;
+    return bme;
+  }
+
+  static bool begin(uint8_t address = BME280_I2C_ADDRESS);
+  // One forced conversion
+  static void read(float *temperature, float *humidity);
+  static float temperatureOffset() { return BMEtempOffset; }
+  static float humidityOffset() { return BMEhumidOffset; }
+  static uint32_t minSampleIntervalMs() { return 0; }
+};
+
+struct DhtSensor {
+  static constexpr const char *NAME = "dht";
+
+  static DHT &device() {
+    static DHT dht(DHT_SENSOR_PIN, DHTTYPE, 11);
+    return dht;
+  }
+
+  static bool begin();
+  static void read(float *temperature, float *humidity);
+  static float temperatureOffset() { return DHTtempOffset; }
+  static float humidityOffset() { return DHThumidOffset; }
+  static uint32_t minSampleIntervalMs() { return DHT_MIN_SAMPLE_INTERVAL_MS; }
+};
+
+// Consecutive NaN samples after which AutoSensor drops the cached detection
+constexpr uint32_t AUTO_SENSOR_FORGET_SAMPLES = 300;
+
+// The universal image's sensor: whichever of the above detectedHardware()
+// found (HardwareProbe.h). Nothing found reads as NaN, so the controller
+// restarts into a new probe after its failure limit.
+struct AutoSensor {
+  static constexpr const char *NAME = "auto";
+
+  static bool begin();
+  static void read(float *temperature, float *humidity);
+  static float temperatureOffset();
+  static float humidityOffset();
+  static uint32_t minSampleIntervalMs();
+};
+
+#endif  // SRC_CONTROLLERS_SENSORDRIVERS_H_
@@ -2,11 +2,19 @@
 
 #include <esp_sleep.h>
 
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
 #include "../helpers/MQTTHelper.h"
+#include "../helpers/ReadingLog.h"
+#include "../helpers/VoltageCalibration.h"
+#include "../helpers/WakeProfiler.h"
 #include "VoltmeterController.h"
 
 RTC_DATA_ATTR float averageVoltage = 0;
 RTC_DATA_ATTR float voltageReadings[READING_VOLTAGE_BUFFER];
+RTC_DATA_ATTR uint32_t voltageReadingTimes[READING_VOLTAGE_BUFFER];
 RTC_DATA_ATTR float totalVoltage = 0;
 RTC_DATA_ATTR int readVoltageIndex = 0;
 RTC_DATA_ATTR bool bufferFilled = false;
@@ -14,37 +22,64 @@ RTC_DATA_ATTR bool bufferFilled = false;
 float currentVoltageReadings = 0;
 RTC_DATA_ATTR int32_t failedVoltageReadings = 0;
 RTC_DATA_ATTR int32_t failedPublishAttempts = 0;
+bool sleepPending = false;
+RTC_DATA_ATTR uint64_t sleptSinceMaintenanceUs = 0;
 
 // Default calibration values
 float a = 0.91406;
 float b = 1.02092;
 
-float readVoltage() {
-  int sensorValue = analogRead(ANALOG_IN_PIN);
-  printHelper.log("INFO", "Sensor Value value: %d", sensorValue);
-
-  // Calculate the measured voltage at the divider output
-  float voltageMeasured = (ANALOG_VOLTAGE / ANALOG_RESOLUTION) * sensorValue;
-  printHelper.log("INFO", "voltageMeasured: %.5f V", voltageMeasured);
+bool isVoltmeterFastWake() {
+  if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+    sleptSinceMaintenanceUs = 0;
+    return false;
+  }
+  if (sleptSinceMaintenanceUs >= VOLTMETER_MAINTENANCE_INTERVAL_US) {
+    sleptSinceMaintenanceUs = 0;
+    return false;
+  }
+  return true;
+}
 
-  float vinTest = voltageMeasured * ((R1 + R2) / R2);
-  printHelper.log("INFO", "vinTest: %.5f V", vinTest);
+// Makes the next timer wakeup run the full setup, e.g. after the fast path
+// failed to connect.
+void requestMaintenanceWake() {
+  sleptSinceMaintenanceUs = VOLTMETER_MAINTENANCE_INTERVAL_US;
+}
 
-  // calculated correction
-  float vinMeasuredCorrected =
-      voltageMeasured * ((R1 + R2) / R2 * CORRECTION_FACTOR);
-  printHelper.log("INFO", "vinMeasuredCorrected: %.5f V", vinMeasuredCorrected);
+// Takes VOLTAGE_BURST_SAMPLES back-to-back samples and returns the mean of
+// the middle ones, so spikes are dropped instead of averaged in.
+static float sampleAdcBurst() {
+  uint16_t samples[VOLTAGE_BURST_SAMPLES];
+  for (int i = 0; i < VOLTAGE_BURST_SAMPLES; i++) {
+#ifdef VOLTMETER_ADC_CALIBRATED
+    samples[i] = analogReadMilliVolts(ANALOG_IN_PIN);
+#else
+    samples[i] = analogRead(ANALOG_IN_PIN);
+#endif
+  }
+  std::sort(samples, samples + VOLTAGE_BURST_SAMPLES);
 
-  // exponential correction
-  float vinTestCorrectedExponential = a * pow(vinTest, b);
-  printHelper.log("INFO", "vinTestCorrectedExponential: %.5f V",
-                  vinTestCorrectedExponential);
+  uint32_t sum = 0;
+  for (int i = VOLTAGE_TRIM_SAMPLES;
+       i < VOLTAGE_BURST_SAMPLES - VOLTAGE_TRIM_SAMPLES; i++) {
+    sum += samples[i];
+  }
+  return static_cast<float>(sum) /
+         (VOLTAGE_BURST_SAMPLES - 2 * VOLTAGE_TRIM_SAMPLES);
+}
 
-  return vinTestCorrectedExponential;
+float readVoltage() {
+  float sensorValue = sampleAdcBurst();
+  uint32_t millivolts = calibratedMillivolts(lroundf(sensorValue));
+  printHelper.log("INFO", "ADC %.2f -> %u mV", sensorValue, millivolts);
+  return millivolts / 1000.0f;
 }
 
 void voltageSensorSetup(const String &mac) {
   pinMode(ANALOG_IN_PIN, INPUT);
+  analogReadResolution(12);
+  analogSetPinAttenuation(ANALOG_IN_PIN, ADC_11db);
 
   String deviceName = getGargeDeviceNameUnderscore(mac);
   for (const auto &cal : CALIBRATIONS) {
@@ -55,11 +90,20 @@ void voltageSensorSetup(const String &mac) {
       break;
     }
   }
+  if (!loadCalibration()) {
+#ifdef VOLTMETER_ADC_CALIBRATED
+    float inputToVolts = 0.001f * (R1 + R2) / R2;
+#else
+    float inputToVolts = ANALOG_VOLTAGE / ANALOG_RESOLUTION * (R1 + R2) / R2;
+#endif
+    buildCalibrationFromPowerLaw(a, b, inputToVolts);
+  }
 
   if (!bufferFilled) {
     totalVoltage = 0;
     for (int i = 0; i < READING_VOLTAGE_BUFFER; i++) {
       voltageReadings[i] = readVoltage();
+      voltageReadingTimes[i] = time(nullptr);
       totalVoltage += voltageReadings[i];
     }
     bufferFilled = true;
@@ -69,42 +113,124 @@ void voltageSensorSetup(const String &mac) {
 void voltageCheckAndRestartIfFailed(float *reading, int32_t *failedReadings) {
   printHelper.log("INFO", "Checking if reading failed");
   if (reading == nullptr || std::isnan(*reading)) {
-    printHelper.log("ERROR", "Reading: %s", String(*reading));
+    printHelper.log("ERROR", "Reading: %.5f", *reading);
     (*failedReadings) += 1;
-    printHelper.log("ERROR", "Failed count: %s", String(*failedReadings));
+    printHelper.log("ERROR", "Failed count: %d", *failedReadings);
     if (*failedReadings >= 10) {
       ESP.restart();
     }
   } else {
     printHelper.log("INFO", "Reading OK");
-    printHelper.log("INFO", "Reading: %s", String(*reading));
+    printHelper.log("INFO", "Reading: %.5f", *reading);
     *failedReadings = 0;
   }
 }
 
-void deepSleepForHour() {
-  printHelper.log("INFO", "Entering deep sleep for 1 hour");
-  esp_sleep_enable_timer_wakeup(VOLTMETER_SLEEP_INTERVAL_US);
+// Least-squares slope of the retained readings in volts per hour. Returns
+// false when the readings do not span enough time to show a trend.
+static bool voltageTrend(float *slope) {
+  uint32_t first = 0;
+  uint32_t last = 0;
+  for (int i = 0; i < READING_VOLTAGE_BUFFER; i++) {
+    uint32_t t = voltageReadingTimes[i];
+    if (t < 8 * 3600 * 2) {
+      continue;  // read before NTP sync
+    }
+    if (first == 0 || t < first) {
+      first = t;
+    }
+    if (t > last) {
+      last = t;
+    }
+  }
+  if (first == 0 || last - first < VOLTMETER_MIN_TREND_SPAN_S) {
+    return false;
+  }
+
+  float sumT = 0, sumV = 0, sumTT = 0, sumTV = 0;
+  int n = 0;
+  for (int i = 0; i < READING_VOLTAGE_BUFFER; i++) {
+    if (voltageReadingTimes[i] < first) {
+      continue;
+    }
+    float t = (voltageReadingTimes[i] - first) / 3600.0f;
+    sumT += t;
+    sumV += voltageReadings[i];
+    sumTT += t * t;
+    sumTV += t * voltageReadings[i];
+    n++;
+  }
+  float denominator = n * sumTT - sumT * sumT;
+  if (n < 2 || denominator <= 0) {
+    return false;
+  }
+  *slope = (n * sumTV - sumT * sumV) / denominator;
+  return true;
+}
+
+uint64_t nextSleepIntervalUs() {
+  if (currentVoltageReadings < VOLTMETER_ALARM_LOW_V ||
+      currentVoltageReadings > VOLTMETER_ALARM_HIGH_V) {
+    return VOLTMETER_SLEEP_MIN_US;
+  }
+
+  float slope;
+  if (!voltageTrend(&slope)) {
+    return VOLTMETER_SLEEP_INTERVAL_US;
+  }
+  printHelper.log("INFO", "Voltage trend: %.4f V/h", slope);
+  if (slope <= -VOLTMETER_FAST_DROP_V_PER_H) {
+    return VOLTMETER_SLEEP_MIN_US;
+  }
+
+  float rate = fabsf(slope);
+  if (rate < 0.001f) {
+    return VOLTMETER_SLEEP_MAX_US;
+  }
+  uint64_t interval = VOLTMETER_TARGET_DELTA_V / rate * 3600.0f * 1000000.0f;
+  if (interval < VOLTMETER_SLEEP_MIN_US) {
+    return VOLTMETER_SLEEP_MIN_US;
+  }
+  if (interval > VOLTMETER_SLEEP_MAX_US) {
+    return VOLTMETER_SLEEP_MAX_US;
+  }
+  return interval;
+}
+
+void enterDeepSleep() {
+  uint64_t interval = nextSleepIntervalUs();
+  printHelper.log("INFO", "Entering deep sleep for %u s",
+                  static_cast<uint32_t>(interval / 1000000ULL));
+  sleptSinceMaintenanceUs += interval;
+  esp_sleep_enable_timer_wakeup(interval);
+  finishWakeProfile();
   Serial.flush();
   esp_deep_sleep_start();
 }
 
-void readAndWriteVoltageSensor() {
-  static uint32_t lastVoltageAttempt = 0;
-  const uint32_t voltageReadInterval = 5000;  // 5 seconds
-
-  if (millis() - lastVoltageAttempt < voltageReadInterval) {
+// Sleeps right away unless an OTA download is running, in which case the
+// sleep is postponed until the download has finished or failed.
+void requestDeepSleep() {
+  sleepPending = true;
+  if (OTA_IN_PROGRESS) {
+    printHelper.log("INFO", "OTA in progress, postponing deep sleep.");
     return;
   }
-  lastVoltageAttempt = millis();
+  enterDeepSleep();
+}
 
+// Reads the voltage into currentVoltageReadings and the retained readings,
+// with its timestamp for the trend
+static void takeVoltageReading() {
   if (!bufferFilled) {
     voltageSensorSetup(CHIP_ID);
   }
   int arrayLength = sizeof(voltageReadings) / sizeof(voltageReadings[0]);
 
+  currentVoltageReadings = readVoltage();
   totalVoltage -= voltageReadings[readVoltageIndex];
-  voltageReadings[readVoltageIndex] = readVoltage();
+  voltageReadings[readVoltageIndex] = currentVoltageReadings;
+  voltageReadingTimes[readVoltageIndex] = time(nullptr);
   totalVoltage += voltageReadings[readVoltageIndex];
 
   voltageCheckAndRestartIfFailed(&totalVoltage, &failedVoltageReadings);
@@ -112,7 +238,35 @@ void readAndWriteVoltageSensor() {
   readVoltageIndex = (readVoltageIndex + 1) % arrayLength;
   averageVoltage = totalVoltage / arrayLength;
 
-  printHelper.log("INFO", "Battery Voltage: %.5f V", averageVoltage);
+  printHelper.log("INFO", "Battery Voltage: %.5f V (average %.5f V)",
+                  currentVoltageReadings, averageVoltage);
+}
+
+void logVoltageAndSleep() {
+  takeVoltageReading();
+  logReading(READING_VOLTAGE, currentVoltageReadings);
+  enterDeepSleep();
+}
+
+void readAndWriteVoltageSensor() {
+  static bool firstAttempt = true;
+  static uint32_t lastVoltageAttempt = 0;
+  const uint32_t voltageReadInterval = 5000;  // 5 seconds
+
+  if (sleepPending) {
+    if (!OTA_IN_PROGRESS) {
+      enterDeepSleep();
+    }
+    return;
+  }
+
+  if (!firstAttempt && millis() - lastVoltageAttempt < voltageReadInterval) {
+    return;
+  }
+  firstAttempt = false;
+  lastVoltageAttempt = millis();
+
+  takeVoltageReading();
 
   if (!mqttStatus() || failedPublishAttempts >= 5) {
     failedPublishAttempts++;
@@ -120,7 +274,8 @@ void readAndWriteVoltageSensor() {
       printHelper.log("WARN", "MQTT issue (Max attempts reached), sleeping.",
                       failedPublishAttempts);
       failedPublishAttempts = 0;
-      deepSleepForHour();
+      logReading(READING_VOLTAGE, currentVoltageReadings);
+      requestDeepSleep();
     } else {
       printHelper.log("WARN", "MQTT issue (attempt %d/5).",
                       failedPublishAttempts);
@@ -131,17 +286,20 @@ void readAndWriteVoltageSensor() {
   DynamicJsonDocument doc(1024);
   char buffer[256];
 
-  doc["value"] = averageVoltage;
-  size_t n = serializeJson(doc, buffer);
+  doc["value"] = currentVoltageReadings;
+  serializeJson(doc, buffer);
 
   bool publishSuccess =
       publishGargeSensorState(CHIP_ID, "voltage", String(buffer));
 
   if (publishSuccess) {
+    markWakePhase(WAKE_PHASE_PUBLISHED);
     failedPublishAttempts = 0;
+    publishWakeProfile(CHIP_ID);
+    flushReadingLog(CHIP_ID);
     mqttClient->loop();
     delay(500);
-    deepSleepForHour();
+    requestDeepSleep();
   } else {
     failedPublishAttempts++;
     printHelper.log("WARN", "Publish failed (attempt %d/5).",
@@ -12,15 +12,25 @@
 extern PubSubClient *mqttClient;
 extern String CHIP_ID;
 extern PRINTHelper printHelper;
+extern volatile bool OTA_IN_PROGRESS;
 
 const int ANALOG_IN_PIN = A0;
 const int ANALOG_RESOLUTION = 4096;     // 10-bit resolution
 const float ANALOG_VOLTAGE = 3.32;      // Reference voltage for ESP32 ADC
 const float R1 = 33000.0;               // 47kΩ
 const float R2 = 10000.0;               // 4.7kΩ
-const float CORRECTION_FACTOR = 1.218;  // multimeter voltage / voltageMeasured
 
-// Corrected constants for exponential correction
+// Each reading is the trimmed mean of a burst of samples taken in one wake;
+// VOLTAGE_TRIM_SAMPLES are dropped from each end after sorting. Define
+// VOLTMETER_ADC_CALIBRATED to sample with the eFuse calibration
+// (analogReadMilliVolts) instead of raw codes scaled by ANALOG_VOLTAGE. The
+// CALIBRATIONS below were fitted against raw codes, so a device switched over
+// needs new calibration points.
+constexpr int VOLTAGE_BURST_SAMPLES = 64;
+constexpr int VOLTAGE_TRIM_SAMPLES = 16;
+
+// Power-law correction, used to build the calibration table for devices that
+// have no calibration points in NVS (see helpers/VoltageCalibration.h).
 // Constants a and b are calculated based on curve fitting using known points:
 // Point 1: (Measured Voltage: 5.31395, Actual Voltage: 5.03)
 // Point 2: (Measured Voltage: 13.05305, Actual Voltage: 12.59)
@@ -79,14 +89,44 @@ constexpr uint64_t VOLTMETER_SLEEP_INTERVAL_US =
 
 // constexpr uint64_t VOLTMETER_SLEEP_INTERVAL_US = 30000000ULL;  // 30 seconds
 
+// Adaptive sleep: the interval is chosen so the voltage is expected to move
+// about VOLTMETER_TARGET_DELTA_V between readings, based on the trend of the
+// retained readings, and clamped to [MIN, MAX]. VOLTMETER_SLEEP_INTERVAL_US
+// is used until there is enough history.
+constexpr uint64_t VOLTMETER_SLEEP_MIN_US = 15ULL * 60ULL * 1000000ULL;
+constexpr uint64_t VOLTMETER_SLEEP_MAX_US = 6ULL * 3600ULL * 1000000ULL;
+constexpr float VOLTMETER_TARGET_DELTA_V = 0.05;
+constexpr float VOLTMETER_FAST_DROP_V_PER_H = 0.2;
+constexpr uint32_t VOLTMETER_MIN_TREND_SPAN_S = 30 * 60;
+// Outside this range every reading matters, so sleep the minimum interval
+constexpr float VOLTMETER_ALARM_LOW_V = 12.0;
+constexpr float VOLTMETER_ALARM_HIGH_V = 14.8;
+
+// Timer wakeups take the fast path (sample, connect, publish, sleep). Once
+// the requested sleep intervals add up to VOLTMETER_MAINTENANCE_INTERVAL_US
+// the wake runs the full setup instead, for NTP, OTA and calibration updates.
+// Counting sleep time rather than wakes keeps maintenance about daily whether
+// the adaptive interval is 15 minutes or 6 hours; the RTC slow clock drift
+// only shifts it by a few percent.
+constexpr uint64_t VOLTMETER_MAINTENANCE_INTERVAL_US =
+    24ULL * 3600ULL * 1000000ULL;  // 24 hours
+
 extern float averageVoltage;
 extern float voltageReadings[READING_VOLTAGE_BUFFER];
+extern uint32_t voltageReadingTimes[READING_VOLTAGE_BUFFER];
 extern float totalVoltage;
 extern int readVoltageIndex;
 
 extern float currentVoltageReadings;
 extern int32_t failedVoltageReadings;
 
+bool isVoltmeterFastWake();
+void requestMaintenanceWake();
+uint64_t nextSleepIntervalUs();
+void enterDeepSleep();
+// For wakes that cannot reach the broker: the reading still goes into the
+// retained readings and the reading log, and the sleep interval follows it
+void logVoltageAndSleep();
 float readVoltage();
 void voltageSensorSetup(const String &mac);
 void voltageCheckAndRestartIfFailed(float *reading, int32_t *failedReadings);
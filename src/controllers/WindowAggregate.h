@@ -0,0 +1,55 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_CONTROLLERS_WINDOWAGGREGATE_H_
+#define SRC_CONTROLLERS_WINDOWAGGREGATE_H_
+
+#include <cmath>
+#include <cstdint>
+
+// Mean, min, max and standard deviation of one channel over a reporting
+// interval. Welford's update keeps it O(1) in time and memory per sample and
+// avoids the cancellation of a sum-of-squares variance in float.
+class WindowAggregate {
+ public:
+  void reset() {
+    count_ = 0;
+    mean_ = 0;
+    m2_ = 0;
+  }
+
+  // NaN samples are ignored
+  void add(float value) {
+    if (std::isnan(value)) {
+      return;
+    }
+    if (count_ == 0) {
+      min_ = value;
+      max_ = value;
+    } else {
+      min_ = value < min_ ? value : min_;
+      max_ = value > max_ ? value : max_;
+    }
+    count_++;
+    float delta = value - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (value - mean_);
+  }
+
+  uint32_t count() const { return count_; }
+
+  // All NaN while the window is empty
+  float mean() const { return count_ > 0 ? mean_ : NAN; }
+  float min() const { return count_ > 0 ? min_ : NAN; }
+  float max() const { return count_ > 0 ? max_ : NAN; }
+  // Population standard deviation of the window
+  float stddev() const { return count_ > 0 ? sqrtf(m2_ / count_) : NAN; }
+
+ private:
+  uint32_t count_ = 0;
+  float mean_ = 0;
+  float m2_ = 0;
+  float min_ = 0;
+  float max_ = 0;
+};
+
+#endif  // SRC_CONTROLLERS_WINDOWAGGREGATE_H_
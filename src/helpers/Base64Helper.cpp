@@ -0,0 +1,49 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <vector>
+
+#include "Base64Helper.h"
+
+typedef unsigned char uchar;
+static const char base64_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+std::string base64_encode(const std::string &in) {
+  std::string out;
+
+  int val = 0, valb = -6;
+  for (uchar c : in) {
+    val = (val << 8) + c;
+    valb += 8;
+    while (valb >= 0) {
+      out.push_back(static_cast<char>(base64_table[(val >> valb) & 0x3F]));
+      valb -= 6;
+    }
+  }
+  if (valb > -6)
+    out.push_back(
+        static_cast<char>(base64_table[((val << 8) >> (valb + 8)) & 0x3F]));
+  while (out.size() % 4)
+    out.push_back('=');
+  return out;
+}
+
+std::string base64_decode(const std::string &in) {
+  std::string out;
+
+  std::vector<int> T(256, -1);
+  for (int i = 0; i < 64; i++)
+    T[static_cast<unsigned char>(base64_table[i])] = i;
+
+  int val = 0, valb = -8;
+  for (uchar c : in) {
+    if (T[c] == -1)
+      break;
+    val = (val << 6) + T[c];
+    valb += 6;
+    if (valb >= 0) {
+      out.push_back(static_cast<char>((val >> valb) & 0xFF));
+      valb -= 8;
+    }
+  }
+  return out;
+}
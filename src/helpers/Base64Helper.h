@@ -0,0 +1,11 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_BASE64HELPER_H_
+#define SRC_HELPERS_BASE64HELPER_H_
+
+#include <string>
+
+std::string base64_encode(const std::string &in);
+std::string base64_decode(const std::string &in);
+
+#endif  // SRC_HELPERS_BASE64HELPER_H_
@@ -0,0 +1,148 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <cstring>
+#include <utility>
+
+#include "DeltaPatcher.h"
+
+static const char DELTA_MAGIC[4] = {'G', 'D', 'P', '1'};
+static const size_t DELTA_HEADER_SIZE = 8;
+static const size_t DELTA_CONTROL_SIZE = 12;
+static const size_t DELTA_BLOCK = 256;
+
+static uint32_t readLE32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+DeltaPatcher::DeltaPatcher(const esp_partition_t *base, OTASink output)
+    : base(base), output(std::move(output)) {}
+
+// Accumulates up to size bytes of a fixed-size field, returning how many
+// bytes of data were consumed.
+size_t DeltaPatcher::readField(const uint8_t *data, size_t len, size_t size) {
+  size_t n = size - fieldLen;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(field + fieldLen, data, n);
+  fieldLen += n;
+  return n;
+}
+
+bool DeltaPatcher::parseHeader() {
+  if (memcmp(field, DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0) {
+    return false;
+  }
+  targetSize = readLE32(field + 4);
+  return targetSize > 0;
+}
+
+bool DeltaPatcher::parseControl() {
+  diffRemaining = readLE32(field);
+  extraRemaining = readLE32(field + 4);
+  seek = static_cast<int32_t>(readLE32(field + 8));
+  if (written + diffRemaining + extraRemaining > targetSize ||
+      basePos + diffRemaining > base->size) {
+    return false;
+  }
+  state = diffRemaining > 0 ? DIFF : EXTRA;
+  if (state == EXTRA && extraRemaining == 0) {
+    finishRecord();
+  }
+  return true;
+}
+
+void DeltaPatcher::finishRecord() {
+  int64_t next = static_cast<int64_t>(basePos) + seek;
+  if (next < 0 || next > base->size) {
+    state = FAILED;
+    return;
+  }
+  basePos = next;
+  state = written == targetSize ? DONE : CONTROL;
+}
+
+bool DeltaPatcher::emit(const uint8_t *data, size_t len) {
+  if (!output(data, len)) {
+    return false;
+  }
+  written += len;
+  return true;
+}
+
+// Adds diff bytes to the base image and emits the result. Returns the number
+// of bytes consumed, or 0 on failure.
+size_t DeltaPatcher::applyDiff(const uint8_t *data, size_t len) {
+  uint8_t block[DELTA_BLOCK];
+  size_t n = len < diffRemaining ? len : diffRemaining;
+  if (n > sizeof(block)) {
+    n = sizeof(block);
+  }
+  if (esp_partition_read(base, basePos, block, n) != ESP_OK) {
+    return 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    block[i] += data[i];
+  }
+  if (!emit(block, n)) {
+    return 0;
+  }
+  basePos += n;
+  diffRemaining -= n;
+  return n;
+}
+
+bool DeltaPatcher::write(const uint8_t *data, size_t len) {
+  while (len > 0 && state != FAILED) {
+    size_t n = 0;
+    switch (state) {
+      case HEADER:
+        n = readField(data, len, DELTA_HEADER_SIZE);
+        if (fieldLen == DELTA_HEADER_SIZE) {
+          fieldLen = 0;
+          state = parseHeader() ? CONTROL : FAILED;
+        }
+        break;
+      case CONTROL:
+        n = readField(data, len, DELTA_CONTROL_SIZE);
+        if (fieldLen == DELTA_CONTROL_SIZE) {
+          fieldLen = 0;
+          if (!parseControl()) {
+            state = FAILED;
+          }
+        }
+        break;
+      case DIFF:
+        n = applyDiff(data, len);
+        if (n == 0) {
+          state = FAILED;
+        } else if (diffRemaining == 0) {
+          state = EXTRA;
+          if (extraRemaining == 0) {
+            finishRecord();
+          }
+        }
+        break;
+      case EXTRA:
+        n = len < extraRemaining ? len : extraRemaining;
+        if (!emit(data, n)) {
+          state = FAILED;
+          break;
+        }
+        extraRemaining -= n;
+        if (extraRemaining == 0) {
+          finishRecord();
+        }
+        break;
+      case DONE:
+        // Trailing bytes after the last record mean a corrupt patch
+        state = FAILED;
+        break;
+      case FAILED:
+        break;
+    }
+    data += n;
+    len -= n;
+  }
+  return state != FAILED;
+}
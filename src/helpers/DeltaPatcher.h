@@ -0,0 +1,55 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_DELTAPATCHER_H_
+#define SRC_HELPERS_DELTAPATCHER_H_
+
+#include <esp_partition.h>
+
+#include <cstdint>
+#include <functional>
+
+typedef std::function<bool(const uint8_t *data, size_t len)> OTASink;
+
+// Applies a streamed delta patch against a base firmware image.
+//
+// Patch format (little endian), produced by scripts/create_delta_patch.py:
+//   "GDP1", u32 target size
+//   repeated: u32 diffLen, u32 extraLen, i32 seek,
+//             diffLen diff bytes, extraLen extra bytes
+// Diff bytes are added to the base image at the current position, extra
+// bytes are copied verbatim and the base position is then moved by seek.
+// These are bsdiff control triples, interleaved so the patch can be applied
+// in a single forward pass while it downloads.
+class DeltaPatcher {
+ public:
+  DeltaPatcher(const esp_partition_t *base, OTASink output);
+  bool write(const uint8_t *data, size_t len);
+  bool isComplete() const { return state == DONE; }
+  uint32_t getTargetSize() const { return targetSize; }
+
+ private:
+  enum State { HEADER, CONTROL, DIFF, EXTRA, DONE, FAILED };
+
+  const esp_partition_t *base;
+  OTASink output;
+  State state = HEADER;
+
+  uint8_t field[12];
+  size_t fieldLen = 0;
+
+  uint32_t targetSize = 0;
+  uint32_t written = 0;
+  uint32_t basePos = 0;
+  uint32_t diffRemaining = 0;
+  uint32_t extraRemaining = 0;
+  int32_t seek = 0;
+
+  size_t readField(const uint8_t *data, size_t len, size_t size);
+  bool parseHeader();
+  bool parseControl();
+  void finishRecord();
+  bool emit(const uint8_t *data, size_t len);
+  size_t applyDiff(const uint8_t *data, size_t len);
+};
+
+#endif  // SRC_HELPERS_DELTAPATCHER_H_
@@ -5,6 +5,8 @@
 #include <regex>
 #include <string>
 
+#include "controllers/Device.h"
+
 extern void checkSerialForCredentials();
 
 const char *TOPIC_ROOT = "garge/devices/";
@@ -44,6 +46,10 @@ String getDiscoveryTopic(const String &mac, const String &targetDeviceId) {
          "/discovered";
 }
 
+String getCalibrationTopic(const String &mac) {
+  return getBaseTopic(mac) + "calibration";
+}
+
 String getDeviceSetTopic(const String &targetDeviceId) {
   return String(TOPIC_ROOT) + targetDeviceId + "/set";
 }
@@ -60,6 +66,8 @@ void publishGargeSensorConfig(const String &mac, const char *type,
   doc["name"] = getGargeDeviceNameSpace(mac) + " " + type;
   doc["stat_cla"] = "measurement";
   doc["stat_t"] = stateTopic;
+  // Environmental states also carry min, max, stddev and count
+  doc["json_attr_t"] = stateTopic;
   doc["unit_of_meas"] = unit;
   doc["dev_cla"] = devClass;
   doc["frc_upd"] = true;
@@ -91,6 +99,39 @@ bool publishGargeSensorState(const String &mac, const char *type,
   return publish;
 }
 
+bool publishGargeBackfill(const String &mac, const uint8_t *payload,
+                          size_t length) {
+  String backfillTopic = getBaseTopic(mac) + "backfill";
+  bool publish = mqttClient->publish(backfillTopic.c_str(), payload, length);
+
+  printHelper.log("DEBUG", "Publishing backfill for %s: %u bytes",
+                  backfillTopic.c_str(), length);
+  printHelper.log("INFO", "Publishing backfill for %s: %s",
+                  backfillTopic.c_str(), publish ? "Success" : "Failed");
+  return publish;
+}
+
+bool publishGargeOtaProgress(const String &mac, const String &payload) {
+  String stateTopic = getSensorStateTopic(mac, "ota");
+  bool publish = mqttClient->publish(stateTopic.c_str(), payload.c_str());
+
+  printHelper.log("DEBUG", "Publishing OTA progress for %s: %s",
+                  stateTopic.c_str(), publish ? "Success" : "Failed");
+  return publish;
+}
+
+bool publishGargeDiagnostics(const String &mac, const String &payload) {
+  String diagnosticsTopic = getBaseTopic(mac) + "diagnostics";
+  bool publish =
+      mqttClient->publish(diagnosticsTopic.c_str(), payload.c_str());
+
+  printHelper.log("DEBUG", "Publishing diagnostics for %s: %s",
+                  diagnosticsTopic.c_str(), payload.c_str());
+  printHelper.log("INFO", "Publishing diagnostics for %s: %s",
+                  diagnosticsTopic.c_str(), publish ? "Success" : "Failed");
+  return publish;
+}
+
 void publishGargeDiscoveryEvent(const String &mac, const String &deviceName,
                                 const String &type) {
   String discoveryTopic =
@@ -168,15 +209,8 @@ void publishDiscoveredWizState(const String &mac, const String &deviceName,
                   payload.c_str());
 }
 
-void mqttCallback(char *topic, byte *payload, unsigned int length) {
-  printHelper.log("INFO", "Message arrived [%s]", topic);
-
-  String payloadStr;
-  for (unsigned int i = 0; i < length; i++) {
-    payloadStr += static_cast<char>(payload[i]);
-  }
-  printHelper.log("DEBUG", "Payload: %s", payloadStr.c_str());
-
+// Switches the WiZ device named in a .../set topic and publishes its state.
+static void handleWizMessage(const char *topic, const String &payloadStr) {
   std::string topicStr(topic);
   size_t lastSlash = topicStr.rfind('/');
   size_t secondLastSlash = topicStr.rfind('/', lastSlash - 1);
@@ -241,9 +275,31 @@ void mqttCallback(char *topic, byte *payload, unsigned int length) {
   }
 }
 
+void mqttCallback(char *topic, byte *payload, unsigned int length) {
+  printHelper.log("INFO", "Message arrived [%s]", topic);
+
+  if (getCalibrationTopic(CHIP_ID) == topic) {
+    applyCalibrationPayload(payload, length);
+    return;
+  }
+
+  String payloadStr;
+  for (unsigned int i = 0; i < length; i++) {
+    payloadStr += static_cast<char>(payload[i]);
+  }
+  printHelper.log("DEBUG", "Payload: %s", payloadStr.c_str());
+
+  if constexpr (GargeDevice::Bridge::ENABLED) {
+    handleWizMessage(topic, payloadStr);
+  }
+}
+
 bool mqttStatus() { return mqttClient->connected(); }
 
-void connectToMQTT() {
+// Connects to the broker, retrying every 5 seconds. maxAttempts of 0 keeps
+// retrying until connected or the credentials change; otherwise it returns
+// right after the last attempt fails.
+void connectToMQTT(int maxAttempts) {
   printHelper.log("INFO", "Attempting to connect to MQTT broker: %s",
                   MQTT_BROKER);
 
@@ -253,10 +309,19 @@ void connectToMQTT() {
 
   String lastUsername = EEPROM_MQTT_USERNAME;
   String lastPassword = EEPROM_MQTT_PASSWORD;
+  int attempts = 0;
 
   while (!mqttClient->connected()) {
-    liz::clearDiscoveredDevices();
-    printHelper.log("INFO", "Clearing Discovered Devices");
+    if (maxAttempts > 0 && attempts++ >= maxAttempts) {
+      printHelper.log("WARN", "MQTT not connected after %d attempts",
+                      maxAttempts);
+      break;
+    }
+
+    if constexpr (GargeDevice::Bridge::ENABLED) {
+      liz::clearDiscoveredDevices();
+      printHelper.log("INFO", "Clearing Discovered Devices");
+    }
 
     printHelper.log("DEBUG", "WiFi.status(): %d, IP: %s", WiFi.status(),
                     WiFi.localIP().toString().c_str());
@@ -283,19 +348,9 @@ void connectToMQTT() {
     if (mqttClient->connect(CHIP_ID.c_str(), EEPROM_MQTT_USERNAME.c_str(),
                             EEPROM_MQTT_PASSWORD.c_str())) {
       printHelper.log("INFO", "MQTT connected");
+      markWakePhase(WAKE_PHASE_MQTT);
 
-      if (strcmp(GARGE_TYPE, "sensor") == 0) {
-        publishGargeSensorConfig(
-            CHIP_ID.c_str(), "temperature", "°C", "temperature",
-            "{{value_json.temperature | round(3) | default(0)}}");
-        publishGargeSensorConfig(
-            CHIP_ID.c_str(), "humidity", "%", "humidity",
-            "{{value_json.humidity | round(3) | default(0)}}");
-      } else if (strcmp(GARGE_TYPE, "voltmeter") == 0) {
-        publishGargeSensorConfig(
-            CHIP_ID.c_str(), "voltage", "V", "voltage",
-            "{{value_json.voltage | round(3) | default(0)}}");
-      }
+      GargeDevice::publishDiscovery();
     } else {
       printHelper.log("ERROR", "MQTT connection failed! Error code = %d",
                       mqttClient->state());
@@ -306,12 +361,15 @@ void connectToMQTT() {
                       secureClient->connected(), errcode, errbuf);
       printHelper.log("DEBUG", "WiFi.status(): %d, IP: %s", WiFi.status(),
                       WiFi.localIP().toString().c_str());
-    }
 
-    int64_t waitStart = millis();
-    while (millis() - waitStart < 5000) {
-      checkSerialForCredentials();
-      delay(10);
+      if (maxAttempts > 0 && attempts >= maxAttempts) {
+        continue;  // no retry left, so no point waiting for one
+      }
+      int64_t waitStart = millis();
+      while (millis() - waitStart < 5000) {
+        checkSerialForCredentials();
+        delay(10);
+      }
     }
   }
 }
@@ -6,14 +6,16 @@
 #include <ArduinoJson.h>
 #include <PubSubClient.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
 
 #include <regex>
 #include <string>
 #include <vector>
 
-#include "../lib/liz/src/liz.h"
+#include "liz.h"
 #include "PRINTHelper.h"
+#include "TLSClient.h"
+#include "VoltageCalibration.h"
+#include "WakeProfiler.h"
 
 extern String CHIP_ID;
 extern const char *MQTT_BROKER;
@@ -24,10 +26,15 @@ extern const int port;
 
 extern std::vector<std::pair<String, String>> discoveredDevices;
 extern PRINTHelper printHelper;
-extern WiFiClientSecure *secureClient;
+extern TLSClient *secureClient;
 extern PubSubClient *mqttClient;
 
 String getGargeDeviceNameUnderscore(const String &mac);
+String getBaseTopic(const String &mac);
+String getSensorConfigTopic(const String &mac, const char *type);
+String getSensorStateTopic(const String &mac, const char *type);
+String getDeviceSetTopic(const String &targetDeviceId);
+String getCalibrationTopic(const String &mac);
 
 void publishGargeSensorConfig(const String &mac, const char *type,
                               const char *unit, const char *devClass,
@@ -40,11 +47,15 @@ void publishDiscoveredDeviceState(const String &mac, const String &deviceName,
                                   const String &payload);
 void publishDiscoveredWizState(const String &mac, const String &deviceName,
                                bool lightState);
+bool publishGargeBackfill(const String &mac, const uint8_t *payload,
+                          size_t length);
+bool publishGargeOtaProgress(const String &mac, const String &payload);
+bool publishGargeDiagnostics(const String &mac, const String &payload);
 void publishGargeDiscoveryEvent(const String &mac, const String &deviceName,
                                 const String &type);
 
 void mqttCallback(char *topic, byte *payload, unsigned int length);
 bool mqttStatus();
-void connectToMQTT();
+void connectToMQTT(int maxAttempts = 0);
 
 #endif  // SRC_HELPERS_MQTTHELPER_H_
@@ -1,16 +1,30 @@
 // Copyright (c) 2023-2025 Sondre Sjølyst
 
-#include <ArduinoJson.h>
 #include <ArduinoOTA.h>
 #include <ESPmDNS.h>
 #include <HTTPClient.h>
+#include <Preferences.h>
 #include <Update.h>
 #include <WiFi.h>
 #include <WiFiUdp.h>
+#include <esp_ota_ops.h>
+#include <esp_rom_crc.h>
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 
+#include "DeltaPatcher.h"
 #include "OTAHelper.h"
+#include "rom/miniz.h"
+
+static const char *OTA_PREFS_NAMESPACE = "ota";
+static const uint32_t OTA_STREAM_TIMEOUT = 10000;
+static const size_t OTA_INPUT_CHUNK = 1024;
+static const uint32_t OTA_TASK_STACK = 12288;
+static const UBaseType_t OTA_TASK_PRIORITY = 1;
+static const BaseType_t OTA_TASK_CORE = 0;
 
 void onStart() { printHelper.log("INFO", "OTA Start"); }
 
@@ -34,7 +48,7 @@ void onError(ota_error_t error) {
     printHelper.log("ERROR", "End Failed");
 }
 
-OTAHelper::OTAHelper() {}
+OTAHelper::OTAHelper() { loadManifestCache(); }
 
 void OTAHelper::setup() {
   if (WiFi.status() != WL_CONNECTED) {
@@ -53,67 +67,311 @@ void OTAHelper::setup() {
 
 void OTAHelper::loop() { ArduinoOTA.handle(); }
 
-int versionCompare(const char *v1, const char *v2) {
-  int maj1, min1, pat1;
-  int maj2, min2, pat2;
-  sscanf(v1, "v%d.%d.%d", &maj1, &min1, &pat1);
-  sscanf(v2, "v%d.%d.%d", &maj2, &min2, &pat2);
+// FNV-1a, used to spread devices deterministically over slots and buckets.
+static uint32_t hashString(const String &s) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < s.length(); i++) {
+    hash ^= static_cast<uint8_t>(s[i]);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
 
-  if (maj1 != maj2)
-    return maj1 - maj2;
-  if (min1 != min2)
-    return min1 - min2;
-  return pat1 - pat2;
+// Local day number, or -1 if the clock has not been set by NTP yet.
+static int32_t currentDay(const struct tm &timeinfo) {
+  if (timeinfo.tm_year < 120) {
+    return -1;
+  }
+  return timeinfo.tm_year * 366 + timeinfo.tm_yday;
 }
 
-void OTAHelper::checkAndUpdateFromManifest(const char *manifestUrl,
-                                           const char *deviceName,
-                                           const char *currentVersion) {
-  OTA_IN_PROGRESS = true;
+bool OTAHelper::isCheckDue() {
+  time_t now = time(nullptr);
+  struct tm timeinfo;
+  localtime_r(&now, &timeinfo);
+
+  int32_t today = currentDay(timeinfo);
+  if (today < 0 || today == lastCheckDay) {
+    return false;
+  }
+  if (timeinfo.tm_hour < OTA_WINDOW_START_HOUR ||
+      timeinfo.tm_hour >= OTA_WINDOW_END_HOUR) {
+    return false;
+  }
+  if (static_cast<uint32_t>(now) < nextRetryTime) {
+    return false;
+  }
+
+  uint32_t windowSeconds = (OTA_WINDOW_END_HOUR - OTA_WINDOW_START_HOUR) * 3600;
+  uint32_t slot = hashString(CHIP_ID) % windowSeconds;
+  uint32_t elapsed = (timeinfo.tm_hour - OTA_WINDOW_START_HOUR) * 3600 +
+                     timeinfo.tm_min * 60 + timeinfo.tm_sec;
+  return elapsed >= slot;
+}
+
+void OTAHelper::recordCheckResult(bool success) {
+  time_t now = time(nullptr);
+  struct tm timeinfo;
+  localtime_r(&now, &timeinfo);
+
+  if (success) {
+    // A boot check does not stand in for the nightly one
+    if (!bootCheck) {
+      lastCheckDay = currentDay(timeinfo);
+    }
+    failedChecks = 0;
+    nextRetryTime = 0;
+  } else {
+    failedChecks++;
+    uint32_t backoff = OTA_BACKOFF_BASE_S;
+    for (uint32_t i = 1; i < failedChecks && backoff < OTA_BACKOFF_MAX_S; i++) {
+      backoff *= 2;
+    }
+    if (backoff > OTA_BACKOFF_MAX_S) {
+      backoff = OTA_BACKOFF_MAX_S;
+    }
+    // Jitter the retry by up to half the backoff so failed devices spread out
+    backoff += esp_random() % (backoff / 2 + 1);
+    nextRetryTime = static_cast<uint32_t>(now) + backoff;
+    printHelper.log("WARN", "OTA check failed %u times, retrying in %u s",
+                    failedChecks, backoff);
+  }
+  saveScheduleState();
+}
+
+void OTAHelper::saveScheduleState() {
+  Preferences prefs;
+  if (!prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+    printHelper.log("WARN", "Failed to open OTA preferences");
+    return;
+  }
+  prefs.putInt("last_day", lastCheckDay);
+  prefs.putUInt("failures", failedChecks);
+  prefs.putUInt("retry_at", nextRetryTime);
+  prefs.end();
+}
+
+void OTAHelper::loadManifestCache() {
+  Preferences prefs;
+  if (!prefs.begin(OTA_PREFS_NAMESPACE, true)) {
+    return;
+  }
+  cachedEtag = prefs.getString("etag", "");
+  cachedLastModified = prefs.getString("last_mod", "");
+  cachedDeviceName = prefs.getString("device", "");
+  latest.version = prefs.getString("version", "");
+  latest.binUrl = prefs.getString("bin_url", "");
+  latest.size = prefs.getUInt("size", 0);
+  latest.compression = prefs.getString("compression", "");
+  latest.compressedUrl = prefs.getString("comp_url", "");
+  latest.compressedSize = prefs.getUInt("comp_size", 0);
+  latest.rollout = prefs.getUChar("rollout", 100);
+  latest.sha256 = prefs.getString("sha256", "");
+  latest.patchFrom = prefs.getString("patch_from", "");
+  latest.patchUrl = prefs.getString("patch_url", "");
+  latest.patchBaseSha256 = prefs.getString("patch_base", "");
+  lastCheckDay = prefs.getInt("last_day", -1);
+  failedChecks = prefs.getUInt("failures", 0);
+  nextRetryTime = prefs.getUInt("retry_at", 0);
+  prefs.end();
+}
+
+void OTAHelper::saveManifestCache() {
+  Preferences prefs;
+  if (!prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+    printHelper.log("WARN", "Failed to open OTA preferences");
+    return;
+  }
+  prefs.putString("etag", cachedEtag);
+  prefs.putString("last_mod", cachedLastModified);
+  prefs.putString("device", cachedDeviceName);
+  prefs.putString("version", latest.version);
+  prefs.putString("bin_url", latest.binUrl);
+  prefs.putUInt("size", latest.size);
+  prefs.putString("compression", latest.compression);
+  prefs.putString("comp_url", latest.compressedUrl);
+  prefs.putUInt("comp_size", latest.compressedSize);
+  prefs.putUChar("rollout", latest.rollout);
+  prefs.putString("sha256", latest.sha256);
+  prefs.putString("patch_from", latest.patchFrom);
+  prefs.putString("patch_url", latest.patchUrl);
+  prefs.putString("patch_base", latest.patchBaseSha256);
+  prefs.end();
+}
+
+// Fetches the manifest and updates the cached release with the latest
+// entry for deviceName, including the delta patch from currentVersion if the
+// manifest lists one. A conditional GET is sent when a previous result is
+// cached, and a 304 reply reuses that result without parsing.
+bool OTAHelper::fetchLatestFromManifest(const char *manifestUrl,
+                                        const char *deviceName,
+                                        const char *currentVersion) {
+  bool hasCachedResult = cachedDeviceName == deviceName &&
+                         !latest.version.isEmpty() && !latest.binUrl.isEmpty();
 
   HTTPClient http;
   http.begin(manifestUrl);
+
+  const char *headerKeys[] = {"ETag", "Last-Modified"};
+  http.collectHeaders(headerKeys, 2);
+  if (hasCachedResult) {
+    if (!cachedEtag.isEmpty()) {
+      http.addHeader("If-None-Match", cachedEtag);
+    }
+    if (!cachedLastModified.isEmpty()) {
+      http.addHeader("If-Modified-Since", cachedLastModified);
+    }
+  }
+
   int httpCode = http.GET();
-  if (httpCode != 200) {
+  if (httpCode == HTTP_CODE_NOT_MODIFIED && hasCachedResult) {
+    http.end();
+    printHelper.log("DEBUG", "Manifest not modified, cached latest: %s",
+                    latest.version.c_str());
+    return true;
+  }
+  if (httpCode != HTTP_CODE_OK) {
     printHelper.log("ERROR", "Failed to fetch manifest: %d", httpCode);
     http.end();
-    OTA_IN_PROGRESS = false;
-    return;
+    return false;
   }
 
+  String etag = http.header("ETag");
+  String lastModified = http.header("Last-Modified");
   String payload = http.getString();
   http.end();
 
-  DynamicJsonDocument doc(4096);
-  DeserializationError err = deserializeJson(doc, payload);
-  if (err) {
-    printHelper.log("ERROR", "Failed to parse manifest JSON");
+  OTARelease release;
+  if (!parseManifest(payload, deviceName, currentVersion, &release)) {
+    return false;
+  }
+
+  cachedEtag = etag;
+  cachedLastModified = lastModified;
+  cachedDeviceName = deviceName;
+  latest = release;
+  saveManifestCache();
+  return true;
+}
+
+// Runs the manifest check and download in a low-priority task pinned away
+// from the Arduino loop, so sampling and MQTT keep running until the reboot.
+bool OTAHelper::startBackgroundCheck(const char *manifestUrl,
+                                     const char *deviceName,
+                                     const char *currentVersion) {
+  if (isBusy()) {
+    return false;
+  }
+  taskDelayMs = 0;
+  bootCheck = false;
+  return startTask(manifestUrl, deviceName, currentVersion);
+}
+
+bool OTAHelper::startBootCheck(const char *manifestUrl,
+                               const char *deviceName,
+                               const char *currentVersion,
+                               uint32_t maxDelaySeconds) {
+  if (isBusy()) {
+    return false;
+  }
+  taskDelayMs =
+      maxDelaySeconds > 0 ? esp_random() % (maxDelaySeconds * 1000UL) : 0;
+  bootCheck = true;
+  printHelper.log("INFO", "Boot OTA check in %u s", taskDelayMs / 1000);
+  return startTask(manifestUrl, deviceName, currentVersion);
+}
+
+bool OTAHelper::startTask(const char *manifestUrl, const char *deviceName,
+                          const char *currentVersion) {
+  taskManifestUrl = manifestUrl;
+  taskDeviceName = deviceName;
+  taskCurrentVersion = currentVersion;
+  // Keeps a voltmeter awake until the task has run; a delayed check sets it
+  // when the delay is over
+  if (taskDelayMs == 0) {
+    OTA_IN_PROGRESS = true;
+  }
+
+  if (xTaskCreatePinnedToCore(backgroundTask, "ota", OTA_TASK_STACK, this,
+                              OTA_TASK_PRIORITY, &taskHandle,
+                              OTA_TASK_CORE) != pdPASS) {
+    printHelper.log("ERROR", "Failed to start OTA task");
+    taskHandle = nullptr;
     OTA_IN_PROGRESS = false;
-    return;
+    return false;
   }
+  return true;
+}
 
-  const char *latest_version = nullptr;
-  const char *latest_bin_url = nullptr;
+void OTAHelper::backgroundTask(void *param) {
+  OTAHelper *self = static_cast<OTAHelper *>(param);
+  if (self->taskDelayMs > 0) {
+    vTaskDelay(pdMS_TO_TICKS(self->taskDelayMs));
+  }
+  self->checkAndUpdateFromManifest(self->taskManifestUrl, self->taskDeviceName,
+                                   self->taskCurrentVersion);
+  self->taskHandle = nullptr;
+  vTaskDelete(nullptr);
+}
 
-  for (JsonObject entry : doc.as<JsonArray>()) {
-    const char *name = entry["name"];
-    const char *version = entry["version"];
-    const char *bin_url = entry["bin_url"];
-    if (name && version && bin_url && strcmp(name, deviceName) == 0) {
-      if (!latest_version || versionCompare(version, latest_version) > 0) {
-        latest_version = version;
-        latest_bin_url = bin_url;
-      }
-    }
+OTAProgress OTAHelper::getProgress() const {
+  portENTER_CRITICAL(&progressLock);
+  OTAProgress p = progress;
+  portEXIT_CRITICAL(&progressLock);
+  return p;
+}
+
+void OTAHelper::setProgressState(const char *state) {
+  portENTER_CRITICAL(&progressLock);
+  progress.state = state;
+  portEXIT_CRITICAL(&progressLock);
+}
+
+// Sets the state a job ended in and waits for the main loop to publish it.
+// Returns whether it was published.
+bool OTAHelper::reportFinalState(const char *state) {
+  setProgressState(state);
+  finalStateReported = false;
+  finalStatePending = true;
+  uint32_t start = millis();
+  while (!finalStateReported &&
+         millis() - start < OTA_FINAL_STATE_TIMEOUT_MS) {
+    delay(100);
+  }
+  finalStatePending = false;
+  if (!finalStateReported) {
+    printHelper.log("WARN", "OTA state \"%s\" was not reported", state);
+  }
+  return finalStateReported;
+}
+
+uint32_t OTAHelper::getEtaSeconds() const {
+  OTAProgress p = getProgress();
+  if (p.written == 0 || p.total <= p.written) {
+    return 0;
   }
+  uint64_t elapsed = millis() - p.startedAt;
+  return elapsed * (p.total - p.written) / p.written / 1000;
+}
 
-  if (!latest_version || !latest_bin_url) {
-    printHelper.log("ERROR",
-                    "No matching device or missing fields in manifest");
+void OTAHelper::checkAndUpdateFromManifest(const char *manifestUrl,
+                                           const char *deviceName,
+                                           const char *currentVersion) {
+  OTA_IN_PROGRESS = true;
+  portENTER_CRITICAL(&progressLock);
+  progress = OTAProgress();
+  progress.state = "checking";
+  portEXIT_CRITICAL(&progressLock);
+
+  if (!fetchLatestFromManifest(manifestUrl, deviceName, currentVersion)) {
+    recordCheckResult(false);
+    reportFinalState("failed");
     OTA_IN_PROGRESS = false;
     return;
   }
 
+  const char *latest_version = latest.version.c_str();
+
   int comparison = versionCompare(latest_version, currentVersion);
 
   if (comparison <= 0) {
@@ -123,6 +381,20 @@ void OTAHelper::checkAndUpdateFromManifest(const char *manifestUrl,
       printHelper.log("INFO", "Current version %s is newer than latest %s",
                       currentVersion, latest_version);
     }
+    recordCheckResult(true);
+    reportFinalState("idle");
+    OTA_IN_PROGRESS = false;
+    return;
+  }
+
+  // Staged rollout: the bucket is salted with the version so a different
+  // subset of the fleet goes first for each release.
+  uint32_t bucket = hashString(CHIP_ID + latest.version) % 100;
+  if (bucket >= latest.rollout) {
+    printHelper.log("INFO", "Version %s rolled out to %u%%, device bucket %u",
+                    latest_version, latest.rollout, bucket);
+    recordCheckResult(true);
+    reportFinalState("idle");
     OTA_IN_PROGRESS = false;
     return;
   }
@@ -130,33 +402,404 @@ void OTAHelper::checkAndUpdateFromManifest(const char *manifestUrl,
   printHelper.log("INFO", "New version available: %s", latest_version);
   printHelper.log("INFO", "Starting OTA update...");
 
-  http.begin(latest_bin_url);
+  if (downloadAndApply(latest, currentVersion)) {
+    printHelper.log("INFO", "OTA Success! Rebooting...");
+    if (reportFinalState("rebooting")) {
+      delay(500);  // let the TCP stack send it
+    }
+    ESP.restart();
+  } else {
+    printHelper.log("ERROR", "OTA Failed!");
+    recordCheckResult(false);
+    reportFinalState("failed");
+    OTA_IN_PROGRESS = false;
+  }
+}
+
+// Reads whatever is available from the stream, waiting up to
+// OTA_STREAM_TIMEOUT for data. Returns 0 on timeout or disconnect.
+static size_t readChunk(WiFiClient *stream, uint8_t *buf, size_t len) {
+  uint32_t start = millis();
+  while (!stream->available()) {
+    if (!stream->connected() || millis() - start > OTA_STREAM_TIMEOUT) {
+      return 0;
+    }
+    delay(1);
+  }
+  size_t avail = stream->available();
+  int n = stream->read(buf, len < avail ? len : avail);
+  return n > 0 ? n : 0;
+}
+
+static bool readExact(WiFiClient *stream, uint8_t *buf, size_t len) {
+  while (len > 0) {
+    size_t n = readChunk(stream, buf, len);
+    if (n == 0) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Skips the gzip member header (RFC 1952) so the stream is positioned at the
+// start of the raw deflate data. Adds the header length to *consumed.
+static bool skipGzipHeader(WiFiClient *stream, size_t *consumed) {
+  auto read = [stream, consumed](uint8_t *buf, size_t len) {
+    if (!readExact(stream, buf, len)) {
+      return false;
+    }
+    *consumed += len;
+    return true;
+  };
+
+  uint8_t header[10];
+  if (!read(header, sizeof(header)) || header[0] != 0x1f ||
+      header[1] != 0x8b || header[2] != 8) {
+    return false;
+  }
+
+  uint8_t flags = header[3];
+  uint8_t c;
+  if (flags & 0x04) {  // FEXTRA
+    uint8_t len[2];
+    if (!read(len, 2)) {
+      return false;
+    }
+    for (uint16_t extra = len[0] | (len[1] << 8); extra > 0; extra--) {
+      if (!read(&c, 1)) {
+        return false;
+      }
+    }
+  }
+  for (uint8_t mask : {0x08, 0x10}) {  // FNAME, FCOMMENT
+    if (flags & mask) {
+      do {
+        if (!read(&c, 1)) {
+          return false;
+        }
+      } while (c != 0);
+    }
+  }
+  if (flags & 0x02) {  // FHCRC
+    uint8_t crc[2];
+    if (!read(crc, 2)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint32_t readLittleEndian32(const uint8_t *bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+         (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+// Copies an uncompressed body to sink chunk by chunk, yielding between chunks
+// so the rest of the firmware keeps running.
+static bool copyStream(WiFiClient *stream, size_t length, const OTASink &sink) {
+  uint8_t buf[OTA_INPUT_CHUNK];
+  size_t copied = 0;
+  while (copied < length) {
+    size_t n = readChunk(stream, buf, sizeof(buf));
+    if (n == 0) {
+      printHelper.log("ERROR", "OTA stream timed out");
+      return false;
+    }
+    if (!sink(buf, n)) {
+      return false;
+    }
+    copied += n;
+    vTaskDelay(1);
+  }
+  return true;
+}
+
+// Inflates a gzip body into sink using the ROM miniz decompressor. The 32 KB
+// dictionary doubles as the output buffer. The member trailer is checked
+// against the output (CRC32 and ISIZE), and the whole member against
+// compressedSize unless that is 0.
+static bool inflateStream(WiFiClient *stream, const OTASink &sink,
+                          size_t compressedSize) {
+  size_t consumed = 0;
+  if (!skipGzipHeader(stream, &consumed)) {
+    printHelper.log("ERROR", "Invalid gzip header");
+    return false;
+  }
+
+  tinfl_decompressor *inflator =
+      static_cast<tinfl_decompressor *>(malloc(sizeof(tinfl_decompressor)));
+  uint8_t *dict = static_cast<uint8_t *>(malloc(TINFL_LZ_DICT_SIZE));
+  uint8_t *input = static_cast<uint8_t *>(malloc(OTA_INPUT_CHUNK));
+  if (!inflator || !dict || !input) {
+    printHelper.log("ERROR", "Not enough heap for OTA decompression");
+    free(inflator);
+    free(dict);
+    free(input);
+    return false;
+  }
+  tinfl_init(inflator);
+
+  size_t inLen = 0;
+  size_t inPos = 0;
+  size_t dictOfs = 0;
+  uint32_t crc = 0;
+  uint32_t inflated = 0;
+  tinfl_status status;
+  do {
+    if (inPos == inLen) {
+      inLen = readChunk(stream, input, OTA_INPUT_CHUNK);
+      inPos = 0;
+      if (inLen == 0) {
+        printHelper.log("ERROR", "OTA stream timed out");
+        status = TINFL_STATUS_FAILED;
+        break;
+      }
+    }
+
+    size_t inBytes = inLen - inPos;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - dictOfs;
+    status = tinfl_decompress(inflator, input + inPos, &inBytes, dict,
+                              dict + dictOfs, &outBytes,
+                              TINFL_FLAG_HAS_MORE_INPUT);
+    inPos += inBytes;
+    consumed += inBytes;
+
+    if (outBytes > 0) {
+      crc = esp_rom_crc32_le(crc, dict + dictOfs, outBytes);
+      inflated += outBytes;
+      if (!sink(dict + dictOfs, outBytes)) {
+        status = TINFL_STATUS_FAILED;
+        break;
+      }
+      dictOfs = (dictOfs + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+    vTaskDelay(1);
+  } while (status == TINFL_STATUS_NEEDS_MORE_INPUT ||
+           status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+  // The trailer follows the deflate data. Its first bytes may already be in
+  // the bit buffer, as the ROM inflater reads ahead and does not give them
+  // back, and more may be left in the last input chunk.
+  uint8_t trailer[8];
+  size_t buffered = 0;
+  if (status == TINFL_STATUS_DONE) {
+    size_t lookahead = inflator->m_num_bits / 8;
+    auto bits = inflator->m_bit_buf >> (inflator->m_num_bits & 7);
+    for (; buffered < lookahead && buffered < sizeof(trailer); buffered++) {
+      trailer[buffered] = bits & 0xFF;
+      bits >>= 8;
+    }
+    consumed -= lookahead;
+    size_t left = inLen - inPos;
+    if (left > sizeof(trailer) - buffered) {
+      left = sizeof(trailer) - buffered;
+    }
+    memcpy(trailer + buffered, input + inPos, left);
+    buffered += left;
+  }
+
+  free(inflator);
+  free(dict);
+  free(input);
+
+  if (status != TINFL_STATUS_DONE) {
+    printHelper.log("ERROR", "OTA decompression failed: %d", status);
+    return false;
+  }
+  if (!readExact(stream, trailer + buffered, sizeof(trailer) - buffered)) {
+    printHelper.log("ERROR", "OTA stream ended before the gzip trailer");
+    return false;
+  }
+  consumed += sizeof(trailer);
+
+  if (readLittleEndian32(trailer) != crc) {
+    printHelper.log("ERROR", "OTA gzip CRC32 mismatch");
+    return false;
+  }
+  if (readLittleEndian32(trailer + 4) != inflated) {
+    printHelper.log("ERROR", "OTA gzip size %u, inflated %u",
+                    readLittleEndian32(trailer + 4), inflated);
+    return false;
+  }
+  if (compressedSize > 0 && consumed != compressedSize) {
+    printHelper.log("ERROR", "OTA gzip is %u bytes, manifest says %u",
+                    consumed, compressedSize);
+    return false;
+  }
+  return true;
+}
+
+static String toHex(const uint8_t *data, size_t len) {
+  static const char digits[] = "0123456789abcdef";
+  String hex;
+  hex.reserve(len * 2);
+  for (size_t i = 0; i < len; i++) {
+    hex += digits[data[i] >> 4];
+    hex += digits[data[i] & 0x0F];
+  }
+  return hex;
+}
+
+bool OTAHelper::beginImage(size_t size) {
+  if (!Update.begin(size)) {
+    printHelper.log("ERROR", "Not enough space for OTA");
+    return false;
+  }
+  mbedtls_sha256_init(&imageHash);
+  mbedtls_sha256_starts(&imageHash, 0);
+  imageWritten = 0;
+
+  portENTER_CRITICAL(&progressLock);
+  progress.state = "downloading";
+  progress.total = size;
+  progress.written = 0;
+  progress.startedAt = millis();
+  portEXIT_CRITICAL(&progressLock);
+  return true;
+}
+
+bool OTAHelper::writeImage(const uint8_t *data, size_t len) {
+  if (Update.write(const_cast<uint8_t *>(data), len) != len) {
+    printHelper.log("ERROR", "OTA write failed: %s", Update.errorString());
+    return false;
+  }
+  mbedtls_sha256_update(&imageHash, data, len);
+  imageWritten += len;
+  portENTER_CRITICAL(&progressLock);
+  progress.written = imageWritten;
+  portEXIT_CRITICAL(&progressLock);
+  return true;
+}
+
+// Verifies size and, when the manifest provides one, the SHA-256 of the
+// written image before marking the new partition bootable.
+bool OTAHelper::finishImage(bool ok, size_t size, const String &sha256) {
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&imageHash, digest);
+  mbedtls_sha256_free(&imageHash);
+
+  if (ok && imageWritten != size) {
+    printHelper.log("ERROR", "OTA wrote %u of %u bytes", imageWritten, size);
+    ok = false;
+  }
+  if (ok && !sha256.isEmpty() &&
+      !sha256.equalsIgnoreCase(toHex(digest, sizeof(digest)))) {
+    printHelper.log("ERROR", "OTA image hash mismatch");
+    ok = false;
+  }
+  if (!ok) {
+    Update.abort();
+    return false;
+  }
+  return Update.end();
+}
+
+// Downloads the full image, preferring the compressed artifact when the
+// manifest advertises one with its image size.
+bool OTAHelper::applyFullImage(const OTARelease &release) {
+  bool compressed = release.compression == "gzip" &&
+                    !release.compressedUrl.isEmpty() && release.size > 0;
+  const String &url = compressed ? release.compressedUrl : release.binUrl;
+
+  HTTPClient http;
+  http.begin(url);
   int binCode = http.GET();
   if (binCode != 200) {
     printHelper.log("ERROR", "Failed to fetch bin: %d", binCode);
     http.end();
-    OTA_IN_PROGRESS = false;
-    return;
+    return false;
   }
 
   int contentLength = http.getSize();
-  bool canBegin = Update.begin(contentLength);
-  if (!canBegin) {
-    printHelper.log("ERROR", "Not enough space for OTA");
+  if (!compressed && contentLength <= 0) {
+    printHelper.log("ERROR", "Unknown firmware size");
     http.end();
-    OTA_IN_PROGRESS = false;
-    return;
+    return false;
+  }
+  size_t imageSize = compressed ? release.size : contentLength;
+  if (compressed) {
+    printHelper.log("INFO", "Downloading gzip image: %d of %u bytes",
+                    contentLength, release.size);
+  }
+
+  if (!beginImage(imageSize)) {
+    http.end();
+    return false;
   }
 
+  OTASink sink = [this](const uint8_t *data, size_t len) {
+    return writeImage(data, len);
+  };
   WiFiClient *stream = http.getStreamPtr();
-  size_t written = Update.writeStream(*stream);
+  bool ok = compressed ? inflateStream(stream, sink, release.compressedSize)
+                       : copyStream(stream, imageSize, sink);
+  http.end();
 
-  if (written == contentLength && Update.end()) {
-    printHelper.log("INFO", "OTA Success! Rebooting...");
-    ESP.restart();
-  } else {
-    printHelper.log("ERROR", "OTA Failed!");
-    OTA_IN_PROGRESS = false;
+  return finishImage(ok, imageSize, release.sha256);
+}
+
+// Rebuilds the new image from the running partition and a gzip-compressed
+// delta patch.
+bool OTAHelper::applyPatch(const OTARelease &release) {
+  const esp_partition_t *running = esp_ota_get_running_partition();
+  if (running == nullptr || release.size == 0) {
+    return false;
+  }
+
+  if (!release.patchBaseSha256.isEmpty()) {
+    uint8_t digest[32];
+    if (esp_partition_get_sha256(running, digest) != ESP_OK ||
+        !release.patchBaseSha256.equalsIgnoreCase(
+            toHex(digest, sizeof(digest)))) {
+      printHelper.log("WARN", "Running image does not match patch base");
+      return false;
+    }
+  }
+
+  HTTPClient http;
+  http.begin(release.patchUrl);
+  int patchCode = http.GET();
+  if (patchCode != 200) {
+    printHelper.log("ERROR", "Failed to fetch patch: %d", patchCode);
+    http.end();
+    return false;
+  }
+  printHelper.log("INFO", "Downloading delta patch: %d bytes for %u bytes",
+                  http.getSize(), release.size);
+
+  if (!beginImage(release.size)) {
+    http.end();
+    return false;
   }
+
+  DeltaPatcher patcher(running, [this](const uint8_t *data, size_t len) {
+    return writeImage(data, len);
+  });
+  OTASink sink = [&patcher](const uint8_t *data, size_t len) {
+    return patcher.write(data, len);
+  };
+  WiFiClient *stream = http.getStreamPtr();
+  bool ok = inflateStream(stream, sink, 0) && patcher.isComplete() &&
+            patcher.getTargetSize() == release.size;
   http.end();
+
+  if (!ok) {
+    printHelper.log("ERROR", "Failed to apply delta patch");
+  }
+  return finishImage(ok, release.size, release.sha256);
+}
+
+// Applies a delta patch when the manifest has one for the running version,
+// falling back to the full image otherwise or if the patch fails.
+bool OTAHelper::downloadAndApply(const OTARelease &release,
+                                 const char *currentVersion) {
+  if (!release.patchUrl.isEmpty() && release.patchFrom == currentVersion) {
+    if (applyPatch(release)) {
+      return true;
+    }
+    printHelper.log("WARN", "Delta update failed, using full image");
+  }
+  return applyFullImage(release);
 }
@@ -3,10 +3,37 @@
 #ifndef SRC_HELPERS_OTAHELPER_H_
 #define SRC_HELPERS_OTAHELPER_H_
 
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+
+#include "OTAManifest.h"
 #include "PRINTHelper.h"
 
 extern PRINTHelper printHelper;
 extern volatile bool OTA_IN_PROGRESS;
+extern String CHIP_ID;
+
+// Nightly OTA window (local time). Each device checks once per night at a
+// slot inside the window derived from its chip ID.
+constexpr int OTA_WINDOW_START_HOUR = 2;
+constexpr int OTA_WINDOW_END_HOUR = 4;
+constexpr uint32_t OTA_BACKOFF_BASE_S = 5UL * 60UL;        // 5 minutes
+constexpr uint32_t OTA_BACKOFF_MAX_S = 24UL * 60UL * 60UL;  // 1 day
+// Devices that boot together, e.g. after a power cut, spread their boot
+// checks over this long
+constexpr uint32_t OTA_BOOT_CHECK_MAX_DELAY_S = 30UL * 60UL;
+// How long a finished job waits for the main loop to publish its final state
+constexpr uint32_t OTA_FINAL_STATE_TIMEOUT_MS = 10000;
+
+// Progress of the current OTA job, read by the main loop for MQTT and
+// /metrics reporting while the download runs in its own task. Only accessed
+// under OTAHelper's progressLock; getProgress() returns a copy.
+struct OTAProgress {
+  const char *state = "idle";
+  uint32_t written = 0;
+  uint32_t total = 0;
+  uint32_t startedAt = 0;
+};
 
 class OTAHelper {
  public:
@@ -16,6 +43,71 @@ class OTAHelper {
   void checkAndUpdateFromManifest(const char *manifestUrl,
                                   const char *deviceName,
                                   const char *currentVersion);
+  bool startBackgroundCheck(const char *manifestUrl, const char *deviceName,
+                            const char *currentVersion);
+  // The check after boot, outside the nightly slot: starts after a random
+  // delay of up to maxDelaySeconds and leaves that night's check scheduled.
+  bool startBootCheck(const char *manifestUrl, const char *deviceName,
+                      const char *currentVersion, uint32_t maxDelaySeconds);
+  bool isCheckDue();
+  bool isBusy() const { return taskHandle != nullptr; }
+  OTAProgress getProgress() const;
+  uint32_t getEtaSeconds() const;
+  // When a job ends ("idle", "failed" or "rebooting") the OTA task waits, up
+  // to OTA_FINAL_STATE_TIMEOUT_MS, for the main loop to publish that state
+  // and acknowledge it before it clears OTA_IN_PROGRESS or restarts.
+  bool isFinalStatePending() const { return finalStatePending; }
+  void acknowledgeFinalState() {
+    finalStatePending = false;
+    finalStateReported = true;
+  }
+
+ private:
+  TaskHandle_t taskHandle = nullptr;
+  const char *taskManifestUrl = nullptr;
+  const char *taskDeviceName = nullptr;
+  const char *taskCurrentVersion = nullptr;
+  uint32_t taskDelayMs = 0;
+  bool bootCheck = false;
+  OTAProgress progress;
+  mutable portMUX_TYPE progressLock = portMUX_INITIALIZER_UNLOCKED;
+  volatile bool finalStatePending = false;
+  volatile bool finalStateReported = false;
+
+  void setProgressState(const char *state);
+  bool reportFinalState(const char *state);
+  bool startTask(const char *manifestUrl, const char *deviceName,
+                 const char *currentVersion);
+  static void backgroundTask(void *param);
+
+  // Last manifest validators and parsed result, persisted in NVS so that
+  // repeated checks can be answered with 304 Not Modified.
+  String cachedEtag;
+  String cachedLastModified;
+  String cachedDeviceName;
+  OTARelease latest;
+
+  // Scheduler state, persisted so backoff survives reboots and deep sleep.
+  int32_t lastCheckDay = -1;
+  uint32_t failedChecks = 0;
+  uint32_t nextRetryTime = 0;
+
+  void loadManifestCache();
+  void saveManifestCache();
+  // Image being written to the inactive partition
+  mbedtls_sha256_context imageHash;
+  size_t imageWritten = 0;
+
+  bool fetchLatestFromManifest(const char *manifestUrl, const char *deviceName,
+                               const char *currentVersion);
+  bool downloadAndApply(const OTARelease &release, const char *currentVersion);
+  bool applyFullImage(const OTARelease &release);
+  bool applyPatch(const OTARelease &release);
+  bool beginImage(size_t size);
+  bool writeImage(const uint8_t *data, size_t len);
+  bool finishImage(bool ok, size_t size, const String &sha256);
+  void saveScheduleState();
+  void recordCheckResult(bool success);
 };
 
 #endif  // SRC_HELPERS_OTAHELPER_H_
@@ -0,0 +1,116 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <ArduinoJson.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "OTAManifest.h"
+
+static const size_t MANIFEST_FILTER_CAPACITY = 512;
+static const size_t MANIFEST_DOC_MIN_CAPACITY = 1024;
+static const int MANIFEST_DOC_GROWTH_STEPS = 3;
+
+int versionCompare(const char *v1, const char *v2) {
+  int maj1, min1, pat1;
+  int maj2, min2, pat2;
+  sscanf(v1, "v%d.%d.%d", &maj1, &min1, &pat1);
+  sscanf(v2, "v%d.%d.%d", &maj2, &min2, &pat2);
+
+  if (maj1 != maj2)
+    return maj1 - maj2;
+  if (min1 != min2)
+    return min1 - min2;
+  return pat1 - pat2;
+}
+
+// Fields read from each manifest entry; everything else is skipped while
+// parsing
+static void buildManifestFilter(JsonDocument *filter) {
+  JsonObject entry = filter->createNestedObject();
+  for (const char *field :
+       {"name", "version", "bin_url", "size", "compression", "compressed_url",
+        "compressed_size", "rollout", "sha256"}) {
+    entry[field] = true;
+  }
+  JsonObject patch = entry.createNestedArray("patches").createNestedObject();
+  for (const char *field : {"from", "url", "from_sha256"}) {
+    patch[field] = true;
+  }
+}
+
+// Picks the highest version listed for deviceName
+static bool selectRelease(JsonArray entries, const char *deviceName,
+                          const char *currentVersion, OTARelease *release) {
+  JsonObject latestEntry;
+  const char *latest_version = nullptr;
+
+  for (JsonObject entry : entries) {
+    const char *name = entry["name"];
+    const char *version = entry["version"];
+    const char *bin_url = entry["bin_url"];
+    if (name && version && bin_url && strcmp(name, deviceName) == 0) {
+      if (!latest_version || versionCompare(version, latest_version) > 0) {
+        latest_version = version;
+        latestEntry = entry;
+      }
+    }
+  }
+
+  if (!latest_version) {
+    printHelper.log("ERROR",
+                    "No matching device or missing fields in manifest");
+    return false;
+  }
+
+  *release = OTARelease();
+  release->version = latest_version;
+  release->binUrl = latestEntry["bin_url"].as<const char *>();
+  release->size = latestEntry["size"] | 0;
+  release->compression = latestEntry["compression"] | "";
+  release->compressedUrl = latestEntry["compressed_url"] | "";
+  release->compressedSize = latestEntry["compressed_size"] | 0;
+  int rollout = latestEntry["rollout"] | 100;
+  release->rollout = constrain(rollout, 0, 100);
+  release->sha256 = latestEntry["sha256"] | "";
+  for (JsonObject patch : latestEntry["patches"].as<JsonArray>()) {
+    const char *from = patch["from"];
+    const char *url = patch["url"];
+    if (from && url && strcmp(from, currentVersion) == 0) {
+      release->patchFrom = from;
+      release->patchUrl = url;
+      release->patchBaseSha256 = patch["from_sha256"] | "";
+      break;
+    }
+  }
+  return true;
+}
+
+bool parseManifest(const String &payload, const char *deviceName,
+                   const char *currentVersion, OTARelease *release) {
+  StaticJsonDocument<MANIFEST_FILTER_CAPACITY> filter;
+  buildManifestFilter(&filter);
+
+  // The manifest lists every version of every product and the strings are
+  // copied, so the document is sized from the payload rather than fixed.
+  // Filtering drops the unused fields, so the payload length is normally
+  // enough; it is doubled on NoMemory a few times before giving up.
+  size_t capacity = payload.length() + MANIFEST_DOC_MIN_CAPACITY;
+  for (int attempt = 0;; attempt++) {
+    DynamicJsonDocument doc(capacity);
+    DeserializationError err = deserializeJson(
+        doc, payload, DeserializationOption::Filter(filter));
+    if (err == DeserializationError::NoMemory &&
+        attempt < MANIFEST_DOC_GROWTH_STEPS) {
+      capacity *= 2;
+      continue;
+    }
+    if (err) {
+      printHelper.log("ERROR", "Failed to parse manifest JSON (%u bytes): %s",
+                      payload.length(), err.c_str());
+      return false;
+    }
+    return selectRelease(doc.as<JsonArray>(), deviceName, currentVersion,
+                         release);
+  }
+}
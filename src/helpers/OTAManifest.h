@@ -0,0 +1,38 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_OTAMANIFEST_H_
+#define SRC_HELPERS_OTAMANIFEST_H_
+
+#include <Arduino.h>
+
+#include "PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+// Latest manifest entry for this device. compressedUrl is optional and points
+// to a gzip copy of the image at binUrl; patchUrl is a gzip delta patch from
+// patchFrom, the version running when the manifest was fetched.
+struct OTARelease {
+  String version;
+  String binUrl;
+  uint32_t size = 0;
+  String compression;
+  String compressedUrl;
+  uint32_t compressedSize = 0;
+  uint8_t rollout = 100;
+  String sha256;
+  String patchFrom;
+  String patchUrl;
+  String patchBaseSha256;
+};
+
+// Compares "vMAJOR.MINOR.PATCH" versions; negative, zero or positive like
+// strcmp.
+int versionCompare(const char *v1, const char *v2);
+
+// Picks the highest version listed for deviceName in a manifest, including
+// the delta patch from currentVersion if there is one.
+bool parseManifest(const String &payload, const char *deviceName,
+                   const char *currentVersion, OTARelease *release);
+
+#endif  // SRC_HELPERS_OTAMANIFEST_H_
@@ -1,12 +1,10 @@
 // Copyright (c) 2023-2025 Sondre Sjølyst
 
-#include <WiFiClientSecure.h>
-
 #include <cstdio>
 
 #include "PRINTHelper.h"
 
-PRINTHelper::PRINTHelper(WiFiClientSecure *client) : _client(client) {}
+PRINTHelper::PRINTHelper(Client *client) : _client(client) {}
 
 void PRINTHelper::log(const char *level, const char *format, ...) {
   char buf[256];
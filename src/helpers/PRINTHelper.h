@@ -3,19 +3,19 @@
 #ifndef SRC_HELPERS_PRINTHELPER_H_
 #define SRC_HELPERS_PRINTHELPER_H_
 
-#include <WiFiClientSecure.h>
-
 #include <Arduino.h>
+#include <Client.h>
+
 #include <cstdio>
 
 class PRINTHelper {
  public:
-  explicit PRINTHelper(WiFiClientSecure *client);
+  explicit PRINTHelper(Client *client);
 
   void log(const char *level, const char *format, ...);
 
  private:
-  WiFiClientSecure *_client;
+  Client *_client;
 };
 
 #endif  // SRC_HELPERS_PRINTHELPER_H_
@@ -0,0 +1,80 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <cmath>
+
+#include "ReadingCodec.h"
+
+struct CodecWriter {
+  uint8_t *out;
+  size_t capacity;
+  size_t pos;
+  bool overflow;
+
+  void byte(uint8_t b) {
+    if (pos >= capacity) {
+      overflow = true;
+      return;
+    }
+    out[pos++] = b;
+  }
+
+  void varint(uint32_t v) {
+    while (v >= 0x80) {
+      byte(static_cast<uint8_t>(v) | 0x80);
+      v >>= 7;
+    }
+    byte(static_cast<uint8_t>(v));
+  }
+
+  void zigzag(int32_t v) {
+    varint((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31));
+  }
+};
+
+static int32_t toFixedPoint(float value) {
+  return static_cast<int32_t>(lroundf(value * READING_FIXED_POINT_SCALE));
+}
+
+size_t encodeReadings(const Reading *readings, size_t count, uint8_t *out,
+                      size_t capacity) {
+  CodecWriter writer = {out, capacity, 0, false};
+  writer.byte(READING_CODEC_VERSION);
+
+  for (uint8_t type = READING_TEMPERATURE; type <= READING_VOLTAGE; type++) {
+    uint32_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (readings[i].type == type) {
+        n++;
+      }
+    }
+    if (n == 0) {
+      continue;
+    }
+    writer.byte(type);
+    writer.varint(n);
+
+    bool first = true;
+    uint32_t prevTime = 0;
+    int32_t prevDelta = 0;
+    int32_t prevValue = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (readings[i].type != type) {
+        continue;
+      }
+      int32_t value = toFixedPoint(readings[i].value);
+      if (first) {
+        writer.varint(readings[i].timestamp);
+        writer.zigzag(value);
+        first = false;
+      } else {
+        int32_t delta = static_cast<int32_t>(readings[i].timestamp - prevTime);
+        writer.zigzag(delta - prevDelta);
+        writer.zigzag(value - prevValue);
+        prevDelta = delta;
+      }
+      prevTime = readings[i].timestamp;
+      prevValue = value;
+    }
+  }
+  return writer.overflow ? 0 : writer.pos;
+}
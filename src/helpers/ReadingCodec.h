@@ -0,0 +1,31 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_READINGCODEC_H_
+#define SRC_HELPERS_READINGCODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ReadingLog.h"
+
+// Compact binary encoding for backfill batches, decoded on the host by
+// scripts/decode_backfill.py.
+//
+//   u8 version
+//   repeated per reading type present in the batch:
+//     u8 type, varint count,
+//     varint first timestamp, zigzag varint first value
+//     per following reading: zigzag varint timestamp delta-of-delta,
+//                            zigzag varint value delta
+//
+// Values are stored as fixed point with READING_FIXED_POINT_SCALE. Regular
+// sampling makes most delta-of-deltas zero, so a reading usually takes 2-3
+// bytes instead of ~20 bytes of JSON.
+constexpr uint8_t READING_CODEC_VERSION = 1;
+constexpr int32_t READING_FIXED_POINT_SCALE = 1000;
+
+// Returns the encoded size, or 0 if the readings do not fit in capacity.
+size_t encodeReadings(const Reading *readings, size_t count, uint8_t *out,
+                      size_t capacity);
+
+#endif  // SRC_HELPERS_READINGCODEC_H_
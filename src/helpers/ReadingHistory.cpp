@@ -0,0 +1,285 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include "ReadingHistory.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+// Stored for a value that was NaN
+static const int16_t HISTORY_MISSING = std::numeric_limits<int16_t>::min();
+// Timestamps before this are from a clock that NTP has not set yet, as in
+// setupTime()
+static const uint32_t HISTORY_MIN_TIMESTAMP = 8 * 3600 * 2;
+
+static const char *HISTORY_COLUMN_NAMES[HISTORY_COLUMN_COUNT] = {
+    "temperature", "temperature_min", "temperature_max",
+    "humidity",    "humidity_min",    "humidity_max",
+};
+
+enum HistoryReduce { REDUCE_MEAN, REDUCE_MIN, REDUCE_MAX };
+
+static const HistoryReduce HISTORY_COLUMN_REDUCE[HISTORY_COLUMN_COUNT] = {
+    REDUCE_MEAN, REDUCE_MIN, REDUCE_MAX, REDUCE_MEAN, REDUCE_MIN, REDUCE_MAX,
+};
+
+static uint32_t *timestamps = nullptr;
+static int16_t *columns[HISTORY_COLUMN_COUNT] = {};
+static size_t capacity = 0;
+static size_t size = 0;
+static size_t next = 0;
+
+bool historySetup() {
+  if (timestamps != nullptr) {
+    return true;
+  }
+
+  const size_t recordBytes =
+      sizeof(uint32_t) + HISTORY_COLUMN_COUNT * sizeof(int16_t);
+  void *block = nullptr;
+  size_t records = HISTORY_CAPACITY;
+  if (psramFound()) {
+    block = ps_malloc(records * recordBytes);
+  }
+  if (block == nullptr) {
+    records = HISTORY_FALLBACK_CAPACITY;
+    block = malloc(records * recordBytes);
+  }
+  if (block == nullptr) {
+    printHelper.log("ERROR", "Failed to allocate reading history");
+    return false;
+  }
+
+  timestamps = static_cast<uint32_t *>(block);
+  int16_t *values = reinterpret_cast<int16_t *>(timestamps + records);
+  for (size_t column = 0; column < HISTORY_COLUMN_COUNT; column++) {
+    columns[column] = values + column * records;
+  }
+  capacity = records;
+  size = 0;
+  next = 0;
+  printHelper.log("INFO", "Reading history holds %u records",
+                  static_cast<unsigned>(capacity));
+  return true;
+}
+
+size_t historyCapacity() { return capacity; }
+
+size_t historySize() { return size; }
+
+void clearHistory() {
+  size = 0;
+  next = 0;
+}
+
+static int16_t toHistoryValue(float value) {
+  if (std::isnan(value)) {
+    return HISTORY_MISSING;
+  }
+  float scaled = roundf(value * HISTORY_SCALE);
+  if (scaled >= std::numeric_limits<int16_t>::max()) {
+    return std::numeric_limits<int16_t>::max();
+  }
+  if (scaled <= HISTORY_MISSING) {
+    return HISTORY_MISSING + 1;
+  }
+  return static_cast<int16_t>(scaled);
+}
+
+// Ring slot of the index'th oldest record
+static size_t slot(size_t index) {
+  return (next + capacity - size + index) % capacity;
+}
+
+void recordHistory(uint32_t timestamp, const float *values) {
+  if (capacity == 0 || timestamp < HISTORY_MIN_TIMESTAMP) {
+    return;
+  }
+  if (size > 0 && timestamp <= timestamps[slot(size - 1)]) {
+    printHelper.log("WARN", "Dropping history record at %u, not after %u",
+                    static_cast<unsigned>(timestamp),
+                    static_cast<unsigned>(timestamps[slot(size - 1)]));
+    return;
+  }
+
+  timestamps[next] = timestamp;
+  for (size_t column = 0; column < HISTORY_COLUMN_COUNT; column++) {
+    columns[column][next] = toHistoryValue(values[column]);
+  }
+  next = (next + 1) % capacity;
+  if (size < capacity) {
+    size++;
+  }
+}
+
+// Index of the oldest record with a timestamp of at least from
+static size_t lowerBound(uint32_t from) {
+  size_t low = 0;
+  size_t high = size;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (timestamps[slot(middle)] < from) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Collects the response and hands it to the writer in full chunks
+class ChunkWriter {
+ public:
+  explicit ChunkWriter(const HistoryWriter &write) : write_(write) {}
+
+  void append(const char *text, size_t length) {
+    if (length_ + length > sizeof(buffer_)) {
+      flush();
+    }
+    memcpy(buffer_ + length_, text, length);
+    length_ += length;
+  }
+
+  void append(const char *text) { append(text, strlen(text)); }
+
+  void flush() {
+    if (length_ > 0) {
+      write_(buffer_, length_);
+      length_ = 0;
+    }
+  }
+
+ private:
+  const HistoryWriter &write_;
+  char buffer_[HISTORY_CHUNK_BYTES];
+  size_t length_ = 0;
+};
+
+// One output row; a column is missing when no record in it had a value
+struct HistoryRow {
+  uint32_t timestamp;
+  int32_t values[HISTORY_COLUMN_COUNT];
+  bool present[HISTORY_COLUMN_COUNT];
+};
+
+static void writeRow(ChunkWriter *out, const HistoryRow &row,
+                     HistoryFormat format, bool first) {
+  // Timestamp plus the columns at up to "-327.68," each
+  char text[16 + HISTORY_COLUMN_COUNT * 10];
+  bool json = format == HISTORY_JSON;
+  size_t length = snprintf(text, sizeof(text), "%s%u",
+                           json ? (first ? "[" : ",[") : "",
+                           static_cast<unsigned>(row.timestamp));
+  for (size_t column = 0; column < HISTORY_COLUMN_COUNT; column++) {
+    text[length++] = ',';
+    if (!row.present[column]) {
+      if (json) {
+        memcpy(text + length, "null", 4);
+        length += 4;
+      }
+      continue;
+    }
+    int32_t value = row.values[column];
+    uint32_t magnitude = value < 0 ? -value : value;
+    length += snprintf(text + length, sizeof(text) - length, "%s%u.%02u",
+                       value < 0 ? "-" : "",
+                       static_cast<unsigned>(magnitude / HISTORY_SCALE),
+                       static_cast<unsigned>(magnitude % HISTORY_SCALE));
+  }
+  text[length++] = json ? ']' : '\n';
+  out->append(text, length);
+}
+
+// Folds record index into an output row being built
+static void reduceInto(HistoryRow *row, int64_t *sums, uint32_t *counts,
+                       size_t index) {
+  size_t at = slot(index);
+  for (size_t column = 0; column < HISTORY_COLUMN_COUNT; column++) {
+    int16_t value = columns[column][at];
+    if (value == HISTORY_MISSING) {
+      continue;
+    }
+    switch (HISTORY_COLUMN_REDUCE[column]) {
+      case REDUCE_MEAN:
+        sums[column] += value;
+        counts[column]++;
+        break;
+      case REDUCE_MIN:
+        if (!row->present[column] || value < row->values[column]) {
+          row->values[column] = value;
+        }
+        break;
+      case REDUCE_MAX:
+        if (!row->present[column] || value > row->values[column]) {
+          row->values[column] = value;
+        }
+        break;
+    }
+    row->present[column] = true;
+  }
+}
+
+static void finishRow(HistoryRow *row, const int64_t *sums,
+                      const uint32_t *counts) {
+  for (size_t column = 0; column < HISTORY_COLUMN_COUNT; column++) {
+    if (HISTORY_COLUMN_REDUCE[column] != REDUCE_MEAN || counts[column] == 0) {
+      continue;
+    }
+    // Rounded half away from zero, like the fixed point conversion
+    int64_t half = sums[column] < 0 ? -static_cast<int64_t>(counts[column] / 2)
+                                    : counts[column] / 2;
+    row->values[column] =
+        static_cast<int32_t>((sums[column] + half) / counts[column]);
+  }
+}
+
+size_t streamHistory(uint32_t from, uint32_t to, uint32_t step,
+                     HistoryFormat format, const HistoryWriter &write) {
+  ChunkWriter out(write);
+  if (format == HISTORY_JSON) {
+    out.append("{\"columns\":[\"t\"");
+    for (size_t column = 0; column < HISTORY_COLUMN_COUNT; column++) {
+      out.append(",\"");
+      out.append(HISTORY_COLUMN_NAMES[column]);
+      out.append("\"");
+    }
+    out.append("],\"rows\":[");
+  } else {
+    out.append("t");
+    for (size_t column = 0; column < HISTORY_COLUMN_COUNT; column++) {
+      out.append(",");
+      out.append(HISTORY_COLUMN_NAMES[column]);
+    }
+    out.append("\n");
+  }
+
+  size_t rows = 0;
+  size_t index = from <= to ? lowerBound(from) : size;
+  while (index < size && timestamps[slot(index)] <= to) {
+    HistoryRow row = {};
+    int64_t sums[HISTORY_COLUMN_COUNT] = {};
+    uint32_t counts[HISTORY_COLUMN_COUNT] = {};
+    if (step == 0) {
+      row.timestamp = timestamps[slot(index)];
+      reduceInto(&row, sums, counts, index++);
+    } else {
+      uint32_t bucket = (timestamps[slot(index)] - from) / step;
+      row.timestamp = from + bucket * step;
+      while (index < size && timestamps[slot(index)] <= to &&
+             (timestamps[slot(index)] - from) / step == bucket) {
+        reduceInto(&row, sums, counts, index++);
+      }
+    }
+    finishRow(&row, sums, counts);
+    writeRow(&out, row, format, rows == 0);
+    rows++;
+  }
+
+  if (format == HISTORY_JSON) {
+    out.append("]}");
+  }
+  out.flush();
+  return rows;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_READINGHISTORY_H_
+#define SRC_HELPERS_READINGHISTORY_H_
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+// Local history of the aggregate records, one per reporting interval, served
+// by the web server as /history so the garage can be charted without the
+// broker. It lives in RAM and starts empty after a reboot.
+//
+// Records are stored column by column in a ring: a range query binary-searches
+// the timestamp column and downsampling then reads each value column
+// sequentially. Values are hundredths in int16_t, 16 bytes per record.
+//
+// The week (about 160 KB) is allocated in PSRAM, which the sensor, universal
+// and bus images enable with BOARD_HAS_PSRAM. Modules without PSRAM, or where
+// it fails to initialise, get HISTORY_FALLBACK_CAPACITY in the heap instead:
+// the last day, about 23 KB, kept small so the heap still has room for the TLS
+// handshake.
+constexpr size_t HISTORY_CAPACITY = 7 * 24 * 60;  // 7 days of 1-minute records
+constexpr size_t HISTORY_FALLBACK_CAPACITY = 24 * 60;  // 1 day
+constexpr int32_t HISTORY_SCALE = 100;
+constexpr size_t HISTORY_CHUNK_BYTES = 1024;
+
+enum HistoryColumn {
+  HISTORY_TEMPERATURE,
+  HISTORY_TEMPERATURE_MIN,
+  HISTORY_TEMPERATURE_MAX,
+  HISTORY_HUMIDITY,
+  HISTORY_HUMIDITY_MIN,
+  HISTORY_HUMIDITY_MAX,
+  HISTORY_COLUMN_COUNT,
+};
+
+enum HistoryFormat { HISTORY_JSON, HISTORY_CSV };
+
+// Receives the response in chunks of up to HISTORY_CHUNK_BYTES
+typedef std::function<void(const char *, size_t)> HistoryWriter;
+
+bool historySetup();
+size_t historyCapacity();
+size_t historySize();
+void clearHistory();
+
+// values holds HISTORY_COLUMN_COUNT entries, NaN where there is no value.
+// Records from before NTP sync or not newer than the newest one are dropped.
+void recordHistory(uint32_t timestamp, const float *values);
+
+// Writes the records with from <= timestamp <= to, averaged into buckets of
+// step seconds starting at from (min and max columns keep their extremes),
+// or one row per record if step is 0. Returns the number of rows.
+//   JSON: {"columns":["t","temperature",...],"rows":[[t,v,...],...]}
+//   CSV:  t,temperature,...
+size_t streamHistory(uint32_t from, uint32_t to, uint32_t step,
+                     HistoryFormat format, const HistoryWriter &write);
+
+#endif  // SRC_HELPERS_READINGHISTORY_H_
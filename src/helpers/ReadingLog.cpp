@@ -0,0 +1,190 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <LittleFS.h>
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include "MQTTHelper.h"
+#include "ReadingCodec.h"
+#include "ReadingLog.h"
+
+// Oldest segment first; the current segment is renamed once it is full
+static const char *READING_OLD_SEGMENT = "/readings.0";
+static const char *READING_CURRENT_SEGMENT = "/readings.1";
+
+RTC_DATA_ATTR Reading rtcReadings[READING_RTC_CAPACITY];
+RTC_DATA_ATTR uint32_t rtcReadingCount = 0;
+RTC_DATA_ATTR uint32_t oldSegmentOffset = 0;
+RTC_DATA_ATTR bool flashHasReadings = false;
+
+static bool fsMounted = false;
+
+static bool mountReadingFs() {
+  if (!fsMounted) {
+    fsMounted = LittleFS.begin(true);
+    if (!fsMounted) {
+      printHelper.log("ERROR", "Failed to mount LittleFS for reading log");
+    }
+  }
+  return fsMounted;
+}
+
+const char *readingTypeName(ReadingType type) {
+  switch (type) {
+    case READING_TEMPERATURE:
+      return "temperature";
+    case READING_HUMIDITY:
+      return "humidity";
+    case READING_VOLTAGE:
+      return "voltage";
+  }
+  return "unknown";
+}
+
+static void rotateSegments() {
+  if (LittleFS.exists(READING_OLD_SEGMENT)) {
+    printHelper.log("WARN", "Reading log full, dropping oldest segment");
+    LittleFS.remove(READING_OLD_SEGMENT);
+  }
+  LittleFS.rename(READING_CURRENT_SEGMENT, READING_OLD_SEGMENT);
+  oldSegmentOffset = 0;
+}
+
+// Moves the RTC ring to the end of the flash log.
+static void spillToFlash() {
+  if (rtcReadingCount == 0 || !mountReadingFs()) {
+    return;
+  }
+
+  File file = LittleFS.open(READING_CURRENT_SEGMENT, FILE_APPEND);
+  if (!file) {
+    printHelper.log("ERROR", "Failed to open reading log");
+    return;
+  }
+  size_t bytes = rtcReadingCount * sizeof(Reading);
+  size_t written =
+      file.write(reinterpret_cast<const uint8_t *>(rtcReadings), bytes);
+  size_t size = file.size();
+  file.close();
+
+  if (written != bytes) {
+    printHelper.log("ERROR", "Reading log write failed");
+    return;
+  }
+  printHelper.log("INFO", "Spilled %u readings to flash", rtcReadingCount);
+  rtcReadingCount = 0;
+  flashHasReadings = true;
+
+  if (size >= READING_SEGMENT_MAX_BYTES) {
+    rotateSegments();
+  }
+}
+
+void logReading(ReadingType type, float value) {
+  if (std::isnan(value)) {
+    return;
+  }
+  if (rtcReadingCount >= READING_RTC_CAPACITY) {
+    spillToFlash();
+    if (rtcReadingCount >= READING_RTC_CAPACITY) {
+      // Flash unavailable: keep the newest readings
+      memmove(rtcReadings, rtcReadings + 1,
+              (READING_RTC_CAPACITY - 1) * sizeof(Reading));
+      rtcReadingCount--;
+    }
+  }
+
+  Reading &reading = rtcReadings[rtcReadingCount++];
+  reading.timestamp = static_cast<uint32_t>(time(nullptr));
+  reading.value = value;
+  reading.type = type;
+  printHelper.log("INFO", "Stored %s reading for later (%u in memory)",
+                  readingTypeName(type), rtcReadingCount);
+}
+
+bool hasPendingReadings() { return rtcReadingCount > 0 || flashHasReadings; }
+
+// Publishes up to count readings as one encoded backfill message, halving
+// the batch until it fits. Returns how many readings were sent.
+static size_t publishBatch(const String &mac, const Reading *readings,
+                           size_t count) {
+  static uint8_t payload[READING_PAYLOAD_MAX];
+  size_t length = 0;
+  while (count > 0 &&
+         (length = encodeReadings(readings, count, payload, sizeof(payload))) ==
+             0) {
+    count /= 2;
+  }
+  if (count == 0 || !publishGargeBackfill(mac, payload, length)) {
+    return 0;
+  }
+  return count;
+}
+
+// Sends the next batch from the flash log. Returns false when nothing was
+// sent, either because the log is empty or the publish failed.
+static bool flushFlashBatch(const String &mac) {
+  if (!flashHasReadings || !mountReadingFs()) {
+    return false;
+  }
+
+  if (!LittleFS.exists(READING_OLD_SEGMENT)) {
+    if (!LittleFS.exists(READING_CURRENT_SEGMENT)) {
+      flashHasReadings = false;
+      return false;
+    }
+    LittleFS.rename(READING_CURRENT_SEGMENT, READING_OLD_SEGMENT);
+    oldSegmentOffset = 0;
+  }
+
+  File file = LittleFS.open(READING_OLD_SEGMENT, FILE_READ);
+  if (!file) {
+    return false;
+  }
+  static Reading batch[READING_BATCH_SIZE];
+  file.seek(oldSegmentOffset);
+  size_t bytes = file.read(reinterpret_cast<uint8_t *>(batch), sizeof(batch));
+  file.close();
+
+  size_t count = bytes / sizeof(Reading);
+  if (count == 0) {
+    LittleFS.remove(READING_OLD_SEGMENT);
+    oldSegmentOffset = 0;
+    flashHasReadings = LittleFS.exists(READING_CURRENT_SEGMENT);
+    return flashHasReadings;
+  }
+  size_t sent = publishBatch(mac, batch, count);
+  oldSegmentOffset += sent * sizeof(Reading);
+  return sent > 0;
+}
+
+// Sends buffered readings, oldest first, after a successful publish. Stops at
+// the first failure and leaves the rest for the next call.
+void flushReadingLog(const String &mac) {
+  if (!hasPendingReadings()) {
+    return;
+  }
+
+  size_t batches = 0;
+  while (batches < READING_MAX_BATCHES_PER_FLUSH && flushFlashBatch(mac)) {
+    batches++;
+  }
+  if (flashHasReadings) {
+    return;
+  }
+
+  while (batches < READING_MAX_BATCHES_PER_FLUSH && rtcReadingCount > 0) {
+    size_t sent = publishBatch(mac, rtcReadings, rtcReadingCount);
+    if (sent == 0) {
+      return;
+    }
+    rtcReadingCount -= sent;
+    memmove(rtcReadings, rtcReadings + sent,
+            rtcReadingCount * sizeof(Reading));
+    batches++;
+  }
+  printHelper.log("INFO", "Backfilled %u batches, %u readings pending",
+                  batches, rtcReadingCount);
+}
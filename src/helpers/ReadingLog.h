@@ -0,0 +1,43 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_READINGLOG_H_
+#define SRC_HELPERS_READINGLOG_H_
+
+#include <Arduino.h>
+
+#include <cstdint>
+
+#include "PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+enum ReadingType : uint8_t {
+  READING_TEMPERATURE = 0,
+  READING_HUMIDITY = 1,
+  READING_VOLTAGE = 2,
+};
+
+struct Reading {
+  uint32_t timestamp;
+  float value;
+  ReadingType type;
+};
+
+// Readings that could not be published are kept in an RTC memory ring, which
+// survives deep sleep. When the ring fills up it is spilled to an append-only
+// log on LittleFS (which does its own wear levelling). The log is capped at
+// two segments; the oldest segment is dropped when both are full.
+constexpr size_t READING_RTC_CAPACITY = 32;
+constexpr size_t READING_SEGMENT_MAX_BYTES = 32 * 1024;
+// Readings per backfill message and the encoded payload limit, which must
+// stay below the 1024 byte MQTT buffer including the topic
+constexpr size_t READING_BATCH_SIZE = 128;
+constexpr size_t READING_PAYLOAD_MAX = 896;
+constexpr size_t READING_MAX_BATCHES_PER_FLUSH = 10;
+
+const char *readingTypeName(ReadingType type);
+void logReading(ReadingType type, float value);
+bool hasPendingReadings();
+void flushReadingLog(const String &mac);
+
+#endif  // SRC_HELPERS_READINGLOG_H_
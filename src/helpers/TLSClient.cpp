@@ -0,0 +1,341 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <mbedtls/error.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "TLSClient.h"
+#include "WakeProfiler.h"
+
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+static const uint32_t TLS_SESSION_MAGIC = 0x544C5353;
+static const uint32_t TLS_WRITE_TIMEOUT_MS = 10000;
+static const size_t TLS_MASTER_SECRET_SIZE = 48;
+
+struct TLSSessionCache {
+  uint32_t magic;
+  uint32_t endpointHash;
+  uint32_t length;
+  unsigned char data[TLS_SESSION_CACHE_SIZE];
+};
+
+RTC_DATA_ATTR TLSSessionCache tlsSessionCache;
+RTC_DATA_ATTR uint32_t tlsResumptionHits = 0;
+RTC_DATA_ATTR uint32_t tlsResumptionMisses = 0;
+
+static uint32_t hashEndpoint(const char *host, uint16_t port) {
+  uint32_t hash = 2166136261UL;
+  for (const char *c = host; *c; c++) {
+    hash ^= static_cast<uint8_t>(*c);
+    hash *= 16777619UL;
+  }
+  return hash ^ port;
+}
+
+static int maxFragmentLengthCode(int length) {
+  switch (length) {
+    case 512:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_512;
+    case 1024:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+    case 2048:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+    case 4096:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+    default:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+  }
+}
+
+TLSClient::TLSClient() { mbedtls_net_init(&net); }
+
+TLSClient::~TLSClient() {
+  stop();
+  if (configured) {
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+  }
+}
+
+void TLSClient::setHandshakeTimeout(uint32_t seconds) {
+  handshakeTimeoutMs = seconds * 1000;
+}
+
+int TLSClient::lastError(char *buf, size_t size) {
+  if (buf != nullptr && size > 0) {
+    buf[0] = '\0';
+    if (lastErr != 0) {
+      mbedtls_strerror(lastErr, buf, size);
+    }
+  }
+  return lastErr;
+}
+
+uint32_t TLSClient::getResumptionHits() { return tlsResumptionHits; }
+
+uint32_t TLSClient::getResumptionMisses() { return tlsResumptionMisses; }
+
+bool TLSClient::fail(int err, const char *what) {
+  lastErr = err;
+  char msg[100];
+  mbedtls_strerror(err, msg, sizeof(msg));
+  printHelper.log("ERROR", "TLS %s failed: -0x%04x %s", what, -err, msg);
+  stop();
+  return false;
+}
+
+// Loads the cached session for this endpoint into ssl. master receives the
+// master secret of the offered session so the caller can tell whether it was
+// resumed.
+bool TLSClient::restoreSession(const char *host, uint16_t port,
+                               unsigned char *master) {
+  if (tlsSessionCache.magic != TLS_SESSION_MAGIC ||
+      tlsSessionCache.endpointHash != hashEndpoint(host, port) ||
+      tlsSessionCache.length > TLS_SESSION_CACHE_SIZE) {
+    return false;
+  }
+
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  bool ok = mbedtls_ssl_session_load(&session, tlsSessionCache.data,
+                                     tlsSessionCache.length) == 0 &&
+            mbedtls_ssl_set_session(&ssl, &session) == 0;
+  if (ok) {
+    memcpy(master, session.MBEDTLS_PRIVATE(master), TLS_MASTER_SECRET_SIZE);
+  } else {
+    tlsSessionCache.magic = 0;
+  }
+  mbedtls_ssl_session_free(&session);
+  return ok;
+}
+
+// Stores the negotiated session and counts whether the server resumed the
+// one we offered. A resumed session keeps its master secret, whether it was
+// resumed by session ID or by ticket; the session ID cannot tell, since
+// mbedTLS clears it when the server sends a NewSessionTicket.
+void TLSClient::saveSession(const char *host, uint16_t port, bool offered,
+                            const unsigned char *offeredMaster) {
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  if (mbedtls_ssl_get_session(&ssl, &session) != 0) {
+    mbedtls_ssl_session_free(&session);
+    return;
+  }
+
+  bool resumed = offered && memcmp(session.MBEDTLS_PRIVATE(master),
+                                   offeredMaster, TLS_MASTER_SECRET_SIZE) == 0;
+  if (resumed) {
+    tlsResumptionHits++;
+  } else {
+    tlsResumptionMisses++;
+  }
+  printHelper.log("DEBUG", "TLS session %s (hits: %u, misses: %u)",
+                  resumed ? "resumed" : "full handshake", tlsResumptionHits,
+                  tlsResumptionMisses);
+
+  size_t length = 0;
+  if (mbedtls_ssl_session_save(&session, tlsSessionCache.data,
+                               sizeof(tlsSessionCache.data), &length) == 0) {
+    tlsSessionCache.magic = TLS_SESSION_MAGIC;
+    tlsSessionCache.endpointHash = hashEndpoint(host, port);
+    tlsSessionCache.length = length;
+  } else {
+    printHelper.log("WARN", "TLS session too large to cache");
+    tlsSessionCache.magic = 0;
+  }
+  mbedtls_ssl_session_free(&session);
+}
+
+int TLSClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+// One-time setup of the parts that can be shared by every connection.
+bool TLSClient::setupConfig() {
+  mbedtls_ssl_config_init(&conf);
+  mbedtls_ctr_drbg_init(&drbg);
+  mbedtls_entropy_init(&entropy);
+  configured = true;
+
+  int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                  nullptr, 0);
+  if (ret == 0) {
+    ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT);
+  }
+  if (ret != 0) {
+    lastErr = ret;
+    printHelper.log("ERROR", "TLS config failed: -0x%04x", -ret);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+    configured = false;
+    return false;
+  }
+
+  mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+  mbedtls_ssl_conf_max_frag_len(&conf,
+                                maxFragmentLengthCode(TLS_MAX_FRAGMENT_LENGTH));
+#endif
+  return true;
+}
+
+int TLSClient::connect(const char *host, uint16_t port) {
+  stop();
+  if (!configured && !setupConfig()) {
+    return 0;
+  }
+
+  uint32_t heapBefore = ESP.getFreeHeap();
+  mbedtls_net_init(&net);
+  mbedtls_ssl_init(&ssl);
+  active = true;
+
+  char portStr[6];
+  snprintf(portStr, sizeof(portStr), "%u", port);
+  int ret = mbedtls_net_connect(&net, host, portStr, MBEDTLS_NET_PROTO_TCP);
+  if (ret != 0) {
+    return fail(ret, "connect");
+  }
+
+  ret = mbedtls_ssl_setup(&ssl, &conf);
+  if (ret != 0) {
+    return fail(ret, "setup");
+  }
+  mbedtls_ssl_set_hostname(&ssl, host);
+  mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv,
+                      nullptr);
+
+  unsigned char offeredMaster[TLS_MASTER_SECRET_SIZE];
+  bool offered = restoreSession(host, port, offeredMaster);
+
+  mbedtls_net_set_nonblock(&net);
+  uint32_t start = millis();
+  while ((ret = mbedtls_ssl_handshake(&ssl)) != 0) {
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      // A rejected session must not be offered again
+      tlsSessionCache.magic = 0;
+      return fail(ret, "handshake");
+    }
+    if (millis() - start > handshakeTimeoutMs) {
+      return fail(MBEDTLS_ERR_SSL_TIMEOUT, "handshake");
+    }
+    delay(1);
+  }
+  markWakePhase(WAKE_PHASE_TLS);
+  printHelper.log("DEBUG", "TLS handshake took %u ms, max fragment %d",
+                  millis() - start, TLS_MAX_FRAGMENT_LENGTH);
+  printHelper.log("DEBUG", "Free heap before TLS: %u, after: %u, min: %u",
+                  heapBefore, ESP.getFreeHeap(), ESP.getMinFreeHeap());
+
+  saveSession(host, port, offered, offeredMaster);
+  lastErr = 0;
+  return 1;
+}
+
+size_t TLSClient::write(uint8_t b) { return write(&b, 1); }
+
+size_t TLSClient::write(const uint8_t *buf, size_t size) {
+  if (!active) {
+    return 0;
+  }
+  size_t sent = 0;
+  uint32_t start = millis();
+  while (sent < size) {
+    int ret = mbedtls_ssl_write(&ssl, buf + sent, size - sent);
+    if (ret > 0) {
+      sent += ret;
+    } else if ((ret == MBEDTLS_ERR_SSL_WANT_WRITE ||
+                ret == MBEDTLS_ERR_SSL_WANT_READ) &&
+               millis() - start < TLS_WRITE_TIMEOUT_MS) {
+      delay(1);
+    } else {
+      fail(ret, "write");
+      break;
+    }
+  }
+  return sent;
+}
+
+int TLSClient::available() {
+  if (!active) {
+    return 0;
+  }
+  int pending = peeked >= 0 ? 1 : 0;
+  // A zero-length read processes any buffered record without consuming it
+  int ret = mbedtls_ssl_read(&ssl, nullptr, 0);
+  if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
+      ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    if (ret != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+      lastErr = ret;
+    }
+    stop();
+    return pending;
+  }
+  return pending + mbedtls_ssl_get_bytes_avail(&ssl);
+}
+
+int TLSClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int TLSClient::read(uint8_t *buf, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  size_t offset = 0;
+  if (peeked >= 0) {
+    buf[offset++] = static_cast<uint8_t>(peeked);
+    peeked = -1;
+    if (offset == size) {
+      return offset;
+    }
+  }
+  if (!active) {
+    return offset > 0 ? offset : -1;
+  }
+
+  int ret = mbedtls_ssl_read(&ssl, buf + offset, size - offset);
+  if (ret > 0) {
+    return offset + ret;
+  }
+  if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    if (ret != 0 && ret != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+      lastErr = ret;
+    }
+    stop();
+  }
+  return offset > 0 ? offset : -1;
+}
+
+int TLSClient::peek() {
+  if (peeked < 0) {
+    peeked = read();
+  }
+  return peeked;
+}
+
+void TLSClient::stop() {
+  if (!active) {
+    return;
+  }
+  active = false;
+  peeked = -1;
+  mbedtls_ssl_close_notify(&ssl);
+  mbedtls_net_free(&net);
+  mbedtls_ssl_free(&ssl);
+}
+
+uint8_t TLSClient::connected() { return active ? 1 : 0; }
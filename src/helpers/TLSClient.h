@@ -0,0 +1,78 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_TLSCLIENT_H_
+#define SRC_HELPERS_TLSCLIENT_H_
+
+#include <Arduino.h>
+#include <Client.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+
+#include "PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+// Largest TLS record we ask the broker to send (RFC 6066 max_fragment_length:
+// 512, 1024, 2048 or 4096). MQTT packets are capped at 1024 bytes, so the
+// default 16 KB records are never needed; with variable mbedTLS buffers this
+// also shrinks the record buffers after the handshake.
+#ifndef TLS_MAX_FRAGMENT_LENGTH
+#define TLS_MAX_FRAGMENT_LENGTH 2048
+#endif
+
+// Serialized TLS session kept in RTC memory so a reconnect, including the
+// first one after deep sleep, can offer it for an abbreviated handshake.
+constexpr size_t TLS_SESSION_CACHE_SIZE = 2048;
+
+// Minimal mbedTLS client for the MQTT connection. Unlike WiFiClientSecure it
+// can offer a cached session ID/ticket before the handshake. The server
+// certificate is not verified, matching the previous setInsecure() setup.
+// The object is meant to live for the whole uptime: the config and DRBG are
+// set up once and only the per-connection SSL context is recreated.
+class TLSClient : public Client {
+ public:
+  TLSClient();
+  ~TLSClient() override;
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+  void setHandshakeTimeout(uint32_t seconds);
+  int lastError(char *buf, size_t size);
+
+  static uint32_t getResumptionHits();
+  static uint32_t getResumptionMisses();
+
+ private:
+  mbedtls_net_context net;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_entropy_context entropy;
+
+  bool configured = false;
+  bool active = false;
+  int lastErr = 0;
+  int peeked = -1;
+  uint32_t handshakeTimeoutMs = 30000;
+
+  bool setupConfig();
+  bool restoreSession(const char *host, uint16_t port, unsigned char *master);
+  void saveSession(const char *host, uint16_t port, bool offered,
+                   const unsigned char *offeredMaster);
+  bool fail(int err, const char *what);
+};
+
+#endif  // SRC_HELPERS_TLSCLIENT_H_
@@ -0,0 +1,162 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <ArduinoJson.h>
+#include <Preferences.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "VoltageCalibration.h"
+
+static const char *CALIBRATION_PREFS_NAMESPACE = "calib";
+
+static uint16_t calibrationLut[CALIBRATION_LUT_SIZE];
+
+static uint16_t clampMillivolts(int64_t millivolts) {
+  if (millivolts < 0) {
+    return 0;
+  }
+  if (millivolts > UINT16_MAX) {
+    return UINT16_MAX;
+  }
+  return static_cast<uint16_t>(millivolts);
+}
+
+// Parses and validates a points document; the points are returned sorted by
+// input.
+static size_t parseCalibrationPoints(const char *json, size_t length,
+                                     CalibrationPoint *points) {
+  DynamicJsonDocument doc(1024);
+  if (deserializeJson(doc, json, length)) {
+    printHelper.log("ERROR", "Failed to parse calibration points");
+    return 0;
+  }
+  JsonArray array = doc["points"];
+  if (array.isNull() || array.size() == 0 ||
+      array.size() > CALIBRATION_MAX_POINTS) {
+    printHelper.log("ERROR", "Calibration needs 1-%u points",
+                    CALIBRATION_MAX_POINTS);
+    return 0;
+  }
+
+  size_t count = 0;
+  for (JsonArray point : array) {
+    int32_t input = point[0] | -1;
+    int32_t millivolts = point[1] | -1;
+    if (input < 0 || input > CALIBRATION_INPUT_MAX || millivolts < 0 ||
+        millivolts > UINT16_MAX) {
+      printHelper.log("ERROR", "Invalid calibration point %u", count);
+      return 0;
+    }
+    points[count++] = {static_cast<uint16_t>(input),
+                       static_cast<uint16_t>(millivolts)};
+  }
+
+  std::sort(points, points + count,
+            [](const CalibrationPoint &lhs, const CalibrationPoint &rhs) {
+              return lhs.input < rhs.input;
+            });
+  for (size_t i = 1; i < count; i++) {
+    if (points[i].input == points[i - 1].input) {
+      printHelper.log("ERROR", "Duplicate calibration input %u",
+                      points[i].input);
+      return 0;
+    }
+  }
+  if (count == 1 && points[0].input == 0) {
+    printHelper.log("ERROR", "Single calibration point must be above zero");
+    return 0;
+  }
+  return count;
+}
+
+static void buildCalibrationFromPoints(const CalibrationPoint *points,
+                                       size_t count) {
+  for (int i = 0; i < CALIBRATION_LUT_SIZE; i++) {
+    int64_t x = static_cast<int64_t>(i) << CALIBRATION_LUT_SHIFT;
+    if (count == 1) {
+      calibrationLut[i] =
+          clampMillivolts(x * points[0].millivolts / points[0].input);
+      continue;
+    }
+    // Segment covering x, or the nearest end segment
+    size_t upper = 1;
+    while (upper < count - 1 && x > points[upper].input) {
+      upper++;
+    }
+    const CalibrationPoint &p0 = points[upper - 1];
+    const CalibrationPoint &p1 = points[upper];
+    int64_t y = p0.millivolts + (x - p0.input) *
+                                    (p1.millivolts - p0.millivolts) /
+                                    (p1.input - p0.input);
+    calibrationLut[i] = clampMillivolts(y);
+  }
+}
+
+bool loadCalibration() {
+  Preferences prefs;
+  if (!prefs.begin(CALIBRATION_PREFS_NAMESPACE, true)) {
+    return false;
+  }
+  String json = prefs.getString("points", "");
+  prefs.end();
+  if (json.isEmpty()) {
+    return false;
+  }
+
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+  size_t count = parseCalibrationPoints(json.c_str(), json.length(), points);
+  if (count == 0) {
+    return false;
+  }
+  buildCalibrationFromPoints(points, count);
+  printHelper.log("INFO", "Loaded %u calibration points", count);
+  return true;
+}
+
+void buildCalibrationFromPowerLaw(float a, float b, float inputToVolts) {
+  for (int i = 0; i < CALIBRATION_LUT_SIZE; i++) {
+    float vin = (i << CALIBRATION_LUT_SHIFT) * inputToVolts;
+    calibrationLut[i] = clampMillivolts(lroundf(1000.0f * a * powf(vin, b)));
+  }
+}
+
+bool applyCalibrationPayload(const uint8_t *payload, size_t length) {
+  const char *json = reinterpret_cast<const char *>(payload);
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+  size_t count = parseCalibrationPoints(json, length, points);
+  if (count == 0) {
+    return false;
+  }
+  buildCalibrationFromPoints(points, count);
+
+  // The message is retained, so it arrives on every connect; only write NVS
+  // when it differs from what is stored.
+  String received;
+  received.reserve(length);
+  for (size_t i = 0; i < length; i++) {
+    received += json[i];
+  }
+  Preferences prefs;
+  if (!prefs.begin(CALIBRATION_PREFS_NAMESPACE, false)) {
+    printHelper.log("WARN", "Failed to open calibration preferences");
+    return true;
+  }
+  if (prefs.getString("points", "") != received) {
+    prefs.putString("points", received);
+    printHelper.log("INFO", "Stored %u calibration points", count);
+  }
+  prefs.end();
+  return true;
+}
+
+uint32_t calibratedMillivolts(uint32_t input) {
+  if (input > CALIBRATION_INPUT_MAX) {
+    input = CALIBRATION_INPUT_MAX;
+  }
+  uint32_t index = input >> CALIBRATION_LUT_SHIFT;
+  int32_t fraction = input & ((1 << CALIBRATION_LUT_SHIFT) - 1);
+  int32_t y0 = calibrationLut[index];
+  int32_t y1 = calibrationLut[index + 1];
+  return y0 + (((y1 - y0) * fraction) >> CALIBRATION_LUT_SHIFT);
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_VOLTAGECALIBRATION_H_
+#define SRC_HELPERS_VOLTAGECALIBRATION_H_
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+// Converts the voltmeter's ADC input (raw code, or millivolts at the pin when
+// built with VOLTMETER_ADC_CALIBRATED) to battery millivolts through a lookup
+// table with one knot every 2^CALIBRATION_LUT_SHIFT input steps. The table is
+// built at boot, either from calibration points or from the compiled power
+// law, so a conversion is one integer interpolation between two knots.
+//
+// Calibration points use the same JSON format in NVS, in the retained
+// calibration MQTT message and in the output of
+// scripts/exponential_correction.py:
+//
+//   {"points": [[input, millivolts], ...]}
+//
+// Between points the curve is linear; outside them the end segments are
+// extended. A single point is treated as a gain through the origin.
+constexpr int CALIBRATION_INPUT_MAX = 4095;
+constexpr int CALIBRATION_LUT_SHIFT = 6;
+constexpr int CALIBRATION_LUT_SIZE =
+    ((CALIBRATION_INPUT_MAX + 1) >> CALIBRATION_LUT_SHIFT) + 1;
+constexpr size_t CALIBRATION_MAX_POINTS = 16;
+
+struct CalibrationPoint {
+  uint16_t input;
+  uint16_t millivolts;
+};
+
+// Builds the table from the points stored in NVS. Returns false if none are
+// stored or they are invalid.
+bool loadCalibration();
+// Builds the table from millivolts = 1000 * a * (input * inputToVolts)^b.
+void buildCalibrationFromPowerLaw(float a, float b, float inputToVolts);
+// Validates a calibration message, stores it in NVS if it changed and
+// rebuilds the table.
+bool applyCalibrationPayload(const uint8_t *payload, size_t length);
+uint32_t calibratedMillivolts(uint32_t input);
+
+#endif  // SRC_HELPERS_VOLTAGECALIBRATION_H_
@@ -1,29 +1,149 @@
 // Copyright (c) 2023-2025 Sondre Sjølyst
 
 #include <WebServer.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
 
 #include "WIFIHelper.h"
+#include "WakeProfiler.h"
 
 DNSServer dnsServer;
 WiFiServer telnetServer(23);
 WiFiClient telnetClient;
 
+static const uint32_t WIFI_CACHE_MAGIC = 0x57494649;
+static const EventBits_t WIFI_GOT_IP_BIT = BIT0;
+static const EventBits_t WIFI_FAILED_BIT = BIT1;
+
+RTC_DATA_ATTR WifiConnectionCache wifiCache;
+static EventGroupHandle_t wifiEvents = nullptr;
+
+static uint32_t hashSsid(const String &ssid) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < ssid.length(); i++) {
+    hash ^= static_cast<uint8_t>(ssid[i]);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static void onWifiEvent(arduino_event_id_t event) {
+  if (event == ARDUINO_EVENT_WIFI_STA_CONNECTED) {
+    markWakePhase(WAKE_PHASE_WIFI_ASSOCIATED);
+  } else if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    markWakePhase(WAKE_PHASE_IP_ACQUIRED);
+    xEventGroupSetBits(wifiEvents, WIFI_GOT_IP_BIT);
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    xEventGroupSetBits(wifiEvents, WIFI_FAILED_BIT);
+  }
+}
+
+// Blocks until the station has an IP address, the association fails or the
+// timeout expires.
+static bool waitForWifi(uint32_t timeoutMs) {
+  EventBits_t bits = xEventGroupWaitBits(
+      wifiEvents, WIFI_GOT_IP_BIT | WIFI_FAILED_BIT, pdTRUE, pdFALSE,
+      pdMS_TO_TICKS(timeoutMs));
+  return (bits & WIFI_GOT_IP_BIT) && WiFi.status() == WL_CONNECTED;
+}
+
+static bool isLeaseFresh() {
+  time_t now = time(nullptr);
+  return wifiCache.ip != 0 && wifiCache.leaseObtainedAt != 0 &&
+         static_cast<uint32_t>(now) - wifiCache.leaseObtainedAt <
+             wifiCache.leaseReuseS;
+}
+
+// How long the lease the DHCP client just obtained may be reused, from the
+// renewal time the server offered. 0 if it is not known.
+static uint32_t dhcpLeaseReuseSeconds() {
+  esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+  if (netif == nullptr) {
+    return 0;
+  }
+  struct netif *lwipNetif =
+      static_cast<struct netif *>(esp_netif_get_netif_impl(netif));
+  struct dhcp *dhcp = lwipNetif ? netif_dhcp_data(lwipNetif) : nullptr;
+  if (dhcp == nullptr) {
+    return 0;
+  }
+  uint32_t renew = dhcp->offered_t1_renew != 0 ? dhcp->offered_t1_renew
+                                                : dhcp->offered_t0_lease / 2;
+  return renew < WIFI_LEASE_REUSE_S ? renew : WIFI_LEASE_REUSE_S;
+}
+
+static void saveWifiCache(const String &ssid, bool usedDhcp) {
+  wifiCache.magic = WIFI_CACHE_MAGIC;
+  wifiCache.ssidHash = hashSsid(ssid);
+  memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+  wifiCache.channel = WiFi.channel();
+  if (usedDhcp) {
+    wifiCache.ip = WiFi.localIP();
+    wifiCache.gateway = WiFi.gatewayIP();
+    wifiCache.subnet = WiFi.subnetMask();
+    wifiCache.dns = WiFi.dnsIP();
+    // Only trust the lease age once NTP has set the clock
+    time_t now = time(nullptr);
+    wifiCache.leaseObtainedAt = now > 8 * 3600 * 2 ? now : 0;
+    wifiCache.leaseReuseS = dhcpLeaseReuseSeconds();
+  }
+}
+
+void invalidateWifiCache() { wifiCache.magic = 0; }
+
+static void onWifiConnected(uint32_t start, const char *mode) {
+  printHelper.log("INFO", "WiFi connected (%s) in %u ms", mode,
+                  millis() - start);
+  telnetServer.begin();
+  telnetServer.setNoDelay(true);
+}
+
 bool connectWifi(String ssid, String password) {
+  if (wifiEvents == nullptr) {
+    wifiEvents = xEventGroupCreate();
+    WiFi.onEvent(onWifiEvent);
+  }
+  uint32_t start = millis();
+  WiFi.mode(WIFI_STA);
+
+  if (wifiCache.magic == WIFI_CACHE_MAGIC &&
+      wifiCache.ssidHash == hashSsid(ssid)) {
+    bool reuseLease = isLeaseFresh();
+    if (reuseLease) {
+      WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                  IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+    }
+    xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT | WIFI_FAILED_BIT);
+    WiFi.begin(ssid.c_str(), password.c_str(), wifiCache.channel,
+               wifiCache.bssid, true);
+    if (waitForWifi(WIFI_FAST_CONNECT_TIMEOUT_MS)) {
+      saveWifiCache(ssid, !reuseLease);
+      onWifiConnected(start, reuseLease ? "cached BSSID and lease"
+                                        : "cached BSSID");
+      return true;
+    }
+
+    printHelper.log("WARN", "Fast WiFi connect failed, scanning");
+    invalidateWifiCache();
+    WiFi.disconnect();
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  }
+
+  xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT | WIFI_FAILED_BIT);
   WiFi.begin(ssid.c_str(), password.c_str());
-  int tries = 0;
-  while (tries < WIFI_TRIES) {
-    if (WiFi.status() == WL_CONNECTED) {
-      printHelper.log("INFO", "WiFi connected after %d attempts", tries + 1);
-      telnetServer.begin();
-      telnetServer.setNoDelay(true);
+  // The first association attempt may fail while the AP is still being
+  // found, so keep waiting for an IP until the overall timeout
+  uint32_t timeout = WIFI_TRIES * WIFI_DELAY;
+  for (uint32_t elapsed = 0; elapsed < timeout; elapsed = millis() - start) {
+    if (waitForWifi(timeout - elapsed)) {
+      saveWifiCache(ssid, true);
+      onWifiConnected(start, "scan");
       return true;
     }
-    printHelper.log("INFO", "WiFi connect attempt %d", tries + 1);
-    delay(WIFI_DELAY);
-    tries++;
   }
-  printHelper.log("ERROR", "Could not connect to WiFi after %d attempts",
-                  tries);
+  printHelper.log("ERROR", "Could not connect to WiFi after %u ms",
+                  millis() - start);
   return false;
 }
 
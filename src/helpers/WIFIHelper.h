@@ -7,10 +7,10 @@
 #include <ESPmDNS.h>
 #include <WebServer.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
 
 #include "EEPROMHelper.h"
 #include "PRINTHelper.h"
+#include "TLSClient.h"
 
 extern String WIFI_NAME;
 extern const int DNS_PORT;
@@ -23,13 +23,37 @@ extern const int WIFI_TRIES;
 
 extern DNSServer dnsServer;
 extern WiFiServer telnetServer;
-extern WiFiClientSecure *secureClient;
+extern TLSClient *secureClient;
 extern WebServer server;
 extern PRINTHelper printHelper;
 
 const size_t kBufferSize = 256;
 
+// Directed connects with the cached BSSID/channel give up after this long
+// and fall back to a full scan.
+constexpr uint32_t WIFI_FAST_CONNECT_TIMEOUT_MS = 3000;
+// A cached DHCP lease is reused as a static config until its renewal time
+// (T1, normally half the lease) and never for longer than this. After that
+// the wake runs DHCP again.
+constexpr uint32_t WIFI_LEASE_REUSE_S = 12UL * 60UL * 60UL;
+
+// Last good association, kept in RTC memory across deep sleep. A reset or
+// power cycle clears it.
+struct WifiConnectionCache {
+  uint32_t magic;
+  uint32_t ssidHash;
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t leaseObtainedAt;
+  uint32_t leaseReuseS;
+};
+
 bool connectWifi(String ssid, String password);
+void invalidateWifiCache();
 void handleNotFound();
 void setupAP();
 void handleTelnet();
@@ -1,14 +1,74 @@
 // Copyright (c) 2023-2025 Sondre Sjølyst
 
-#include "MQTTHelper.h"
 #include "WIZHelper.h"
 
+#include <algorithm>
+#include <regex>
+#include <string>
+
+#include "MQTTHelper.h"
+#include "controllers/Device.h"
+#include "liz.h"
+
 WiFiUDP Udp;
 
 extern PRINTHelper printHelper;
+extern const char *TOPIC_ROOT;
+extern const char *TOPIC_SET;
 
 void wizSetup() {
   Udp.begin(localUdpPort);
   printHelper.log("INFO", "Now listening at IP %s, UDP port %d",
                   WiFi.localIP().toString().c_str(), localUdpPort);
 }
+
+// Returns true if "SOCKET" or "SHRGBC"
+bool isWizDevice(const std::string &moduleName) {
+  return moduleName.find("SOCKET") != std::string::npos ||
+         moduleName.find("SHRGBC") != std::string::npos;
+}
+
+void discoverAndSubscribe() {
+  // Get the current discoveredDevices
+  auto oldDiscoveredDevices = liz::getDiscoveredDevices();
+  // Discover devices
+  auto discoveredDevices = liz::discover(port, 60000);
+
+  // Only subscribe if a new device has been discovered
+  for (const auto &device : discoveredDevices) {
+    // Check if the device is not in oldDiscoveredDevices
+    if (std::find(oldDiscoveredDevices.begin(), oldDiscoveredDevices.end(),
+                  device) == oldDiscoveredDevices.end()) {
+      std::string deviceIP = std::get<0>(device);
+      std::string deviceMac = std::get<1>(device);
+      std::string moduleName = std::get<2>(device);
+
+      // Extract only "SOCKET" or "SHRGBC" from moduleName
+      std::smatch match;
+      std::string moduleType;
+      if (std::regex_search(moduleName, match, std::regex("(SOCKET|SHRGBC)"))) {
+        moduleType = match.str();
+      } else {
+        moduleType = "unknown";
+      }
+
+      if (isWizDevice(moduleType)) {
+        std::string deviceName = "wiz_" + moduleType + "_" + deviceMac;
+
+        publishDiscoveredDeviceConfig(deviceName.c_str(), moduleType.c_str(),
+                                      "Wiz");
+
+        publishGargeDiscoveryEvent(CHIP_ID, deviceName.c_str(),
+                                   moduleType.c_str());
+
+        String setTopic = String(TOPIC_ROOT) + deviceName.c_str() + TOPIC_SET;
+        mqttClient->subscribe(setTopic.c_str());
+        printHelper.log("INFO", "Subscribed to %s", setTopic.c_str());
+      }
+    }
+  }
+}
+
+void WizBridge::setup() { wizSetup(); }
+
+void WizBridge::loop() { discoverAndSubscribe(); }
@@ -6,6 +6,8 @@
 #include <ArduinoJson.h>
 #include <WiFiUdp.h>
 
+#include <string>
+
 #include "PRINTHelper.h"
 
 constexpr unsigned int localUdpPort = 38899;
@@ -13,5 +15,7 @@ extern WiFiUDP Udp;
 extern PRINTHelper printHelper;
 
 void wizSetup();
+bool isWizDevice(const std::string &moduleName);
+void discoverAndSubscribe();
 
 #endif  // SRC_HELPERS_WIZHELPER_H_
@@ -0,0 +1,106 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <esp_timer.h>
+
+#include "MQTTHelper.h"
+#include "WakeProfiler.h"
+
+static const char *WAKE_PHASE_NAMES[WAKE_PHASE_COUNT] = {
+    "boot", "eeprom", "wifi", "ip", "ntp", "tls", "mqtt", "publish", "sleep",
+};
+
+// Phase durations in ms per wake, WAKE_PHASE_MISSING if not reached
+RTC_DATA_ATTR uint16_t wakeHistory[WAKE_PROFILE_HISTORY][WAKE_PHASE_COUNT];
+RTC_DATA_ATTR uint32_t wakeHistoryCount = 0;
+RTC_DATA_ATTR uint32_t wakeHistoryNext = 0;
+RTC_DATA_ATTR uint32_t wakeTotalMs = 0;
+RTC_DATA_ATTR bool wakeProfilePending = false;
+
+// Microseconds since boot per phase in this wake, 0 if not reached
+static int64_t phaseMarks[WAKE_PHASE_COUNT];
+
+void markWakePhase(WakePhase phase) {
+  if (phaseMarks[phase] == 0) {
+    phaseMarks[phase] = esp_timer_get_time();
+  }
+}
+
+void finishWakeProfile() {
+  markWakePhase(WAKE_PHASE_SLEEP);
+
+  uint16_t *durations = wakeHistory[wakeHistoryNext];
+  int64_t previous = 0;
+  for (int phase = 0; phase < WAKE_PHASE_COUNT; phase++) {
+    if (phaseMarks[phase] == 0) {
+      durations[phase] = WAKE_PHASE_MISSING;
+      continue;
+    }
+    int64_t ms = (phaseMarks[phase] - previous) / 1000;
+    durations[phase] = static_cast<uint16_t>(
+        ms < WAKE_PHASE_MISSING ? ms : WAKE_PHASE_MISSING - 1);
+    previous = phaseMarks[phase];
+  }
+  wakeTotalMs = phaseMarks[WAKE_PHASE_SLEEP] / 1000;
+
+  wakeHistoryNext = (wakeHistoryNext + 1) % WAKE_PROFILE_HISTORY;
+  if (wakeHistoryCount < WAKE_PROFILE_HISTORY) {
+    wakeHistoryCount++;
+  }
+  wakeProfilePending = true;
+}
+
+bool publishWakeProfile(const String &mac) {
+  if (!wakeProfilePending || wakeHistoryCount == 0) {
+    return true;
+  }
+
+  size_t last = (wakeHistoryNext + WAKE_PROFILE_HISTORY - 1) %
+                WAKE_PROFILE_HISTORY;
+  DynamicJsonDocument doc(1536);
+  JsonObject phases = doc.createNestedObject("phases");
+  JsonObject stats = doc.createNestedObject("stats");
+  for (int phase = 0; phase < WAKE_PHASE_COUNT; phase++) {
+    const char *name = WAKE_PHASE_NAMES[phase];
+    if (wakeHistory[last][phase] != WAKE_PHASE_MISSING) {
+      phases[name] = wakeHistory[last][phase];
+    }
+
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+    uint32_t sum = 0;
+    uint32_t count = 0;
+    for (size_t i = 0; i < wakeHistoryCount; i++) {
+      uint16_t ms = wakeHistory[i][phase];
+      if (ms == WAKE_PHASE_MISSING) {
+        continue;
+      }
+      min = ms < min ? ms : min;
+      max = ms > max ? ms : max;
+      sum += ms;
+      count++;
+    }
+    if (count > 0) {
+      // [min, avg, max] keeps the message inside the MQTT buffer
+      JsonArray stat = stats.createNestedArray(name);
+      stat.add(min);
+      stat.add(sum / count);
+      stat.add(max);
+    }
+  }
+  doc["total"] = wakeTotalMs;
+  doc["wakes"] = wakeHistoryCount;
+
+  char buffer[768];
+  size_t n = serializeJson(doc, buffer, sizeof(buffer));
+  if (n == 0 || n >= sizeof(buffer) - 1) {
+    printHelper.log("ERROR", "Wake profile does not fit in %u bytes",
+                    sizeof(buffer));
+    wakeProfilePending = false;
+    return false;
+  }
+  if (!publishGargeDiagnostics(mac, String(buffer))) {
+    return false;
+  }
+  wakeProfilePending = false;
+  return true;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef SRC_HELPERS_WAKEPROFILER_H_
+#define SRC_HELPERS_WAKEPROFILER_H_
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "PRINTHelper.h"
+
+extern PRINTHelper printHelper;
+
+// Milestones of a wake cycle, in the order they normally happen. Each phase's
+// duration is the time since the previous milestone that was reached; phases
+// a wake skips (e.g. NTP on a fast wake) are reported as missing.
+enum WakePhase : uint8_t {
+  WAKE_PHASE_BOOT = 0,
+  WAKE_PHASE_EEPROM,
+  WAKE_PHASE_WIFI_ASSOCIATED,
+  WAKE_PHASE_IP_ACQUIRED,
+  WAKE_PHASE_NTP,
+  WAKE_PHASE_TLS,
+  WAKE_PHASE_MQTT,
+  WAKE_PHASE_PUBLISHED,
+  WAKE_PHASE_SLEEP,
+  WAKE_PHASE_COUNT,
+};
+
+// Breakdowns of the most recent wakes are kept in RTC memory for the
+// min/avg/max statistics.
+constexpr size_t WAKE_PROFILE_HISTORY = 16;
+constexpr uint16_t WAKE_PHASE_MISSING = UINT16_MAX;
+
+// Records esp_timer_get_time() for the phase; only the first mark of a phase
+// in a wake counts.
+void markWakePhase(WakePhase phase);
+// Marks sleep entry and stores this wake's breakdown. Call right before deep
+// sleep.
+void finishWakeProfile();
+// Publishes the breakdown of the previous wake and the statistics, once per
+// stored breakdown. Returns false only if publishing failed.
+bool publishWakeProfile(const String &mac);
+
+#endif  // SRC_HELPERS_WAKEPROFILER_H_
@@ -1,50 +1,38 @@
 // Copyright (c) 2023-2025 Sondre Sjølyst
 
 #include <Arduino.h>
-#include <DHT.h>
 #include <DNSServer.h>
 #include <EEPROM.h>
 #include <HTTPClient.h>
 #include <WebServer.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
 #include <Wire.h>
 
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
-#include <regex>
 #include <string>
 #include <vector>
 
-#include "./liz.h"
-#include "controllers/SensorController.h"
-#include "controllers/VoltmeterController.h"
+#include "controllers/Device.h"
+#include "helpers/Base64Helper.h"
 #include "helpers/EEPROMHelper.h"
 #include "helpers/MQTTHelper.h"
 #include "helpers/OTAHelper.h"
 #include "helpers/PRINTHelper.h"
+#include "helpers/TLSClient.h"
+#include "helpers/WakeProfiler.h"
 #include "helpers/WIZHelper.h"
 #include "helpers/WiFiHelper.h"
 #include "soc/rtc_cntl_reg.h"
 #include "soc/soc.h"
 #include "web/WebSite.h"
 
-#ifndef SENSOR_TYPE
-#define SENSOR_TYPE "bme"  // "bme" or "dht"
-#endif
-
-#ifndef GARGE_TYPE
-#define GARGE_TYPE "sensor"  // "voltmeter" or "sensor"
-#endif
-
 const char *MQTT_BROKER = "emqx-mqtt.prod.tumogroup.com";
 const int MQTT_PORT = 8883;
 bool isAPMode = false;
 
-constexpr uint8_t DHTTYPE = DHT11;
 constexpr float TEMP_HUMID_DIFF = 10.0;
-constexpr int DHT_SENSOR_PIN = 2;
 constexpr int DNS_PORT = 53;
 constexpr int EEPROM_MQTT_PASSWORD_END = 511;
 constexpr int EEPROM_MQTT_PASSWORD_START = 384;
@@ -64,16 +52,15 @@ constexpr int WIFI_DELAY = 1000;
 constexpr int WIFI_TRIES = 15;
 constexpr int port = 38899;
 constexpr size_t EEPROM_SIZE = 512;
+// Free heap required before starting a TLS handshake. Lower it only from the
+// "Free heap before TLS" log lines measured on a device.
+constexpr uint32_t MQTT_MIN_FREE_HEAP = 200000;
 constexpr int LIGHT_PIN = 2;
 volatile bool OTA_IN_PROGRESS = false;
+bool fastWake = false;
 
-extern const char *TOPIC_ROOT;
-extern const char *TOPIC_SET;
-
-WiFiClientSecure *secureClient = nullptr;
+TLSClient *secureClient = nullptr;
 PubSubClient *mqttClient = nullptr;
-Adafruit_BME280 bme;
-DHT dht(DHT_SENSOR_PIN, DHTTYPE, 11);
 WebServer server(WEBSITE_PORT);
 ResetWiFi resetWiFi(RESET_BUTTON_GPO, RESET_PRESS_DURATION);
 OTAHelper *otaHelper = nullptr;
@@ -95,50 +82,6 @@ String sensorTypeLower = toLowerFunc(SENSOR_TYPE);
 const String OTA_PRODUCT_NAME =
     productNameLower + "_" + gargeTypeLower + "_" + sensorTypeLower;
 
-typedef unsigned char uchar;
-static const char base64_table[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static std::string base64_encode(const std::string &in) {
-  std::string out;
-
-  int val = 0, valb = -6;
-  for (uchar c : in) {
-    val = (val << 8) + c;
-    valb += 8;
-    while (valb >= 0) {
-      out.push_back(static_cast<char>(base64_table[(val >> valb) & 0x3F]));
-      valb -= 6;
-    }
-  }
-  if (valb > -6)
-    out.push_back(
-        static_cast<char>(base64_table[((val << 8) >> (valb + 8)) & 0x3F]));
-  while (out.size() % 4)
-    out.push_back('=');
-  return out;
-}
-
-static std::string base64_decode(const std::string &in) {
-  std::string out;
-
-  std::vector<int> T(256, -1);
-  for (int i = 0; i < 64; i++)
-    T[static_cast<unsigned char>(base64_table[i])] = i;
-
-  int val = 0, valb = -8;
-  for (uchar c : in) {
-    if (T[c] == -1)
-      break;
-    val = (val << 6) + T[c];
-    valb += 6;
-    if (valb >= 0) {
-      out.push_back(static_cast<char>((val >> valb) & 0xFF));
-      valb -= 8;
-    }
-  }
-  return out;
-}
-
 void gargeSetupAP() {
   setupAP();
   isAPMode = true;
@@ -162,19 +105,12 @@ void setupTime() {
   if (now < 8 * 3600 * 2) {
     printHelper.log("WARN", "NTP sync timeout. Time not set.");
   } else {
+    markWakePhase(WAKE_PHASE_NTP);
     printHelper.log("DEBUG", "NTP sync successful. Current time: %s",
                     ctime(&now));
   }
 }
 
-bool isNightTime() {
-  time_t now = time(nullptr);
-  struct tm timeinfo;
-  localtime_r(&now, &timeinfo);
-  int hour = timeinfo.tm_hour;
-  return (hour >= 2 && hour < 4);
-}
-
 #define WIFI_DEBUG
 
 String getMacString() {
@@ -189,23 +125,69 @@ String getMacString() {
   return mac;
 }
 
+// Keeps one TLSClient for the whole uptime; reconnects only reset the
+// connection instead of reallocating the client, which fragmented the heap.
 void setupSecureClient() {
   if (secureClient) {
-    delete secureClient;
-    secureClient = nullptr;
+    secureClient->stop();
+    return;
   }
 
-  secureClient = new WiFiClientSecure();
+  secureClient = new TLSClient();
   if (!secureClient) {
-    printHelper.log("ERROR", "Failed to allocate WiFiClientSecure");
+    printHelper.log("ERROR", "Failed to allocate TLSClient");
     return;
   }
 
-  secureClient->setInsecure();
   secureClient->setHandshakeTimeout(30);
 }
 
+// Timer wakeup path for the voltmeter: only what is needed to publish one
+// reading. NTP, OTA, WiZ and the web server are left to maintenance boots,
+// and the system time set by NTP survives deep sleep.
+void fastWakeSetup() {
+  fastWake = true;
+  CHIP_ID = getMacString();
+  printHelper.log("DEBUG", "Fast wake, chip ID: %s", CHIP_ID.c_str());
+
+  EEPROMHelper_begin(EEPROM_SIZE);
+  String EEPROM_SSID = readEEPROM(EEPROM_SSID_START, EEPROM_SSID_END);
+  String EEPROM_PASSWORD =
+      readEEPROM(EEPROM_PASSWORD_START, EEPROM_PASSWORD_END);
+  EEPROM_MQTT_USERNAME =
+      readEEPROM(EEPROM_MQTT_USERNAME_START, EEPROM_MQTT_USERNAME_END);
+  EEPROM_MQTT_PASSWORD =
+      readEEPROM(EEPROM_MQTT_PASSWORD_START, EEPROM_MQTT_PASSWORD_END);
+  markWakePhase(WAKE_PHASE_EEPROM);
+
+  voltageSensorSetup(CHIP_ID);
+
+  if (!connectWifi(EEPROM_SSID, EEPROM_PASSWORD)) {
+    printHelper.log("WARN", "Fast wake WiFi failed, full boot next wake");
+    requestMaintenanceWake();
+    logVoltageAndSleep();
+  }
+
+  setupSecureClient();
+  mqttClient = new PubSubClient(*secureClient);
+  connectToMQTT(1);
+  if (!mqttStatus()) {
+    printHelper.log("WARN", "Fast wake MQTT failed, full boot next wake");
+    requestMaintenanceWake();
+    logVoltageAndSleep();
+  }
+}
+
 void setup() {
+  markWakePhase(WAKE_PHASE_BOOT);
+  if constexpr (GargeDevice::CAN_BE_VOLTMETER) {
+    if (GargeDevice::isVoltmeter() && isVoltmeterFastWake()) {
+      Serial.begin(SERIAL_PORT);
+      fastWakeSetup();
+      return;
+    }
+  }
+
   delay(1000);
   Serial.begin(SERIAL_PORT);
   delay(100);
@@ -236,6 +218,7 @@ void setup() {
       readEEPROM(EEPROM_MQTT_USERNAME_START, EEPROM_MQTT_USERNAME_END);
   EEPROM_MQTT_PASSWORD =
       readEEPROM(EEPROM_MQTT_PASSWORD_START, EEPROM_MQTT_PASSWORD_END);
+  markWakePhase(WAKE_PHASE_EEPROM);
 
   printHelper.log("DEBUG", "EEPROM_SSID: '%s', EEPROM_PASSWORD: '%s'",
                   EEPROM_SSID.c_str(), EEPROM_PASSWORD.c_str());
@@ -269,15 +252,14 @@ void setup() {
     mqttClient = new PubSubClient(*secureClient);
     mqttClient->setServer(MQTT_BROKER, MQTT_PORT);
 
-    if (strcmp(GARGE_TYPE, "sensor") == 0) {
-      environmentalSensorSetup(SENSOR_TYPE);
-    } else if (strcmp(GARGE_TYPE, "voltmeter") == 0) {
-      voltageSensorSetup(CHIP_ID);
-    } else {
-      printHelper.log("ERROR", "Please set GARGE_TYPE");
+    GargeDevice::setupSensor();
+    // The RAM history needs the device to stay awake
+    if (!GargeDevice::isVoltmeter()) {
+      server.on("/history", webpage_history);
     }
 
     server.on("/", webpage_status);
+    server.on("/metrics", webpage_metrics);
 
     if (otaHelper != nullptr) {
       delete otaHelper;
@@ -286,10 +268,14 @@ void setup() {
     otaHelper = new OTAHelper();
     otaHelper->setup();
 
-    otaHelper->checkAndUpdateFromManifest(OTA_MANIFEST_URL,
-                                          OTA_PRODUCT_NAME.c_str(), VERSION);
+    // Mains-powered devices boot together after a power cut and spread
+    // their checks out; a voltmeter's boots are its own, and it stays awake
+    // until the check is done
+    otaHelper->startBootCheck(
+        OTA_MANIFEST_URL, OTA_PRODUCT_NAME.c_str(), VERSION,
+        GargeDevice::isVoltmeter() ? 0 : OTA_BOOT_CHECK_MAX_DELAY_S);
 
-    wizSetup();
+    GargeDevice::Bridge::setup();
   } else {
     printHelper.log("WARN", "WiFi connection failed, starting AP mode.");
     gargeSetupAP();
@@ -322,53 +308,6 @@ void blinkLED(int count, int LED_BLINK_DELAY) {
   }
 }
 
-// Returns true if "SOCKET" or "SHRGBC"
-bool isWizDevice(const std::string &moduleName) {
-  return moduleName.find("SOCKET") != std::string::npos ||
-         moduleName.find("SHRGBC") != std::string::npos;
-}
-
-void discoverAndSubscribe() {
-  // Get the current discoveredDevices
-  auto oldDiscoveredDevices = liz::getDiscoveredDevices();
-  // Discover devices
-  auto discoveredDevices = liz::discover(port, 60000);
-
-  // Only subscribe if a new device has been discovered
-  for (const auto &device : discoveredDevices) {
-    // Check if the device is not in oldDiscoveredDevices
-    if (std::find(oldDiscoveredDevices.begin(), oldDiscoveredDevices.end(),
-                  device) == oldDiscoveredDevices.end()) {
-      std::string deviceIP = std::get<0>(device);
-      std::string deviceMac = std::get<1>(device);
-      std::string moduleName = std::get<2>(device);
-
-      // Extract only "SOCKET" or "SHRGBC" from moduleName
-      std::smatch match;
-      std::string moduleType;
-      if (std::regex_search(moduleName, match, std::regex("(SOCKET|SHRGBC)"))) {
-        moduleType = match.str();
-      } else {
-        moduleType = "unknown";
-      }
-
-      if (isWizDevice(moduleType)) {
-        std::string deviceName = "wiz_" + moduleType + "_" + deviceMac;
-
-        publishDiscoveredDeviceConfig(deviceName.c_str(), moduleType.c_str(),
-                                      "Wiz");
-
-        publishGargeDiscoveryEvent(CHIP_ID, deviceName.c_str(),
-                                   moduleType.c_str());
-
-        String setTopic = String(TOPIC_ROOT) + deviceName.c_str() + TOPIC_SET;
-        mqttClient->subscribe(setTopic.c_str());
-        printHelper.log("INFO", "Subscribed to %s", setTopic.c_str());
-      }
-    }
-  }
-}
-
 void checkSerialForCredentials() {
   if (Serial.available()) {
     String line = Serial.readStringUntil('\n');
@@ -398,17 +337,52 @@ void checkSerialForCredentials() {
   }
 }
 
+void publishOtaProgress() {
+  if (!mqttStatus()) {
+    return;
+  }
+  // Read first: the final state is already set once this is
+  bool finalStatePending = otaHelper->isFinalStatePending();
+  OTAProgress progress = otaHelper->getProgress();
+
+  DynamicJsonDocument doc(256);
+  char buffer[256];
+  doc["state"] = progress.state;
+  doc["written"] = progress.written;
+  doc["total"] = progress.total;
+  if (progress.total > 0) {
+    doc["percent"] = 100ULL * progress.written / progress.total;
+  }
+  doc["eta"] = otaHelper->getEtaSeconds();
+  serializeJson(doc, buffer);
+
+  if (publishGargeOtaProgress(CHIP_ID, String(buffer)) && finalStatePending) {
+    // The OTA task finishes the job, or restarts, once this is out
+    otaHelper->acknowledgeFinalState();
+  }
+}
+
 void loop() {
   static uint32_t apStartTime = 0;
   static uint32_t lastMqttAttempt = 0;
   static uint32_t lastOtaCheck = 0;
+  static uint32_t lastOtaProgress = 0;
 
   const uint32_t mqttReconnectDelay = 5000;                // 5 seconds
-  const uint32_t otaCheckInterval = 60UL * 60UL * 1000UL;  // 1 hour
+  const uint32_t otaCheckInterval = 60UL * 1000UL;         // 1 minute
+  const uint32_t otaProgressInterval = 5000;               // 5 seconds
   const uint32_t apTimeout = 30UL * 60UL * 1000UL;         // 30 minutes
 
   checkSerialForCredentials();
 
+  if constexpr (GargeDevice::CAN_BE_VOLTMETER) {
+    if (fastWake) {
+      mqttClient->loop();
+      readAndWriteVoltageSensor();
+      return;
+    }
+  }
+
   if (isAPMode) {
     server.handleClient();
     blinkLED(LED_BLINK_COUNT, LED_BLINK_DELAY);
@@ -426,6 +400,10 @@ void loop() {
     blinkLED(LED_BLINK_COUNT, 5000);
   }
 
+  // Sampled whatever the connection state; readings that cannot be published
+  // go to the reading log and are backfilled once the broker is back
+  GargeDevice::loop();
+
   if (WiFi.status() != WL_CONNECTED) {
     static uint32_t lastAttempt = 0;
     if (millis() - lastAttempt > 5000) {
@@ -458,7 +436,7 @@ void loop() {
       if (millis() - lastMqttAttempt > mqttReconnectDelay) {
         uint32_t freeHeap = ESP.getFreeHeap();
         printHelper.log("DEBUG", "Free heap before MQTT connect: %u", freeHeap);
-        if (freeHeap < 200000) {
+        if (freeHeap < MQTT_MIN_FREE_HEAP) {
           printHelper.log("ERROR", "Not enough heap for MQTT TLS connection. "
                                    "Skipping connect attempt.");
         } else {
@@ -469,8 +447,9 @@ void loop() {
           setupSecureClient();
           mqttClient->setClient(*secureClient);
 
+          // One attempt, so the sensor keeps being serviced in an outage
           printHelper.log("DEBUG", "Connecting to MQTT...");
-          connectToMQTT();
+          connectToMQTT(1);
           printHelper.log("DEBUG", "MQTT status after connect: %d",
                           mqttStatus());
         }
@@ -484,28 +463,23 @@ void loop() {
 
   if (millis() - lastOtaCheck > otaCheckInterval) {
     lastOtaCheck = millis();
-    if (isNightTime()) {
-      printHelper.log("DEBUG", "Night time OTA check...");
-      otaHelper->checkAndUpdateFromManifest(OTA_MANIFEST_URL,
-                                            OTA_PRODUCT_NAME.c_str(), VERSION);
+    if (otaHelper != nullptr && !otaHelper->isBusy() &&
+        otaHelper->isCheckDue()) {
+      printHelper.log("DEBUG", "Scheduled OTA check...");
+      otaHelper->startBackgroundCheck(OTA_MANIFEST_URL,
+                                      OTA_PRODUCT_NAME.c_str(), VERSION);
     }
   }
 
+  if (otaHelper != nullptr && OTA_IN_PROGRESS &&
+      (otaHelper->isFinalStatePending() ||
+       millis() - lastOtaProgress > otaProgressInterval)) {
+    lastOtaProgress = millis();
+    publishOtaProgress();
+  }
+
   handleTelnet();
   server.handleClient();
   resetWiFi.update();
   mqttClient->loop();
-
-  if (strcmp(GARGE_TYPE, "sensor") == 0) {
-    readAndWriteEnvironmentalSensors(SENSOR_TYPE);
-  } else if (strcmp(GARGE_TYPE, "voltmeter") == 0) {
-    if (!OTA_IN_PROGRESS) {
-      readAndWriteVoltageSensor();
-    } else {
-      printHelper.log(
-          "INFO", "OTA in progress, skipping voltage publish and deep sleep.");
-    }
-    return;
-  }
-  discoverAndSubscribe();
 }
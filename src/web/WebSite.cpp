@@ -4,14 +4,17 @@
 #include <WebServer.h>
 #include <WiFi.h>
 
+#include <ctime>
 #include <vector>
 
 #include "WebSite.h"
 #include "helpers/EEPROMHelper.h"
+#include "helpers/ReadingHistory.h"
 
 extern WebServer server;
 extern WiFiClient serverClient;
 extern PubSubClient *mqttClient;
+extern OTAHelper *otaHelper;
 
 String getWifiOptions() {
   int n = WiFi.scanNetworks();
@@ -122,6 +125,64 @@ void webpage_status() {
   server.send(200, "text/html", html);
 }
 
+// Prometheus text exposition of device and OTA state.
+void webpage_metrics() {
+  String body;
+  body += "garge_uptime_seconds " + String(millis() / 1000) + "\n";
+  body += "garge_free_heap_bytes " + String(ESP.getFreeHeap()) + "\n";
+  body += "garge_wifi_rssi_dbm " + String(WiFi.RSSI()) + "\n";
+  body += "garge_tls_resumption_hits " +
+          String(TLSClient::getResumptionHits()) + "\n";
+  body += "garge_tls_resumption_misses " +
+          String(TLSClient::getResumptionMisses()) + "\n";
+  body += "garge_mqtt_connected " +
+          String(mqttClient != nullptr && mqttClient->connected() ? 1 : 0) +
+          "\n";
+
+  if (otaHelper != nullptr) {
+    OTAProgress progress = otaHelper->getProgress();
+    body += "garge_ota_in_progress " + String(OTA_IN_PROGRESS ? 1 : 0) +
+            "\n";
+    body += "garge_ota_state{state=\"" + String(progress.state) + "\"} 1\n";
+    body += "garge_ota_written_bytes " + String(progress.written) + "\n";
+    body += "garge_ota_total_bytes " + String(progress.total) + "\n";
+    body += "garge_ota_eta_seconds " + String(otaHelper->getEtaSeconds()) +
+            "\n";
+  }
+
+  server.send(200, "text/plain; version=0.0.4", body);
+}
+
+static uint32_t uintArg(const char *name, uint32_t fallback) {
+  return server.hasArg(name) ? strtoul(server.arg(name).c_str(), nullptr, 10)
+                             : fallback;
+}
+
+// /history?from=&to=&step=&format=json|csv, times in Unix seconds. Defaults
+// to the last day at the stored resolution, as JSON.
+void webpage_history() {
+  uint32_t to = uintArg("to", static_cast<uint32_t>(time(nullptr)));
+  uint32_t from = uintArg("from", to > 24 * 3600 ? to - 24 * 3600 : 0);
+  uint32_t step = uintArg("step", 0);
+  HistoryFormat format =
+      server.arg("format") == "csv" ? HISTORY_CSV : HISTORY_JSON;
+
+  if (from > to) {
+    server.send(400, "text/plain", "from is after to");
+    return;
+  }
+
+  // Streamed with chunked encoding, so a week of history never has to fit in
+  // the heap as one String
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, format == HISTORY_CSV ? "text/csv" : "application/json",
+              "");
+  streamHistory(from, to, step, format, [](const char *chunk, size_t length) {
+    server.sendContent(chunk, length);
+  });
+  server.sendContent("");
+}
+
 void handleSubmit() {
   if (server.hasArg("ssid") && server.hasArg("password")) {
     String ssid = server.arg("ssid");
@@ -9,13 +9,19 @@
 
 #include <vector>
 
+#include "helpers/OTAHelper.h"
+#include "helpers/TLSClient.h"
+
 extern WebServer server;
 extern WiFiClient serverClient;
 extern PubSubClient *mqttClient;
+extern OTAHelper *otaHelper;
 
 String getWifiOptions();
 void handleRoot();
 void webpage_status();
+void webpage_metrics();
+void webpage_history();
 void handleSubmit();
 void handleClearWiFi();
 
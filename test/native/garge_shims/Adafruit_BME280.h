@@ -0,0 +1,70 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_ADAFRUIT_BME280_H_
+#define TEST_NATIVE_GARGE_SHIMS_ADAFRUIT_BME280_H_
+
+#include <Adafruit_Sensor.h>
+#include <Wire.h>
+
+// Returns whatever the test last stored in the public fields. Reads spend the
+// bus time of the library's transactions on the TwoWire passed to begin().
+class Adafruit_BME280 {
+ public:
+  enum sensor_sampling {
+    SAMPLING_NONE,
+    SAMPLING_X1,
+    SAMPLING_X2,
+    SAMPLING_X4,
+    SAMPLING_X8,
+    SAMPLING_X16
+  };
+  enum sensor_mode { MODE_SLEEP, MODE_FORCED, MODE_NORMAL = 3 };
+  enum sensor_filter {
+    FILTER_OFF,
+    FILTER_X2,
+    FILTER_X4,
+    FILTER_X8,
+    FILTER_X16
+  };
+  enum standby_duration { STANDBY_MS_0_5 };
+
+  bool begin(uint8_t address = 0x77, TwoWire *wire = &Wire) {
+    wire_ = wire;
+    return present;
+  }
+  void setSampling(sensor_mode mode = MODE_NORMAL,
+                   sensor_sampling tempSampling = SAMPLING_X16,
+                   sensor_sampling pressSampling = SAMPLING_X16,
+                   sensor_sampling humSampling = SAMPLING_X16,
+                   sensor_filter filter = FILTER_OFF,
+                   standby_duration duration = STANDBY_MS_0_5) {
+    this->mode = mode;
+  }
+  bool takeForcedMeasurement() {
+    forcedMeasurements++;
+    return present;
+  }
+  // Register write, then 3 data bytes
+  float readTemperature() {
+    wire_->busTime(6);
+    return temperature;
+  }
+  // The library reads the temperature again first, then 2 data bytes
+  float readHumidity() {
+    wire_->busTime(11);
+    return humidity;
+  }
+  float readPressure() { return pressure; }
+
+  bool present = true;
+  sensor_mode mode = MODE_NORMAL;
+  uint32_t forcedMeasurements = 0;
+  float temperature = 21.5;
+  float humidity = 40.0;
+  float pressure = 101325.0;
+
+ private:
+  TwoWire *wire_ = &Wire;
+};
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_ADAFRUIT_BME280_H_
@@ -0,0 +1,8 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_ADAFRUIT_SENSOR_H_
+#define TEST_NATIVE_GARGE_SHIMS_ADAFRUIT_SENSOR_H_
+
+#include <Arduino.h>
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_ADAFRUIT_SENSOR_H_
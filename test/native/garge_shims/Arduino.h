@@ -0,0 +1,158 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_ARDUINO_H_
+#define TEST_NATIVE_GARGE_SHIMS_ARDUINO_H_
+
+// Host stand-ins for the Arduino/ESP32 APIs the firmware uses, so the
+// controllers and helpers can be built and exercised on Linux. Behaviour the
+// tests need to steer (time, ADC values, restarts) is controlled through the
+// shim namespace.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "WString.h"
+
+#define RTC_DATA_ATTR
+
+// Flash is ordinary memory on the ESP32, as it is on the host
+#define PROGMEM
+#define pgm_read_byte_near(address) \
+  (*reinterpret_cast<const uint8_t *>(address))
+#define strlen_P strlen
+#define strnlen_P strnlen
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+constexpr uint8_t INPUT = 0x01;
+constexpr uint8_t OUTPUT = 0x03;
+constexpr uint8_t LOW = 0x0;
+constexpr uint8_t HIGH = 0x1;
+constexpr uint8_t A0 = 1;
+
+enum adc_attenuation_t { ADC_0db, ADC_2_5db, ADC_6db, ADC_11db };
+
+template <typename T, typename L, typename H>
+T constrain(T value, L low, H high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+namespace shim {
+
+// Raised instead of rebooting, so a test can observe the restart.
+struct Restart {};
+
+// Time only moves forward through delay() and advanceMillis(), which makes
+// runs deterministic and lets simulations skip hours without waiting.
+uint64_t nowMicros();
+void advanceMillis(uint32_t ms);
+// Jumps to an absolute time, also backwards. The fleet simulator uses it to
+// run each virtual device on its own timeline.
+void setMicros(uint64_t us);
+
+void setAnalogValue(uint8_t pin, uint16_t value);
+void setAnalogMilliVolts(uint8_t pin, uint32_t millivolts);
+
+// Silences Serial, e.g. while benchmarking.
+void setSerialEnabled(bool enabled);
+
+// Whether psramFound() reports PSRAM; true unless a test turns it off.
+void setPsramFound(bool found);
+
+}  // namespace shim
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation);
+
+uint32_t esp_random();
+
+bool psramFound();
+void *ps_malloc(size_t size);
+
+class IPAddress {
+ public:
+  IPAddress() = default;
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : address_(a | (b << 8) | (c << 16) | (static_cast<uint32_t>(d) << 24)) {
+  }
+  explicit IPAddress(uint32_t address) : address_(address) {}
+  operator uint32_t() const { return address_; }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", address_ & 0xFF,
+             (address_ >> 8) & 0xFF, (address_ >> 16) & 0xFF, address_ >> 24);
+    return String(buf);
+  }
+
+ private:
+  uint32_t address_ = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) {
+    size_t n = 0;
+    while (size--) {
+      n += write(*buf++);
+    }
+    return n;
+  }
+  size_t print(const char *s) {
+    return write(reinterpret_cast<const uint8_t *>(s), strlen(s));
+  }
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t println(const char *s = "") { return print(s) + print("\n"); }
+  size_t println(const String &s) { return println(s.c_str()); }
+  size_t printf(const char *format, ...)
+      __attribute__((format(printf, 2, 3))) {
+    char buf[512];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return n > 0 ? print(buf) : 0;
+  }
+  virtual void flush() {}
+};
+
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud) {}  // NOLINT(runtime/int)
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() { return 0; }
+  int read() { return -1; }
+  String readStringUntil(char terminator) { return String(); }
+  void setDebugOutput(bool enabled) {}
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getMinFreeHeap() { return 180000; }
+  [[noreturn]] void restart() { throw shim::Restart(); }
+};
+
+extern EspClass ESP;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_ARDUINO_H_
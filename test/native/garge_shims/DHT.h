@@ -0,0 +1,31 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_DHT_H_
+#define TEST_NATIVE_GARGE_SHIMS_DHT_H_
+
+#include <Arduino.h>
+
+#define DHT11 11
+#define DHT22 22
+
+// Returns whatever the test last stored in the public fields.
+class DHT {
+ public:
+  DHT(uint8_t pin, uint8_t type, uint8_t count = 6) {}
+  void begin(uint8_t usecMaxCycles = 55) {}
+  // The start signal and the response take about 25 ms on the wire
+  bool read(bool force = false) {
+    delay(25);
+    return present;
+  }
+  float readTemperature(bool fahrenheit = false, bool force = false) {
+    return temperature;
+  }
+  float readHumidity(bool force = false) { return humidity; }
+
+  float temperature = 21.5;
+  float humidity = 40.0;
+  bool present = true;
+};
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_DHT_H_
@@ -0,0 +1,41 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_EEPROM_H_
+#define TEST_NATIVE_GARGE_SHIMS_EEPROM_H_
+
+#include <Arduino.h>
+
+#include <vector>
+
+// Erased flash reads as 0xFF, like a fresh device.
+class EEPROMClass {
+ public:
+  bool begin(size_t size) {
+    data_.resize(size, 0xFF);
+    return true;
+  }
+  uint8_t read(int address) {
+    return address >= 0 && static_cast<size_t>(address) < data_.size()
+               ? data_[address]
+               : 0xFF;
+  }
+  void write(int address, uint8_t value) {
+    if (address >= 0 && static_cast<size_t>(address) < data_.size()) {
+      data_[address] = value;
+    }
+  }
+  bool commit() {
+    commits++;
+    return true;
+  }
+  void end() {}
+
+  uint32_t commits = 0;
+
+ private:
+  std::vector<uint8_t> data_;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_EEPROM_H_
@@ -0,0 +1,10 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_IPADDRESS_H_
+#define TEST_NATIVE_GARGE_SHIMS_IPADDRESS_H_
+
+// IPAddress is defined in Arduino.h, this is for libraries that include it
+// on its own
+#include <Arduino.h>
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_IPADDRESS_H_
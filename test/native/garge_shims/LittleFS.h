@@ -0,0 +1,86 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_LITTLEFS_H_
+#define TEST_NATIVE_GARGE_SHIMS_LITTLEFS_H_
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+// Handle to a file kept in memory by LittleFSClass.
+class File {
+ public:
+  File() = default;
+  explicit File(std::vector<uint8_t> *data, size_t position = 0)
+      : data_(data), position_(position) {}
+
+  explicit operator bool() const { return data_ != nullptr; }
+  size_t write(const uint8_t *buf, size_t size) {
+    data_->insert(data_->end(), buf, buf + size);
+    position_ = data_->size();
+    return size;
+  }
+  size_t read(uint8_t *buf, size_t size) {
+    size_t n = std::min(size, data_->size() - position_);
+    memcpy(buf, data_->data() + position_, n);
+    position_ += n;
+    return n;
+  }
+  bool seek(uint32_t position) {
+    if (position > data_->size()) {
+      return false;
+    }
+    position_ = position;
+    return true;
+  }
+  size_t position() const { return position_; }
+  size_t size() const { return data_->size(); }
+  void close() { data_ = nullptr; }
+
+ private:
+  std::vector<uint8_t> *data_ = nullptr;
+  size_t position_ = 0;
+};
+
+class LittleFSClass {
+ public:
+  bool begin(bool formatOnFail = false) { return mountable; }
+  bool exists(const char *path) { return files_.count(path) > 0; }
+  bool remove(const char *path) { return files_.erase(path) > 0; }
+  bool rename(const char *from, const char *to) {
+    auto it = files_.find(from);
+    if (it == files_.end()) {
+      return false;
+    }
+    files_[to] = std::move(it->second);
+    files_.erase(it);
+    return true;
+  }
+  File open(const char *path, const char *mode) {
+    if (strcmp(mode, FILE_READ) == 0) {
+      auto it = files_.find(path);
+      return it == files_.end() ? File() : File(&it->second);
+    }
+    std::vector<uint8_t> &data = files_[path];
+    if (strcmp(mode, FILE_WRITE) == 0) {
+      data.clear();
+    }
+    return File(&data, data.size());
+  }
+  void format() { files_.clear(); }
+
+  bool mountable = true;
+
+ private:
+  std::map<std::string, std::vector<uint8_t>> files_;
+};
+
+extern LittleFSClass LittleFS;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_LITTLEFS_H_
@@ -0,0 +1,211 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <LoopbackClient.h>
+#include <MQTTBroker.h>
+#include <PubSubClient.h>
+
+#include <algorithm>
+
+// MQTT 3.1.1 control packet types, the high nibble of the first byte
+static const uint8_t PACKET_CONNECT = 0x10;
+static const uint8_t PACKET_CONNACK = 0x20;
+static const uint8_t PACKET_PUBLISH = 0x30;
+static const uint8_t PACKET_SUBSCRIBE = 0x80;
+static const uint8_t PACKET_SUBACK = 0x90;
+static const uint8_t PACKET_PINGREQ = 0xC0;
+static const uint8_t PACKET_PINGRESP = 0xD0;
+static const uint8_t PACKET_DISCONNECT = 0xE0;
+
+// Reads the fields of a packet body front to back
+struct PacketReader {
+  const std::string &body;
+  size_t pos;
+
+  uint8_t byte() { return pos < body.size() ? body[pos++] : 0; }
+  uint16_t u16() {
+    uint16_t high = byte();
+    return (high << 8) | byte();
+  }
+  std::string string() {
+    size_t len = u16();
+    std::string value = body.substr(std::min(pos, body.size()), len);
+    pos += len;
+    return value;
+  }
+  std::string rest() { return pos < body.size() ? body.substr(pos) : ""; }
+  bool done() const { return pos >= body.size(); }
+};
+
+static void appendString(std::string *out, const std::string &value) {
+  out->push_back(static_cast<char>(value.size() >> 8));
+  out->push_back(static_cast<char>(value.size() & 0xFF));
+  out->append(value);
+}
+
+LoopbackClient::~LoopbackClient() { stop(); }
+
+int LoopbackClient::connect(IPAddress ip, uint16_t port) {
+  stop();
+  open_ = true;
+  return 1;
+}
+
+int LoopbackClient::connect(const char *host, uint16_t port) {
+  return connect(IPAddress(127, 0, 0, 1), port);
+}
+
+size_t LoopbackClient::write(const uint8_t *buf, size_t size) {
+  if (!connected()) {
+    return 0;
+  }
+  outbound_.append(reinterpret_cast<const char *>(buf), size);
+
+  // Fixed header: type and flags, then the remaining length as a varint
+  while (outbound_.size() >= 2) {
+    size_t length = 0;
+    size_t pos = 1;
+    int shift = 0;
+    uint8_t digit;
+    do {
+      if (pos >= outbound_.size()) {
+        return size;
+      }
+      digit = outbound_[pos++];
+      length |= static_cast<size_t>(digit & 0x7F) << shift;
+      shift += 7;
+    } while (digit & 0x80);
+    if (outbound_.size() < pos + length) {
+      return size;
+    }
+    uint8_t header = outbound_[0];
+    std::string body = outbound_.substr(pos, length);
+    outbound_.erase(0, pos + length);
+    handlePacket(header, body);
+  }
+  return size;
+}
+
+int LoopbackClient::read() {
+  if (inbound_.empty()) {
+    return -1;
+  }
+  uint8_t b = inbound_.front();
+  inbound_.pop_front();
+  return b;
+}
+
+int LoopbackClient::read(uint8_t *buf, size_t size) {
+  if (inbound_.empty()) {
+    return -1;
+  }
+  size_t n = std::min(size, inbound_.size());
+  std::copy(inbound_.begin(), inbound_.begin() + n, buf);
+  inbound_.erase(inbound_.begin(), inbound_.begin() + n);
+  return n;
+}
+
+int LoopbackClient::peek() {
+  return inbound_.empty() ? -1 : inbound_.front();
+}
+
+void LoopbackClient::stop() {
+  if (broker_ && session_) {
+    broker_->close(this);
+  }
+  open_ = false;
+  session_ = false;
+  outbound_.clear();
+  inbound_.clear();
+}
+
+// A session the broker dropped reads as a closed socket
+uint8_t LoopbackClient::connected() {
+  return open_ && (!session_ || !broker_ || broker_->isConnected(this));
+}
+
+void LoopbackClient::deliver(const std::string &topic,
+                             const std::string &payload, bool retained) {
+  std::string body;
+  appendString(&body, topic);
+  body += payload;
+  send(PACKET_PUBLISH | (retained ? 1 : 0), body);
+}
+
+void LoopbackClient::handlePacket(uint8_t header, const std::string &body) {
+  PacketReader reader = {body, 0};
+
+  switch (header & 0xF0) {
+    case PACKET_CONNECT: {
+      reader.string();  // protocol name
+      reader.byte();    // protocol level
+      uint8_t flags = reader.byte();
+      reader.u16();  // keep alive
+      std::string id = reader.string();
+      if (flags & 0x04) {
+        reader.string();  // will topic
+        reader.string();  // will message
+      }
+      std::string username = flags & 0x80 ? reader.string() : "";
+      std::string password = flags & 0x40 ? reader.string() : "";
+
+      int returnCode = broker_ ? broker_->connect(this, id.c_str(),
+                                                  username.c_str(),
+                                                  password.c_str())
+                               : MQTT_CONNECTED;
+      session_ = returnCode == MQTT_CONNECTED;
+      send(PACKET_CONNACK, std::string{0, static_cast<char>(returnCode)});
+      break;
+    }
+    case PACKET_PUBLISH: {
+      // PubSubClient only publishes at QoS 0, so there is no packet id
+      std::string topic = reader.string();
+      std::string payload = reader.rest();
+      bool retained = header & 0x01;
+      published.push_back({topic, payload, retained});
+      if (broker_) {
+        broker_->publish(this, topic, payload, retained);
+      }
+      break;
+    }
+    case PACKET_SUBSCRIBE: {
+      uint16_t packetId = reader.u16();
+      std::vector<std::string> filters;
+      std::string granted;
+      while (!reader.done()) {
+        filters.push_back(reader.string());
+        reader.byte();  // requested QoS
+        granted.push_back(0);
+      }
+      // The SUBACK goes out before any retained message
+      send(PACKET_SUBACK, std::string{static_cast<char>(packetId >> 8),
+                                      static_cast<char>(packetId & 0xFF)} +
+                              granted);
+      for (const std::string &filter : filters) {
+        if (broker_) {
+          broker_->subscribe(this, filter);
+        }
+      }
+      break;
+    }
+    case PACKET_PINGREQ:
+      send(PACKET_PINGRESP, "");
+      break;
+    case PACKET_DISCONNECT:
+      if (broker_ && session_) {
+        broker_->close(this);
+      }
+      session_ = false;
+      break;
+  }
+}
+
+void LoopbackClient::send(uint8_t header, const std::string &body) {
+  inbound_.push_back(header);
+  size_t length = body.size();
+  do {
+    uint8_t digit = length & 0x7F;
+    length >>= 7;
+    inbound_.push_back(length > 0 ? digit | 0x80 : digit);
+  } while (length > 0);
+  inbound_.insert(inbound_.end(), body.begin(), body.end());
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_LOOPBACKCLIENT_H_
+#define TEST_NATIVE_GARGE_SHIMS_LOOPBACKCLIENT_H_
+
+#include <Client.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+class MQTTBroker;
+
+// The connection under the real PubSubClient on the host. The MQTT packets
+// the client writes are decoded and handed to the MQTTBroker attached with
+// setBroker(), and the broker's CONNACK, SUBACK and PUBLISH packets are
+// encoded into what the client reads next, so they reach the callback from
+// loop() as they do on the device. Without a broker it answers as one that
+// accepts everything. Either way it records what was published.
+class LoopbackClient : public Client {
+ public:
+  struct Message {
+    std::string topic;
+    std::string payload;
+    bool retained;
+  };
+
+  ~LoopbackClient() override;
+
+  void setBroker(MQTTBroker *broker) { broker_ = broker; }
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override { return inbound_.size(); }
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+  // Broker side: queues a PUBLISH for the client to read.
+  void deliver(const std::string &topic, const std::string &payload,
+               bool retained);
+
+  std::vector<Message> published;
+
+ private:
+  void handlePacket(uint8_t header, const std::string &body);
+  void send(uint8_t header, const std::string &body);
+
+  MQTTBroker *broker_ = nullptr;
+  // Bytes written since the last whole packet
+  std::string outbound_;
+  std::deque<uint8_t> inbound_;
+  bool open_ = false;
+  bool session_ = false;
+};
+
+// The connection under mqttClient, see NativeMain.cpp
+extern LoopbackClient *mqttLink;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_LOOPBACKCLIENT_H_
@@ -0,0 +1,154 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <Arduino.h>
+#include <LoopbackClient.h>
+#include <MQTTBroker.h>
+#include <PubSubClient.h>
+
+void MQTTBroker::setCredentials(const std::string &username,
+                                const std::string &password) {
+  username_ = username;
+  password_ = password;
+}
+
+void MQTTBroker::refuseConnects(uint32_t count, int returnCode) {
+  refuseCount_ = count;
+  refuseCode_ = returnCode;
+}
+
+void MQTTBroker::disconnectAll() { sessions_.clear(); }
+
+void MQTTBroker::disconnect(const std::string &clientId) {
+  for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+    if (it->second.clientId == clientId) {
+      sessions_.erase(it);
+      return;
+    }
+  }
+}
+
+size_t MQTTBroker::retainedBytes() const {
+  size_t bytes = 0;
+  for (const auto &message : retained_) {
+    bytes += message.first.size() + message.second.size();
+  }
+  return bytes;
+}
+
+int MQTTBroker::connect(LoopbackClient *client, const char *id,
+                        const char *username, const char *password) {
+  shim::advanceMillis(latencyMs_);
+
+  if (refuseCount_ > 0) {
+    refuseCount_--;
+    stats.refused++;
+    return refuseCode_;
+  }
+  if (!username_.empty() &&
+      (username_ != username || password_ != password)) {
+    stats.refused++;
+    return MQTT_CONNECT_BAD_CREDENTIALS;
+  }
+  uint32_t &accepted = connectsPerSecond_[millis() / 1000];
+  if (connectRate_ > 0 && accepted >= connectRate_) {
+    stats.refused++;
+    return MQTT_CONNECT_UNAVAILABLE;
+  }
+  accepted++;
+
+  // A second connection with the same client id takes the session over
+  for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+    if (it->first != client && it->second.clientId == id) {
+      sessions_.erase(it);
+      stats.takeovers++;
+      break;
+    }
+  }
+
+  // Clean session: subscriptions do not survive a reconnect
+  sessions_[client] = Session{id, {}};
+  stats.connects++;
+  return MQTT_CONNECTED;
+}
+
+void MQTTBroker::close(LoopbackClient *client) { sessions_.erase(client); }
+
+bool MQTTBroker::isConnected(const LoopbackClient *client) const {
+  return sessions_.count(const_cast<LoopbackClient *>(client)) > 0;
+}
+
+void MQTTBroker::publish(LoopbackClient *client, const std::string &topic,
+                         const std::string &payload, bool retained) {
+  shim::advanceMillis(latencyMs_);
+  stats.publishes++;
+  stats.bytesIn += topic.size() + payload.size();
+
+  if (retained) {
+    if (payload.empty()) {
+      retained_.erase(topic);
+    } else {
+      retained_[topic] = payload;
+    }
+  }
+
+  for (auto &session : sessions_) {
+    for (const auto &filter : session.second.filters) {
+      if (topicMatches(filter, topic)) {
+        session.first->deliver(topic, payload, false);
+        stats.delivered++;
+        stats.bytesOut += topic.size() + payload.size();
+        break;
+      }
+    }
+  }
+}
+
+void MQTTBroker::subscribe(LoopbackClient *client,
+                           const std::string &filter) {
+  shim::advanceMillis(latencyMs_);
+
+  auto it = sessions_.find(client);
+  if (it == sessions_.end()) {
+    return;
+  }
+  it->second.filters.push_back(filter);
+
+  for (const auto &message : retained_) {
+    if (topicMatches(filter, message.first)) {
+      client->deliver(message.first, message.second, true);
+      stats.delivered++;
+      stats.bytesOut += message.first.size() + message.second.size();
+    }
+  }
+}
+
+bool MQTTBroker::topicMatches(const std::string &filter,
+                              const std::string &topic) {
+  size_t f = 0;
+  size_t t = 0;
+  while (f <= filter.size()) {
+    size_t filterEnd = filter.find('/', f);
+    if (filterEnd == std::string::npos) {
+      filterEnd = filter.size();
+    }
+    std::string level = filter.substr(f, filterEnd - f);
+    if (level == "#") {
+      return true;
+    }
+    if (t > topic.size()) {
+      return false;
+    }
+
+    size_t topicEnd = topic.find('/', t);
+    if (topicEnd == std::string::npos) {
+      topicEnd = topic.size();
+    }
+    if (level != "+" && level != topic.substr(t, topicEnd - t)) {
+      return false;
+    }
+
+    f = filterEnd + 1;
+    t = topicEnd + 1;
+  }
+  return t > topic.size();
+}
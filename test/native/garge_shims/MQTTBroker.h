@@ -0,0 +1,96 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_MQTTBROKER_H_
+#define TEST_NATIVE_GARGE_SHIMS_MQTTBROKER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class LoopbackClient;
+
+// In-process stand-in for the MQTT 3.1.1 broker. It follows the broker side
+// of the protocol at the message level: CONNACK return codes, client id
+// takeover, retained messages (an empty payload clears them), + and #
+// wildcards, and delivery to subscribers on their next loop(). Faults are
+// injected on demand, and latency is charged to the shim clock so that timings
+// measured with millis() are deterministic.
+class MQTTBroker {
+ public:
+  struct Stats {
+    uint32_t connects = 0;
+    uint32_t refused = 0;
+    uint32_t takeovers = 0;
+    uint32_t publishes = 0;
+    uint32_t delivered = 0;
+    size_t bytesIn = 0;
+    size_t bytesOut = 0;
+  };
+
+  // Connects are refused with 4 (bad credentials) unless they match. An empty
+  // username accepts everyone, which is the default.
+  void setCredentials(const std::string &username,
+                      const std::string &password);
+
+  // Charged once per client packet: connect, publish and subscribe.
+  void setLatency(uint32_t ms) { latencyMs_ = ms; }
+
+  // Refuses the next count connects with the given CONNACK return code.
+  void refuseConnects(uint32_t count, int returnCode);
+
+  // Accepts at most perSecond connects per second of shim time and refuses
+  // the rest with 3 (server unavailable), like an overloaded broker. 0 lifts
+  // the limit.
+  void setConnectRate(uint32_t perSecond) { connectRate_ = perSecond; }
+
+  // Drops every session, as a broker restart or a lost link would.
+  void disconnectAll();
+  void disconnect(const std::string &clientId);
+
+  const std::map<std::string, std::string> &retained() const {
+    return retained_;
+  }
+  size_t retainedBytes() const;
+  const std::map<uint32_t, uint32_t> &connectsPerSecond() const {
+    return connectsPerSecond_;
+  }
+  size_t sessionCount() const { return sessions_.size(); }
+  void clearRetained() { retained_.clear(); }
+
+  Stats stats;
+
+  // Broker side of LoopbackClient, one call per packet it decodes.
+  int connect(LoopbackClient *client, const char *id, const char *username,
+              const char *password);
+  void close(LoopbackClient *client);
+  bool isConnected(const LoopbackClient *client) const;
+  void publish(LoopbackClient *client, const std::string &topic,
+               const std::string &payload, bool retained);
+  void subscribe(LoopbackClient *client, const std::string &filter);
+
+  static bool topicMatches(const std::string &filter,
+                           const std::string &topic);
+
+ private:
+  struct Session {
+    std::string clientId;
+    std::vector<std::string> filters;
+  };
+
+  std::map<LoopbackClient *, Session> sessions_;
+  std::map<std::string, std::string> retained_;
+  std::string username_;
+  std::string password_;
+  uint32_t latencyMs_ = 0;
+  uint32_t refuseCount_ = 0;
+  int refuseCode_ = 0;
+  uint32_t connectRate_ = 0;
+  // Accepted connects per second of shim time. Keyed by second rather than
+  // kept as a window, since the fleet simulator runs devices on their own
+  // timelines and the clock can step back between them.
+  std::map<uint32_t, uint32_t> connectsPerSecond_;
+};
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_MQTTBROKER_H_
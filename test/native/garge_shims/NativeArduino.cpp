@@ -0,0 +1,122 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <esp_partition.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+EEPROMClass EEPROM;
+LittleFSClass LittleFS;
+TwoWire Wire;
+
+static uint64_t clockMicros = 0;
+static bool serialEnabled = true;
+static bool psramAvailable = true;
+static std::map<uint8_t, uint16_t> analogValues;
+static std::map<uint8_t, uint32_t> analogMilliVolts;
+static esp_sleep_wakeup_cause_t wakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static uint64_t sleepDurationUs = 0;
+static std::mt19937 rng(12345);
+
+namespace shim {
+
+uint64_t nowMicros() { return clockMicros; }
+
+void advanceMillis(uint32_t ms) { clockMicros += ms * 1000ULL; }
+
+void setMicros(uint64_t us) { clockMicros = us; }
+
+void setAnalogValue(uint8_t pin, uint16_t value) { analogValues[pin] = value; }
+
+void setAnalogMilliVolts(uint8_t pin, uint32_t millivolts) {
+  analogMilliVolts[pin] = millivolts;
+}
+
+void setSerialEnabled(bool enabled) { serialEnabled = enabled; }
+
+void setPsramFound(bool found) { psramAvailable = found; }
+
+void setWakeupCause(esp_sleep_wakeup_cause_t cause) { wakeupCause = cause; }
+
+NvsStore &nvs() {
+  static NvsStore store;
+  return store;
+}
+
+}  // namespace shim
+
+uint32_t millis() { return clockMicros / 1000; }
+
+uint32_t micros() { return clockMicros; }
+
+void delay(uint32_t ms) { shim::advanceMillis(ms); }
+
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+int digitalRead(uint8_t pin) { return HIGH; }
+
+uint16_t analogRead(uint8_t pin) { return analogValues[pin]; }
+
+uint32_t analogReadMilliVolts(uint8_t pin) { return analogMilliVolts[pin]; }
+
+void analogReadResolution(uint8_t bits) {}
+
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation) {}
+
+uint32_t esp_random() { return rng(); }
+
+bool psramFound() { return psramAvailable; }
+
+void *ps_malloc(size_t size) { return psramAvailable ? malloc(size) : nullptr; }
+
+size_t HardwareSerial::write(uint8_t b) {
+  if (serialEnabled) {
+    fputc(b, stdout);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t size) {
+  if (serialEnabled) {
+    fwrite(buf, 1, size, stdout);
+  }
+  return size;
+}
+
+int64_t esp_timer_get_time() { return clockMicros; }
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return wakeupCause; }
+
+int esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+  sleepDurationUs = timeUs;
+  return 0;
+}
+
+void esp_deep_sleep_start() { throw shim::DeepSleep{sleepDurationUs}; }
+
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             size_t src_offset, void *dst, size_t size) {
+  if (src_offset + size > partition->size ||
+      src_offset + size > partition->contents.size()) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(dst, partition->contents.data() + src_offset, size);
+  return ESP_OK;
+}
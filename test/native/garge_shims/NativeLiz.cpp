@@ -0,0 +1,34 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <liz.h>
+
+#include <map>
+
+static std::vector<liz::Device> discoveredDevices;
+static std::map<std::string, bool> pilotStates;
+
+namespace liz {
+
+std::vector<Device> &getDiscoveredDevices() { return discoveredDevices; }
+
+void clearDiscoveredDevices() { discoveredDevices.clear(); }
+
+std::vector<Device> discover(int port, int timeoutMs) {
+  return discoveredDevices;
+}
+
+bool setPilot(const char *ip, int port, bool state) {
+  pilotStates[ip] = state;
+  return true;
+}
+
+std::optional<std::string> getPilot(const char *ip, int port) {
+  auto it = pilotStates.find(ip);
+  if (it == pilotStates.end()) {
+    return std::nullopt;
+  }
+  return std::string("{\"result\":{\"state\":") +
+         (it->second ? "true" : "false") + "}}";
+}
+
+}  // namespace liz
@@ -0,0 +1,31 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// Stand-in for the globals main.cpp defines on the device.
+
+#include <LoopbackClient.h>
+
+#include "controllers/SensorController.h"
+#include "controllers/VoltmeterController.h"
+#include "helpers/EEPROMHelper.h"
+#include "helpers/MQTTHelper.h"
+
+const char *MQTT_BROKER = "localhost";
+const int MQTT_PORT = 8883;
+const int port = 38899;
+const int EEPROM_PASSWORD_START = 0;
+const int EEPROM_PASSWORD_END = 127;
+const int EEPROM_SSID_START = 128;
+const int EEPROM_SSID_END = 255;
+
+volatile bool OTA_IN_PROGRESS = false;
+String CHIP_ID = "b43a4536a89c";
+String EEPROM_MQTT_USERNAME = "native";
+String EEPROM_MQTT_PASSWORD = "native";
+
+// There is no TLS on the host, MQTT goes over a loopback to MQTTBroker
+TLSClient *secureClient = new TLSClient();
+LoopbackClient *mqttLink = new LoopbackClient();
+PubSubClient *mqttClient = new PubSubClient(*mqttLink);
+PRINTHelper printHelper(nullptr);
+
+void checkSerialForCredentials() {}
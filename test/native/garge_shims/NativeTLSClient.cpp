@@ -0,0 +1,56 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#include <cstring>
+
+#include "helpers/TLSClient.h"
+
+// The native build has no sockets or mbedTLS: the client "connects" to
+// anything, swallows writes and never has data to read. MQTT does not go
+// through it, see LoopbackClient.
+
+TLSClient::TLSClient() {}
+
+TLSClient::~TLSClient() {}
+
+int TLSClient::connect(IPAddress ip, uint16_t port) {
+  active = true;
+  return 1;
+}
+
+int TLSClient::connect(const char *host, uint16_t port) {
+  active = true;
+  return 1;
+}
+
+size_t TLSClient::write(uint8_t b) { return write(&b, 1); }
+
+size_t TLSClient::write(const uint8_t *buf, size_t size) {
+  return active ? size : 0;
+}
+
+int TLSClient::available() { return 0; }
+
+int TLSClient::read() { return -1; }
+
+int TLSClient::read(uint8_t *buf, size_t size) { return -1; }
+
+int TLSClient::peek() { return -1; }
+
+void TLSClient::stop() { active = false; }
+
+uint8_t TLSClient::connected() { return active; }
+
+void TLSClient::setHandshakeTimeout(uint32_t seconds) {
+  handshakeTimeoutMs = seconds * 1000;
+}
+
+int TLSClient::lastError(char *buf, size_t size) {
+  if (buf && size > 0) {
+    buf[0] = '\0';
+  }
+  return lastErr;
+}
+
+uint32_t TLSClient::getResumptionHits() { return 0; }
+
+uint32_t TLSClient::getResumptionMisses() { return 0; }
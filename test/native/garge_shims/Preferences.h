@@ -0,0 +1,104 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_PREFERENCES_H_
+#define TEST_NATIVE_GARGE_SHIMS_PREFERENCES_H_
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+
+namespace shim {
+// NVS contents by namespace, shared by all Preferences objects
+typedef std::map<std::string, std::map<std::string, std::string>> NvsStore;
+NvsStore &nvs();
+}  // namespace shim
+
+class Preferences {
+ public:
+  bool begin(const char *name, bool readOnly = false) {
+    ns_ = name;
+    readOnly_ = readOnly;
+    open_ = true;
+    return true;
+  }
+  void end() { open_ = false; }
+  bool clear() {
+    shim::nvs().erase(ns_);
+    return open_ && !readOnly_;
+  }
+  bool remove(const char *key) { return entries().erase(key) > 0; }
+  bool isKey(const char *key) { return entries().count(key) > 0; }
+
+  size_t putString(const char *key, const String &value) {
+    return put(key, std::string(value.c_str()));
+  }
+  String getString(const char *key, const String &defaultValue = String()) {
+    auto it = entries().find(key);
+    return it == entries().end() ? defaultValue : String(it->second);
+  }
+  size_t putBytes(const char *key, const void *value, size_t length) {
+    return put(key, std::string(static_cast<const char *>(value), length));
+  }
+  size_t getBytes(const char *key, void *buf, size_t maxLength) {
+    auto it = entries().find(key);
+    if (it == entries().end() || it->second.size() > maxLength) {
+      return 0;
+    }
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+
+  size_t putUChar(const char *key, uint8_t value) {
+    return putValue(key, value);
+  }
+  uint8_t getUChar(const char *key, uint8_t defaultValue = 0) {
+    return getValue(key, defaultValue);
+  }
+  size_t putBool(const char *key, bool value) { return putValue(key, value); }
+  bool getBool(const char *key, bool defaultValue = false) {
+    return getValue(key, defaultValue);
+  }
+  size_t putInt(const char *key, int32_t value) { return putValue(key, value); }
+  int32_t getInt(const char *key, int32_t defaultValue = 0) {
+    return getValue(key, defaultValue);
+  }
+  size_t putUInt(const char *key, uint32_t value) {
+    return putValue(key, value);
+  }
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0) {
+    return getValue(key, defaultValue);
+  }
+
+ private:
+  std::string ns_;
+  bool readOnly_ = false;
+  bool open_ = false;
+
+  std::map<std::string, std::string> &entries() { return shim::nvs()[ns_]; }
+
+  size_t put(const char *key, const std::string &value) {
+    if (!open_ || readOnly_) {
+      return 0;
+    }
+    entries()[key] = value;
+    return value.size();
+  }
+  template <typename T>
+  size_t putValue(const char *key, T value) {
+    return put(key, std::string(reinterpret_cast<const char *>(&value),
+                                sizeof(value)));
+  }
+  template <typename T>
+  T getValue(const char *key, T defaultValue) {
+    auto it = entries().find(key);
+    if (it == entries().end() || it->second.size() != sizeof(T)) {
+      return defaultValue;
+    }
+    T value;
+    memcpy(&value, it->second.data(), sizeof(T));
+    return value;
+  }
+};
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_PREFERENCES_H_
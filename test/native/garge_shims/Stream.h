@@ -0,0 +1,15 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_STREAM_H_
+#define TEST_NATIVE_GARGE_SHIMS_STREAM_H_
+
+#include <Arduino.h>
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_STREAM_H_
@@ -0,0 +1,180 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_WSTRING_H_
+#define TEST_NATIVE_GARGE_SHIMS_WSTRING_H_
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+// Arduino String on top of std::string, covering what the firmware uses.
+class String {
+ public:
+  String() = default;
+  String(const char *s) : s_(s ? s : "") {}  // NOLINT(runtime/explicit)
+  String(const std::string &s) : s_(s) {}   // NOLINT(runtime/explicit)
+  explicit String(char c) : s_(1, c) {}
+  explicit String(int v) : s_(std::to_string(v)) {}
+  explicit String(unsigned int v) : s_(std::to_string(v)) {}
+  explicit String(long v) : s_(std::to_string(v)) {}            // NOLINT
+  explicit String(unsigned long v) : s_(std::to_string(v)) {}   // NOLINT
+  explicit String(float v, unsigned int decimals = 2) {
+    fromDouble(v, decimals);
+  }
+  explicit String(double v, unsigned int decimals = 2) {
+    fromDouble(v, decimals);
+  }
+
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.length(); }
+  bool isEmpty() const { return s_.empty(); }
+  bool reserve(unsigned int size) {
+    s_.reserve(size);
+    return true;
+  }
+
+  bool concat(const String &s) {
+    s_ += s.s_;
+    return true;
+  }
+  bool concat(const char *s) {
+    s_ += s ? s : "";
+    return true;
+  }
+  bool concat(const char *s, unsigned int length) {
+    s_.append(s, length);
+    return true;
+  }
+  bool concat(char c) {
+    s_ += c;
+    return true;
+  }
+  String &operator+=(const String &s) {
+    s_ += s.s_;
+    return *this;
+  }
+  String &operator+=(const char *s) {
+    concat(s);
+    return *this;
+  }
+  String &operator+=(char c) {
+    s_ += c;
+    return *this;
+  }
+  String &operator+=(int v) {
+    s_ += std::to_string(v);
+    return *this;
+  }
+
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char &operator[](unsigned int i) { return s_[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  char *begin() { return &s_[0]; }
+  char *end() { return &s_[0] + s_.size(); }
+  const char *begin() const { return s_.data(); }
+  const char *end() const { return s_.data() + s_.size(); }
+
+  bool equals(const String &s) const { return s_ == s.s_; }
+  bool operator==(const String &s) const { return s_ == s.s_; }
+  bool operator==(const char *s) const { return s_ == (s ? s : ""); }
+  bool operator!=(const String &s) const { return s_ != s.s_; }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  bool operator<(const String &s) const { return s_ < s.s_; }
+
+  String substring(unsigned int from) const {
+    return from < s_.size() ? String(s_.substr(from)) : String();
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+      std::swap(from, to);
+    }
+    if (from >= s_.size()) {
+      return String();
+    }
+    return String(s_.substr(from, to - from));
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    return toIndex(s_.find(c, from));
+  }
+  int indexOf(const String &s, unsigned int from = 0) const {
+    return toIndex(s_.find(s.s_, from));
+  }
+  int lastIndexOf(char c) const { return toIndex(s_.rfind(c)); }
+  bool startsWith(const String &s) const {
+    return s_.compare(0, s.s_.size(), s.s_) == 0;
+  }
+  bool endsWith(const String &s) const {
+    return s_.size() >= s.s_.size() &&
+           s_.compare(s_.size() - s.s_.size(), s.s_.size(), s.s_) == 0;
+  }
+  long toInt() const { return std::strtol(s_.c_str(), nullptr, 10); }  // NOLINT
+  float toFloat() const { return std::strtof(s_.c_str(), nullptr); }
+  void toLowerCase() {
+    for (char &c : s_) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+  }
+  void toUpperCase() {
+    for (char &c : s_) {
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+  }
+  void trim() {
+    size_t first = s_.find_first_not_of(" \t\r\n");
+    size_t last = s_.find_last_not_of(" \t\r\n");
+    s_ = first == std::string::npos ? "" : s_.substr(first, last - first + 1);
+  }
+  void replace(const String &from, const String &to) {
+    if (from.s_.empty()) {
+      return;
+    }
+    for (size_t pos = 0; (pos = s_.find(from.s_, pos)) != std::string::npos;
+         pos += to.s_.size()) {
+      s_.replace(pos, from.s_.size(), to.s_);
+    }
+  }
+
+ private:
+  std::string s_;
+
+  static int toIndex(size_t pos) {
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+  }
+  void fromDouble(double v, unsigned int decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", static_cast<int>(decimals), v);
+    s_ = buf;
+  }
+};
+
+// ArduinoJson adapts this type as well as String
+class StringSumHelper : public String {
+ public:
+  using String::String;
+};
+
+inline String operator+(const String &lhs, const String &rhs) {
+  String out(lhs);
+  out += rhs;
+  return out;
+}
+inline String operator+(const String &lhs, const char *rhs) {
+  String out(lhs);
+  out += rhs;
+  return out;
+}
+inline String operator+(const char *lhs, const String &rhs) {
+  String out(lhs);
+  out += rhs;
+  return out;
+}
+inline String operator+(const String &lhs, char rhs) {
+  String out(lhs);
+  out += rhs;
+  return out;
+}
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_WSTRING_H_
@@ -0,0 +1,37 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_WIFI_H_
+#define TEST_NATIVE_GARGE_SHIMS_WIFI_H_
+
+#include <Arduino.h>
+
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+};
+
+// Station state only; the tests set it directly instead of associating.
+class WiFiClass {
+ public:
+  wl_status_t status() { return status_; }
+  int8_t RSSI() { return rssi_; }
+  IPAddress localIP() { return localIP_; }
+  String macAddress() { return String("B4:3A:45:36:A8:9C"); }
+  void disconnect() { status_ = WL_DISCONNECTED; }
+
+  void setStatus(wl_status_t status) { status_ = status; }
+  void setRSSI(int8_t rssi) { rssi_ = rssi; }
+  void setLocalIP(IPAddress ip) { localIP_ = ip; }
+
+ private:
+  wl_status_t status_ = WL_CONNECTED;
+  int8_t rssi_ = -60;
+  IPAddress localIP_ = IPAddress(192, 168, 1, 50);
+};
+
+extern WiFiClass WiFi;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_WIFI_H_
@@ -0,0 +1,117 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_WIRE_H_
+#define TEST_NATIVE_GARGE_SHIMS_WIRE_H_
+
+#include <Arduino.h>
+
+#include <map>
+#include <vector>
+
+// A bus of register-file devices. Tests attach a device by filling in its
+// registers, e.g. Wire.devices[0x76][0xD0] = 0x60; an address with no entry
+// does not acknowledge. A write sets the register pointer with its first byte
+// and stores the rest from there on.
+//
+// Devices in channels sit behind a TCA9548A at muxAddress, which answers once
+// any channel is populated; the byte written to it selects channels by bit.
+class TwoWire {
+ public:
+  typedef std::map<uint8_t, uint8_t> Registers;
+  typedef std::map<uint8_t, Registers> Bus;
+
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) {
+    return true;
+  }
+
+  void beginTransmission(uint8_t address) {
+    address_ = address;
+    pending_.clear();
+  }
+  size_t write(uint8_t value) {
+    pending_.push_back(value);
+    return 1;
+  }
+  // 0 on success, 2 when the address is not acknowledged
+  uint8_t endTransmission(bool sendStop = true) {
+    transactions++;
+    busTime(1 + pending_.size());
+    if (isMux(address_)) {
+      if (!pending_.empty()) {
+        selected_ = pending_[0];
+      }
+      return 0;
+    }
+    Registers *device = find(address_);
+    if (device == nullptr) {
+      return 2;
+    }
+    for (size_t i = 0; i < pending_.size(); i++) {
+      if (i == 0) {
+        register_ = pending_[0];
+      } else {
+        (*device)[static_cast<uint8_t>(register_ + i - 1)] = pending_[i];
+      }
+    }
+    return 0;
+  }
+  uint8_t requestFrom(uint8_t address, uint8_t length) {
+    transactions++;
+    address_ = address;
+    available_ = isMux(address) || find(address) ? length : 0;
+    busTime(1 + available_);
+    return available_;
+  }
+  int available() { return available_; }
+  int read() {
+    if (available_ == 0) {
+      return -1;
+    }
+    available_--;
+    if (isMux(address_)) {
+      return selected_;
+    }
+    return (*find(address_))[register_++];
+  }
+
+  Bus devices;
+  std::map<uint8_t, Bus> channels;
+  uint8_t muxAddress = 0x70;
+  // Transactions since the test last cleared it
+  uint32_t transactions = 0;
+  // Shim time per byte on the wire including the address byte, 90 at
+  // 100 kHz; 0 keeps the bus instant
+  uint32_t byteMicros = 0;
+
+  // Spends the time of bytes on the wire, for shims of drivers whose reads
+  // do not go through the registers here
+  void busTime(size_t bytes) {
+    shim::setMicros(shim::nowMicros() + bytes * byteMicros);
+  }
+
+ private:
+  bool isMux(uint8_t address) {
+    return address == muxAddress && !channels.empty();
+  }
+  Registers *find(uint8_t address) {
+    if (devices.count(address)) {
+      return &devices[address];
+    }
+    for (auto &channel : channels) {
+      if ((selected_ & (1 << channel.first)) &&
+          channel.second.count(address)) {
+        return &channel.second[address];
+      }
+    }
+    return nullptr;
+  }
+  uint8_t address_ = 0;
+  uint8_t register_ = 0;
+  uint8_t selected_ = 0;
+  std::vector<uint8_t> pending_;
+  uint8_t available_ = 0;
+};
+
+extern TwoWire Wire;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_WIRE_H_
@@ -0,0 +1,26 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_ESP_PARTITION_H_
+#define TEST_NATIVE_GARGE_SHIMS_ESP_PARTITION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_INVALID_SIZE 0x104
+
+// A flash partition backed by host memory; contents holds the image and size
+// is what the firmware sees
+struct esp_partition_t {
+  uint32_t address = 0;
+  uint32_t size = 0;
+  std::vector<uint8_t> contents;
+};
+
+// Fails like the real call when the read runs past the end of the partition
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             size_t src_offset, void *dst, size_t size);
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_ESP_PARTITION_H_
@@ -0,0 +1,31 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_ESP_SLEEP_H_
+#define TEST_NATIVE_GARGE_SHIMS_ESP_SLEEP_H_
+
+#include <cstdint>
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_EXT0 = 2,
+  ESP_SLEEP_WAKEUP_TIMER = 4,
+} esp_sleep_wakeup_cause_t;
+
+namespace shim {
+
+// Raised by esp_deep_sleep_start() instead of powering down. RTC_DATA_ATTR
+// variables are ordinary globals here, so they keep their values for the next
+// simulated wake just like RTC memory does.
+struct DeepSleep {
+  uint64_t durationUs;
+};
+
+void setWakeupCause(esp_sleep_wakeup_cause_t cause);
+
+}  // namespace shim
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+int esp_sleep_enable_timer_wakeup(uint64_t timeUs);
+[[noreturn]] void esp_deep_sleep_start();
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_ESP_SLEEP_H_
@@ -0,0 +1,11 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_ESP_TIMER_H_
+#define TEST_NATIVE_GARGE_SHIMS_ESP_TIMER_H_
+
+#include <cstdint>
+
+// Microseconds since boot, on the same simulated clock as millis()
+int64_t esp_timer_get_time();
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_ESP_TIMER_H_
@@ -0,0 +1,25 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_LIZ_H_
+#define TEST_NATIVE_GARGE_SHIMS_LIZ_H_
+
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// WiZ discovery and control without the network: devices are whatever the
+// test put in the discovered list, and pilots just remember their state.
+namespace liz {
+
+typedef std::tuple<std::string, std::string, std::string> Device;
+
+std::vector<Device> &getDiscoveredDevices();
+void clearDiscoveredDevices();
+std::vector<Device> discover(int port, int timeoutMs);
+bool setPilot(const char *ip, int port, bool state);
+std::optional<std::string> getPilot(const char *ip, int port);
+
+}  // namespace liz
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_LIZ_H_
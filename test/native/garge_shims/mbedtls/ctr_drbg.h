@@ -0,0 +1,10 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_MBEDTLS_CTR_DRBG_H_
+#define TEST_NATIVE_GARGE_SHIMS_MBEDTLS_CTR_DRBG_H_
+
+typedef struct mbedtls_ctr_drbg_context {
+  int unused;
+} mbedtls_ctr_drbg_context;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_MBEDTLS_CTR_DRBG_H_
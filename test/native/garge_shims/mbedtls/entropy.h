@@ -0,0 +1,10 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_MBEDTLS_ENTROPY_H_
+#define TEST_NATIVE_GARGE_SHIMS_MBEDTLS_ENTROPY_H_
+
+typedef struct mbedtls_entropy_context {
+  int unused;
+} mbedtls_entropy_context;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_MBEDTLS_ENTROPY_H_
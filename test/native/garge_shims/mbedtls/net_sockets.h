@@ -0,0 +1,10 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_MBEDTLS_NET_SOCKETS_H_
+#define TEST_NATIVE_GARGE_SHIMS_MBEDTLS_NET_SOCKETS_H_
+
+typedef struct mbedtls_net_context {
+  int unused;
+} mbedtls_net_context;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_MBEDTLS_NET_SOCKETS_H_
@@ -0,0 +1,16 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+#ifndef TEST_NATIVE_GARGE_SHIMS_MBEDTLS_SSL_H_
+#define TEST_NATIVE_GARGE_SHIMS_MBEDTLS_SSL_H_
+
+// Only the types TLSClient.h holds by value; the native TLSClient does not
+// use mbedTLS.
+typedef struct mbedtls_ssl_context {
+  int unused;
+} mbedtls_ssl_context;
+
+typedef struct mbedtls_ssl_config {
+  int unused;
+} mbedtls_ssl_config;
+
+#endif  // TEST_NATIVE_GARGE_SHIMS_MBEDTLS_SSL_H_
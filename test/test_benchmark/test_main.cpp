@@ -0,0 +1,300 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// Micro-benchmarks for the hot paths of a wake, run on the host with
+//   pio test -e native -v
+// Timings are host timings: compare runs against each other, not against the
+// device.
+
+#include <LoopbackClient.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "controllers/FilterChain.h"
+#include "controllers/SensorController.h"
+#include "controllers/VoltmeterController.h"
+#include "helpers/Base64Helper.h"
+#include "helpers/MQTTHelper.h"
+#include "helpers/OTAManifest.h"
+#include "helpers/ReadingCodec.h"
+#include "helpers/VoltageCalibration.h"
+
+static volatile uint32_t sink;
+
+template <typename F>
+static double benchmark(const char *name, uint32_t iterations, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++) {
+    body(i);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double ns =
+      std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+  printf("bench %-24s %10.1f ns/op (%u iterations)\n", name, ns, iterations);
+  return ns;
+}
+
+void setUp() {
+  shim::setSerialEnabled(false);
+  mqttClient->setBufferSize(1024);
+  mqttClient->connect(CHIP_ID.c_str(), "native", "native");
+  mqttLink->published.clear();
+}
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+void test_topic_building() {
+  benchmark("topic_state", 100000, [](uint32_t) {
+    sink += getSensorStateTopic(CHIP_ID, "temperature").length();
+  });
+  TEST_ASSERT_EQUAL_STRING(
+      "garge/devices/garge_b43a4536a89c/"
+      "garge_b43a4536a89c_temperature/state",
+      getSensorStateTopic(CHIP_ID, "temperature").c_str());
+}
+
+void test_json_serialization() {
+  char buffer[128];
+  benchmark("json_reading", 100000, [&](uint32_t i) {
+    DynamicJsonDocument doc(256);
+    doc["value"] = 21.5f + (i % 100) / 100.0f;
+    sink += serializeJson(doc, buffer);
+  });
+  DynamicJsonDocument doc(256);
+  doc["value"] = 12.5f;
+  serializeJson(doc, buffer);
+  TEST_ASSERT_EQUAL_STRING("{\"value\":12.5}", buffer);
+}
+
+void test_publish_path() {
+  benchmark("publish_state", 100000, [](uint32_t) {
+    if (mqttLink->published.size() >= 1000) {
+      mqttLink->published.clear();
+    }
+    publishGargeSensorState(CHIP_ID, "temperature",
+                            String("{\"value\":21.5}"));
+  });
+  TEST_ASSERT_FALSE(mqttLink->published.empty());
+  TEST_ASSERT_TRUE(mqttLink->published.back().retained);
+}
+
+void test_calibration_math() {
+  const float inputToVolts =
+      ANALOG_VOLTAGE / ANALOG_RESOLUTION * (R1 + R2) / R2;
+  buildCalibrationFromPowerLaw(a, b, inputToVolts);
+
+  double powfNs = benchmark("calibration_powf", 1000000, [&](uint32_t i) {
+    float vin = (i & 4095) * inputToVolts;
+    sink += static_cast<uint32_t>(1000.0f * a * powf(vin, b));
+  });
+  double lutNs = benchmark("calibration_lut", 1000000, [](uint32_t i) {
+    sink += calibratedMillivolts(i & 4095);
+  });
+  printf("bench calibration lut speedup %.1fx\n", powfNs / lutNs);
+
+  // The table must agree with the power law it was built from
+  for (uint32_t code = 1000; code < 4096; code += 97) {
+    float expected = 1000.0f * a * powf(code * inputToVolts, b);
+    TEST_ASSERT_FLOAT_WITHIN(40.0f, expected, calibratedMillivolts(code));
+  }
+}
+
+void test_filter_chain() {
+  float ring[READING_BUFFER] = {};
+  float total = 0;
+  int index = 0;
+  double ringNs = benchmark("filter_float_ring", 1000000, [&](uint32_t i) {
+    float sample = 20.0f + (i % 17) * 0.01f;
+    total -= ring[index];
+    ring[index] = sample;
+    total += sample;
+    index = (index + 1) % READING_BUFFER;
+    sink += static_cast<uint32_t>(total / READING_BUFFER);
+  });
+
+  SensorFilter filter(TEMP_FILTER_MIN_DEVIATION);
+  double chainNs = benchmark("filter_chain", 1000000, [&](uint32_t i) {
+    filter.add(20.0f + (i % 17) * 0.01f);
+    sink += static_cast<uint32_t>(filter.value());
+  });
+  printf("bench filter chain costs %.1fx the float ring\n", chainNs / ringNs);
+
+  // After a million updates the float running sum has drifted, the
+  // integer sum of the chain has not
+  for (int i = 0; i < READING_BUFFER; i++) {
+    total -= ring[index];
+    ring[index] = 20.0f;
+    total += 20.0f;
+    index = (index + 1) % READING_BUFFER;
+    filter.add(20.0f);
+  }
+  printf("bench filter drift: float ring %.6f, chain %.6f\n",
+         total / READING_BUFFER - 20.0f, filter.value() - 20.0f);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 20.0f, filter.value());
+  TEST_ASSERT_FALSE(filter.add(NAN));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 20.0f, filter.value());
+}
+
+void test_reading_codec() {
+  Reading readings[READING_BATCH_SIZE];
+  for (size_t i = 0; i < READING_BATCH_SIZE; i++) {
+    readings[i] = {1700000000 + static_cast<uint32_t>(i) * 60,
+                   20.0f + (i % 7) * 0.1f, READING_TEMPERATURE};
+  }
+  uint8_t out[READING_PAYLOAD_MAX];
+  benchmark("encode_batch", 10000, [&](uint32_t) {
+    sink += encodeReadings(readings, READING_BATCH_SIZE, out, sizeof(out));
+  });
+  TEST_ASSERT_GREATER_THAN(0, encodeReadings(readings, READING_BATCH_SIZE, out,
+                                             sizeof(out)));
+}
+
+// The decoder of scripts/decode_backfill.py, reading by reading
+struct DecodedReading {
+  uint8_t type;
+  uint32_t timestamp;
+  double value;
+};
+
+static std::vector<DecodedReading> decodeBackfill(const uint8_t *data,
+                                                  size_t len) {
+  size_t pos = 0;
+  auto varint = [&]() {
+    uint32_t result = 0;
+    for (int shift = 0; pos < len; shift += 7) {
+      uint8_t b = data[pos++];
+      result |= static_cast<uint32_t>(b & 0x7F) << shift;
+      if (b < 0x80) {
+        break;
+      }
+    }
+    return result;
+  };
+  auto zigzag = [&]() {
+    uint32_t v = varint();
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+  };
+
+  std::vector<DecodedReading> readings;
+  TEST_ASSERT_EQUAL(READING_CODEC_VERSION, data[pos++]);
+  while (pos < len) {
+    uint8_t type = data[pos++];
+    uint32_t count = varint();
+    uint32_t timestamp = varint();
+    int32_t value = zigzag();
+    int32_t delta = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      if (i > 0) {
+        delta += zigzag();
+        timestamp += delta;
+        value += zigzag();
+      }
+      readings.push_back({type, timestamp,
+                          static_cast<double>(value) /
+                              READING_FIXED_POINT_SCALE});
+    }
+  }
+  return readings;
+}
+
+// The JSON backfill payload the codec replaced:
+// {"temperature":[[timestamp,value],...],"humidity":[...]}
+static size_t jsonBackfillSize(const Reading *readings, size_t count) {
+  DynamicJsonDocument doc(16384);
+  for (size_t i = 0; i < count; i++) {
+    const char *type = readingTypeName(readings[i].type);
+    JsonArray series = doc[type].as<JsonArray>();
+    if (series.isNull()) {
+      series = doc.createNestedArray(type);
+    }
+    JsonArray entry = series.createNestedArray();
+    entry.add(readings[i].timestamp);
+    entry.add(readings[i].value);
+  }
+  String payload;
+  serializeJson(doc, payload);
+  return payload.length();
+}
+
+void test_reading_codec_round_trip() {
+  // A garage thawing out: pairs a minute apart as the sensor logs them, with
+  // a gap where a wake was missed and two voltage readings in the same batch
+  Reading readings[READING_BATCH_SIZE];
+  uint32_t timestamp = 1700000000;
+  for (size_t i = 0; i < READING_BATCH_SIZE - 2; i += 2) {
+    timestamp += i == 40 ? 600 : 60;
+    float jitter = (static_cast<int>(i % 3) - 1) * 0.01f;
+    readings[i] = {timestamp, -2.5f + i * 0.02f + jitter, READING_TEMPERATURE};
+    readings[i + 1] = {timestamp, 78.0f - i * 0.05f - jitter, READING_HUMIDITY};
+  }
+  readings[READING_BATCH_SIZE - 2] = {timestamp + 60, 12.61f, READING_VOLTAGE};
+  readings[READING_BATCH_SIZE - 1] = {timestamp + 120, 12.58f,
+                                      READING_VOLTAGE};
+
+  uint8_t out[READING_PAYLOAD_MAX];
+  size_t encoded =
+      encodeReadings(readings, READING_BATCH_SIZE, out, sizeof(out));
+  TEST_ASSERT_GREATER_THAN(0, encoded);
+
+  std::vector<DecodedReading> decoded = decodeBackfill(out, encoded);
+  TEST_ASSERT_EQUAL(READING_BATCH_SIZE, decoded.size());
+  // Grouped by type, in order within each type
+  size_t next = 0;
+  for (uint8_t type = READING_TEMPERATURE; type <= READING_VOLTAGE; type++) {
+    for (const Reading &reading : readings) {
+      if (reading.type != type) {
+        continue;
+      }
+      TEST_ASSERT_EQUAL(type, decoded[next].type);
+      TEST_ASSERT_EQUAL(reading.timestamp, decoded[next].timestamp);
+      TEST_ASSERT_FLOAT_WITHIN(0.0005, reading.value, decoded[next].value);
+      next++;
+    }
+  }
+
+  // 2-3 bytes a reading instead of ~20 bytes of JSON
+  size_t json = jsonBackfillSize(readings, READING_BATCH_SIZE);
+  printf("bench backfill: %u readings, %u bytes encoded, %u bytes JSON\n",
+         static_cast<unsigned>(READING_BATCH_SIZE),
+         static_cast<unsigned>(encoded), static_cast<unsigned>(json));
+  TEST_ASSERT_TRUE(encoded <= 3 * READING_BATCH_SIZE);
+  TEST_ASSERT_TRUE(json >= 5 * encoded);
+}
+
+void test_manifest_and_base64() {
+  String manifest =
+      "[{\"name\":\"garge_sensor_bme\",\"version\":\"v1.5.2\","
+      "\"bin_url\":\"https://example.com/a.bin\"},"
+      "{\"name\":\"garge_sensor_bme\",\"version\":\"v1.10.0\","
+      "\"bin_url\":\"https://example.com/b.bin\",\"rollout\":150}]";
+  OTARelease release;
+  benchmark("manifest_parse", 10000, [&](uint32_t) {
+    sink += parseManifest(manifest, "garge_sensor_bme", "v1.5.2", &release);
+  });
+  TEST_ASSERT_EQUAL_STRING("v1.10.0", release.version.c_str());
+  TEST_ASSERT_EQUAL(100, release.rollout);
+  TEST_ASSERT_TRUE(versionCompare("v1.10.0", "v1.9.9") > 0);
+
+  std::string encoded = base64_encode("mqtt-user:secret");
+  benchmark("base64_decode", 100000, [&](uint32_t) {
+    sink += base64_decode(encoded).size();
+  });
+  TEST_ASSERT_EQUAL_STRING("mqtt-user:secret", base64_decode(encoded).c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_topic_building);
+  RUN_TEST(test_json_serialization);
+  RUN_TEST(test_publish_path);
+  RUN_TEST(test_calibration_math);
+  RUN_TEST(test_filter_chain);
+  RUN_TEST(test_reading_codec);
+  RUN_TEST(test_reading_codec_round_trip);
+  RUN_TEST(test_manifest_and_base64);
+  return UNITY_END();
+}
@@ -0,0 +1,321 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// Several BME280s on one bus, directly and behind a TCA9548A: what is found,
+// what each one publishes, and what a sample cycle costs as sensors are added.
+//   pio test -e native -f test_bus -v
+
+#include <ArduinoJson.h>
+#include <LoopbackClient.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "controllers/Device.h"
+#include "controllers/SensorBusController.h"
+#include "helpers/MQTTHelper.h"
+#include "helpers/ReadingLog.h"
+
+static void attachDirect(uint8_t address) {
+  Wire.devices[address][BME280_CHIP_ID_REGISTER] = BME280_CHIP_ID;
+}
+
+static void attachBehindMux(uint8_t channel, uint8_t address) {
+  Wire.channels[channel][address][BME280_CHIP_ID_REGISTER] = BME280_CHIP_ID;
+}
+
+// Up to 16 sensors, both addresses on each channel
+static void attachSensors(size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    attachBehindMux(i / 2, i % 2 == 0 ? 0x76 : 0x77);
+  }
+}
+
+static void runFor(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    readAndWriteSensorBus();
+    delay(1);
+  }
+}
+
+// Reports wait for the conversions of a cycle in flight
+static void runIntervals(uint32_t count) {
+  runFor(count * (READ_DELAY + BME280_CONVERSION_MS) + 1);
+}
+
+static const LoopbackClient::Message *lastState(const char *type) {
+  std::string topic = getSensorStateTopic(CHIP_ID, type).c_str();
+  const LoopbackClient::Message *found = nullptr;
+  for (const LoopbackClient::Message &message : mqttLink->published) {
+    if (message.topic == topic) {
+      found = &message;
+    }
+  }
+  return found;
+}
+
+// Buffer PubSubClient needs to publish a message: header, topic length, topic
+// and payload
+static size_t publishSize(const LoopbackClient::Message &message) {
+  return 5 + 2 + message.topic.size() + message.payload.size();
+}
+
+static size_t countTopics(const char *suffix) {
+  size_t count = 0;
+  for (const LoopbackClient::Message &message : mqttLink->published) {
+    size_t at = message.topic.rfind(suffix);
+    if (at != std::string::npos &&
+        at + strlen(suffix) == message.topic.size()) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void setUp() {
+  shim::setSerialEnabled(false);
+  Wire.devices.clear();
+  Wire.channels.clear();
+  Wire.byteMicros = 0;
+  failedTempReadings = 0;
+  // As connectToMQTT() sets it, discovery does not fit the default
+  mqttClient->setBufferSize(1024);
+  mqttClient->connect(CHIP_ID.c_str(), "native", "native");
+  mqttLink->published.clear();
+}
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+void test_enumerates_direct_and_muxed_sensors() {
+  attachDirect(0x76);
+  attachBehindMux(0, 0x77);
+  attachBehindMux(3, 0x77);
+  attachBehindMux(5, 0x77);
+
+  TEST_ASSERT_EQUAL(4, sensorBusSetup());
+  const char *suffixes[] = {"", "_ch0_77", "_ch3_77", "_ch5_77"};
+  for (size_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_STRING(suffixes[i], busSensor(i).suffix);
+  }
+  TEST_ASSERT_EQUAL(SENSOR_BUS_DIRECT, busSensor(0).channel);
+  TEST_ASSERT_EQUAL(3, busSensor(2).channel);
+  TEST_ASSERT_EQUAL(0x77, busSensor(2).address);
+
+  // Without a mux, both direct addresses
+  Wire.channels.clear();
+  attachDirect(0x77);
+  TEST_ASSERT_EQUAL(2, sensorBusSetup());
+  TEST_ASSERT_EQUAL_STRING("_77", busSensor(1).suffix);
+}
+
+void test_direct_address_is_not_probed_behind_mux() {
+  // With a channel selected the direct 0x76 answers too
+  attachDirect(0x76);
+  attachBehindMux(1, 0x76);
+  attachBehindMux(1, 0x77);
+
+  TEST_ASSERT_EQUAL(2, sensorBusSetup());
+  TEST_ASSERT_EQUAL_STRING("", busSensor(0).suffix);
+  TEST_ASSERT_EQUAL_STRING("_ch1_77", busSensor(1).suffix);
+}
+
+void test_discovery_per_sensor() {
+  attachDirect(0x76);
+  attachBehindMux(2, 0x77);
+  attachBehindMux(7, 0x77);
+  sensorBusSetup();
+
+  Device<SensorBus, NoBridge>::publishDiscovery();
+  TEST_ASSERT_EQUAL(6, mqttLink->published.size());
+  // The direct 0x76 keeps the entities of a single-sensor node
+  TEST_ASSERT_EQUAL(1, countTopics("_temperature/config"));
+  TEST_ASSERT_EQUAL(1, countTopics("_humidity/config"));
+  TEST_ASSERT_EQUAL(1, countTopics("_temperature_ch2_77/config"));
+  TEST_ASSERT_EQUAL(1, countTopics("_humidity_ch7_77/config"));
+
+  // Slots are twice their ESP32 size on a 64-bit host
+  StaticJsonDocument<1024> doc;
+  deserializeJson(doc, mqttLink->published[4].payload);
+  TEST_ASSERT_EQUAL_STRING(
+      (getGargeDeviceNameUnderscore(CHIP_ID) + "_temperature_ch7_77").c_str(),
+      doc["uniq_id"].as<const char *>());
+}
+
+void test_conversions_overlap() {
+  attachDirect(0x76);
+  attachBehindMux(0, 0x77);
+  attachBehindMux(4, 0x77);
+  sensorBusSetup();
+  Wire.devices[0x76][BME280_CTRL_MEAS_REGISTER] = 0;
+  Wire.channels[0][0x77][BME280_CTRL_MEAS_REGISTER] = 0;
+  Wire.channels[4][0x77][BME280_CTRL_MEAS_REGISTER] = 0;
+
+  delay(SENSOR_SAMPLE_INTERVAL_MS);
+  readAndWriteSensorBus();
+  // Every conversion is running before any sensor is read
+  TEST_ASSERT_EQUAL_HEX8(BME280_CTRL_MEAS_FORCED,
+                         Wire.devices[0x76][BME280_CTRL_MEAS_REGISTER]);
+  TEST_ASSERT_EQUAL_HEX8(BME280_CTRL_MEAS_FORCED,
+                         Wire.channels[0][0x77][BME280_CTRL_MEAS_REGISTER]);
+  TEST_ASSERT_EQUAL_HEX8(BME280_CTRL_MEAS_FORCED,
+                         Wire.channels[4][0x77][BME280_CTRL_MEAS_REGISTER]);
+  for (size_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(0, busSensor(i).tempAggregate.count());
+  }
+
+  // loop() keeps running while they convert
+  delay(BME280_CONVERSION_MS - 1);
+  readAndWriteSensorBus();
+  TEST_ASSERT_EQUAL(0, busSensor(0).tempAggregate.count());
+  delay(1);
+  readAndWriteSensorBus();
+  for (size_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(1, busSensor(i).tempAggregate.count());
+    TEST_ASSERT_EQUAL(1, busSensor(i).humidAggregate.count());
+  }
+}
+
+void test_each_sensor_reports_its_own_state() {
+  attachDirect(0x76);
+  attachBehindMux(6, 0x77);
+  sensorBusSetup();
+  busSensor(0).driver.temperature = 21.5;
+  busSensor(1).driver.temperature = -4.25;
+  busSensor(1).driver.humidity = 80.0;
+  // The first interval still has the filters settling on the new values
+  runIntervals(2);
+
+  StaticJsonDocument<256> doc;
+  const LoopbackClient::Message *inside = lastState("temperature");
+  TEST_ASSERT_NOT_NULL(inside);
+  deserializeJson(doc, inside->payload);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 21.5 + BMEtempOffset,
+                           doc["value"].as<float>());
+  TEST_ASSERT_EQUAL(READ_DELAY / SENSOR_SAMPLE_INTERVAL_MS,
+                    doc["count"].as<int>());
+
+  const LoopbackClient::Message *outside = lastState("temperature_ch6_77");
+  TEST_ASSERT_NOT_NULL(outside);
+  deserializeJson(doc, outside->payload);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, -4.25 + BMEtempOffset,
+                           doc["value"].as<float>());
+  outside = lastState("humidity_ch6_77");
+  TEST_ASSERT_NOT_NULL(outside);
+  deserializeJson(doc, outside->payload);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 80.0 + BMEhumidOffset,
+                           doc["value"].as<float>());
+}
+
+void test_missing_sensor_stops_its_own_entities() {
+  attachDirect(0x76);
+  attachBehindMux(3, 0x77);
+  sensorBusSetup();
+  Wire.channels[3].clear();
+  runIntervals(1);
+
+  TEST_ASSERT_NOT_NULL(lastState("temperature"));
+  TEST_ASSERT_NULL(lastState("temperature_ch3_77"));
+  TEST_ASSERT_NULL(lastState("humidity_ch3_77"));
+  TEST_ASSERT_EQUAL(0, failedTempReadings);
+}
+
+void test_backfill_follows_the_primary_sensor() {
+  attachDirect(0x76);
+  attachBehindMux(6, 0x77);
+  sensorBusSetup();
+  // The same readings on both, so only the topics tell their sizes apart
+  for (size_t i = 0; i < 2; i++) {
+    busSensor(i).driver.temperature = 21.5;
+    busSensor(i).driver.humidity = 40.1;
+  }
+  runIntervals(2);
+  TEST_ASSERT_FALSE(hasPendingReadings());
+
+  // A buffer that fits the primary's states but not the longer topics of the
+  // sensor behind the mux
+  size_t primarySize = 0;
+  size_t secondarySize = SIZE_MAX;
+  for (const char *type : {"temperature", "humidity"}) {
+    primarySize = std::max(primarySize, publishSize(*lastState(type)));
+    std::string secondary = std::string(type) + "_ch6_77";
+    secondarySize = std::min(secondarySize,
+                             publishSize(*lastState(secondary.c_str())));
+  }
+  TEST_ASSERT_TRUE(primarySize < secondarySize);
+  mqttClient->setBufferSize(primarySize);
+  mqttLink->published.clear();
+  runIntervals(1);
+
+  TEST_ASSERT_NOT_NULL(lastState("temperature"));
+  TEST_ASSERT_NOT_NULL(lastState("humidity"));
+  TEST_ASSERT_NULL(lastState("temperature_ch6_77"));
+  // The secondary's failed publishes do not log the primary's readings
+  TEST_ASSERT_FALSE(hasPendingReadings());
+
+  // The primary's own failures still do
+  mqttClient->setBufferSize(16);
+  runIntervals(1);
+  TEST_ASSERT_TRUE(hasPendingReadings());
+  mqttClient->setBufferSize(1024);
+  runIntervals(1);
+  TEST_ASSERT_FALSE(hasPendingReadings());
+}
+
+void test_no_sensor_restarts_after_failure_limit() {
+  TEST_ASSERT_EQUAL(0, sensorBusSetup());
+  bool restarted = false;
+  try {
+    runIntervals(10);
+  } catch (const shim::Restart &) {
+    restarted = true;
+  }
+  TEST_ASSERT_TRUE(restarted);
+  TEST_ASSERT_EQUAL(10, failedTempReadings);
+}
+
+// At 100 kHz a cycle of N sensors costs one conversion and N sensors' worth
+// of bus traffic; one after another they would cost N conversions as well
+void test_cycle_cost_is_sublinear() {
+  const size_t counts[] = {1, 2, 4, 8, 16};
+  uint32_t cycleMicros[5];
+  for (size_t i = 0; i < 5; i++) {
+    Wire.devices.clear();
+    Wire.channels.clear();
+    Wire.byteMicros = 0;
+    attachSensors(counts[i]);
+    TEST_ASSERT_EQUAL(counts[i], sensorBusSetup());
+
+    Wire.byteMicros = 90;
+    Wire.transactions = 0;
+    runFor(SENSOR_SAMPLE_INTERVAL_MS * 2);
+    cycleMicros[i] = busCycleMicros;
+    printf("bus: %2u sensors, cycle %6u us, %4u us per sensor, sequential "
+           "%6u us\n",
+           static_cast<unsigned>(counts[i]),
+           static_cast<unsigned>(cycleMicros[i]),
+           static_cast<unsigned>(cycleMicros[i] / counts[i]),
+           static_cast<unsigned>(counts[i] * cycleMicros[0]));
+  }
+  TEST_ASSERT_TRUE(cycleMicros[0] >= BME280_CONVERSION_MS * 1000);
+  for (size_t i = 1; i < 5; i++) {
+    TEST_ASSERT_TRUE(cycleMicros[i] / counts[i] <
+                     cycleMicros[i - 1] / counts[i - 1]);
+  }
+  TEST_ASSERT_TRUE(cycleMicros[4] * 3 < 16 * cycleMicros[0]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_enumerates_direct_and_muxed_sensors);
+  RUN_TEST(test_direct_address_is_not_probed_behind_mux);
+  RUN_TEST(test_discovery_per_sensor);
+  RUN_TEST(test_conversions_overlap);
+  RUN_TEST(test_each_sensor_reports_its_own_state);
+  RUN_TEST(test_missing_sensor_stops_its_own_entities);
+  RUN_TEST(test_backfill_follows_the_primary_sensor);
+  RUN_TEST(test_no_sensor_restarts_after_failure_limit);
+  RUN_TEST(test_cycle_cost_is_sublinear);
+  return UNITY_END();
+}
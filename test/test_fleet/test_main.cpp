@@ -0,0 +1,303 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// Fleet simulator: many virtual devices run the firmware's MQTT layer against
+// one in-process broker, to size the backend for a power outage.
+//   pio test -e native -f test_fleet -v
+//   FLEET_DEVICES=2000 pio test -e native -f test_fleet -v
+//
+// connectToMQTT() and the publish helpers work on the CHIP_ID and mqttClient
+// globals, so devices run one at a time: a discrete-event loop always picks
+// the device that is furthest behind, points the globals and the shim clock
+// at it and runs one step (a connect attempt or a wake's worth of publishes).
+// The personality is GargeDevice, as on the device, since connectToMQTT()
+// picks the discovery configs from it; build with GARGE_TYPE "voltmeter" for
+// a voltmeter fleet.
+
+#include <LoopbackClient.h>
+#include <MQTTBroker.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "controllers/Device.h"
+#include "helpers/MQTTHelper.h"
+
+struct FleetConfig {
+  uint32_t devices;
+  uint32_t connectsPerSecond;  // broker capacity, 0 for unlimited
+  uint32_t bootSpreadMs;       // power returns to every device within this
+  uint32_t durationMs;
+};
+
+struct FleetReport {
+  uint32_t connected = 0;
+  uint32_t allConnectedMs = 0;
+  uint32_t p50ConnectedMs = 0;
+  uint32_t p95ConnectedMs = 0;
+  uint32_t attempts = 0;
+  uint32_t refused = 0;
+  uint32_t peakConnectsPerSecond = 0;
+  uint32_t peakPublishesPerSecond = 0;
+  uint32_t configMessages = 0;
+  size_t configBytes = 0;
+  uint32_t stateMessages = 0;
+  size_t retainedMessages = 0;
+  size_t retainedBytes = 0;
+  uint64_t steps = 0;
+  double hostSeconds = 0;
+};
+
+struct VirtualDevice {
+  String chipId;
+  LoopbackClient link;
+  PubSubClient client{link};
+  std::mt19937 rng;
+  float phase;
+  uint32_t firstConnectMs = UINT32_MAX;
+};
+
+static const bool VOLTMETER = GargeDevice::isVoltmeter();
+// After a refused connect the firmware's loop retries this much later
+static const uint32_t MQTT_RETRY_DELAY = 5000;
+
+static uint32_t fleetSize() {
+  const char *devices = getenv("FLEET_DEVICES");
+  return devices ? strtoul(devices, nullptr, 10) : 500;
+}
+
+static String valuePayload(float value) {
+  DynamicJsonDocument doc(256);
+  char buffer[128];
+  doc["value"] = value;
+  serializeJson(doc, buffer);
+  return String(buffer);
+}
+
+// Daily cycles with per-device phase and a little noise
+static void publishTrace(VirtualDevice *device) {
+  std::normal_distribution<float> noise(0.0f, 0.1f);
+  float day = 2.0f * M_PI * (millis() / 1000.0f) / 86400.0f + device->phase;
+  if (VOLTMETER) {
+    publishGargeSensorState(
+        CHIP_ID, "voltage",
+        valuePayload(12.6f + 0.4f * sinf(day) + noise(device->rng)));
+  } else {
+    publishGargeSensorState(
+        CHIP_ID, "temperature",
+        valuePayload(19.0f + 4.0f * sinf(day) + noise(device->rng)));
+    publishGargeSensorState(
+        CHIP_ID, "humidity",
+        valuePayload(45.0f + 10.0f * cosf(day) + noise(device->rng)));
+  }
+}
+
+// One connect attempt, or one wake's worth of publishes. Leaves the shim
+// clock at the time the device next needs to run.
+static void stepDevice(VirtualDevice *device) {
+  if (!mqttStatus()) {
+    connectToMQTT(1);
+    if (!mqttStatus()) {
+      delay(MQTT_RETRY_DELAY);
+      return;
+    }
+    device->firstConnectMs = std::min(device->firstConnectMs, millis());
+  }
+
+  // The firmware's loop() runs often enough to read everything waiting
+  while (device->link.available() > 0 && mqttClient->loop()) {
+  }
+  publishTrace(device);
+
+  if (VOLTMETER) {
+    mqttClient->disconnect();
+    delay(VOLTMETER_SLEEP_MIN_US / 1000);
+  } else {
+    delay(READ_DELAY);
+  }
+}
+
+static FleetReport runFleet(const FleetConfig &config) {
+  MQTTBroker broker;
+  broker.setConnectRate(config.connectsPerSecond);
+
+  std::vector<std::unique_ptr<VirtualDevice>> devices;
+  typedef std::pair<uint64_t, size_t> Event;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue;
+  uint64_t startUs = shim::nowMicros();
+  for (uint32_t i = 0; i < config.devices; i++) {
+    std::unique_ptr<VirtualDevice> device(new VirtualDevice());
+    char chipId[13];
+    snprintf(chipId, sizeof(chipId), "%012llx",
+             0xb43a45000000ULL + i);  // NOLINT(runtime/int)
+    device->chipId = chipId;
+    device->link.setBroker(&broker);
+    device->rng.seed(i);
+    device->phase = (i % 360) * M_PI / 180.0f;
+    devices.push_back(std::move(device));
+
+    uint64_t bootMs =
+        config.devices > 1
+            ? static_cast<uint64_t>(config.bootSpreadMs) * i / config.devices
+            : 0;
+    queue.push({startUs + bootMs * 1000, i});
+  }
+
+  String savedChipId = CHIP_ID;
+  PubSubClient *savedClient = mqttClient;
+  FleetReport report;
+  std::map<uint32_t, uint32_t> publishesPerSecond;
+  uint64_t endUs = startUs + config.durationMs * 1000ULL;
+  uint64_t latestUs = startUs;
+
+  auto hostStart = std::chrono::steady_clock::now();
+  while (!queue.empty() && queue.top().first < endUs) {
+    Event event = queue.top();
+    queue.pop();
+    VirtualDevice *device = devices[event.second].get();
+
+    CHIP_ID = device->chipId;
+    mqttClient = &device->client;
+    shim::setMicros(event.first);
+    uint32_t second = (event.first - startUs) / 1000000;
+
+    stepDevice(device);
+    report.steps++;
+
+    for (const auto &message : device->link.published) {
+      if (message.topic.size() > 7 &&
+          message.topic.compare(message.topic.size() - 7, 7, "/config") ==
+              0) {
+        report.configMessages++;
+        report.configBytes += message.topic.size() + message.payload.size();
+      } else {
+        report.stateMessages++;
+      }
+      publishesPerSecond[second]++;
+    }
+    device->link.published.clear();
+
+    latestUs = std::max(latestUs, shim::nowMicros());
+    queue.push({shim::nowMicros(), event.second});
+  }
+  report.hostSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - hostStart)
+                           .count();
+
+  CHIP_ID = savedChipId;
+  mqttClient = savedClient;
+  shim::setMicros(latestUs);
+
+  std::vector<uint32_t> connectTimes;
+  for (const auto &device : devices) {
+    if (device->firstConnectMs != UINT32_MAX) {
+      connectTimes.push_back(device->firstConnectMs - startUs / 1000);
+    }
+  }
+  std::sort(connectTimes.begin(), connectTimes.end());
+  report.connected = connectTimes.size();
+  if (!connectTimes.empty()) {
+    report.allConnectedMs = connectTimes.back();
+    report.p50ConnectedMs = connectTimes[connectTimes.size() / 2];
+    report.p95ConnectedMs = connectTimes[connectTimes.size() * 95 / 100];
+  }
+  report.attempts = broker.stats.connects + broker.stats.refused;
+  report.refused = broker.stats.refused;
+  for (const auto &second : broker.connectsPerSecond()) {
+    report.peakConnectsPerSecond =
+        std::max(report.peakConnectsPerSecond, second.second);
+  }
+  for (const auto &second : publishesPerSecond) {
+    report.peakPublishesPerSecond =
+        std::max(report.peakPublishesPerSecond, second.second);
+  }
+  report.retainedMessages = broker.retained().size();
+  report.retainedBytes = broker.retainedBytes();
+  return report;
+}
+
+static void printReport(const char *name, const FleetConfig &config,
+                        const FleetReport &report) {
+  printf("fleet %s: %u %s devices, %u connects/s, boot spread %u s\n", name,
+         config.devices, GARGE_TYPE, config.connectsPerSecond,
+         config.bootSpreadMs / 1000);
+  printf("  connected %u, all after %.1f s (p50 %.1f s, p95 %.1f s)\n",
+         report.connected, report.allConnectedMs / 1000.0,
+         report.p50ConnectedMs / 1000.0, report.p95ConnectedMs / 1000.0);
+  printf("  connect attempts %u, refused %u, peak %u connects/s\n",
+         report.attempts, report.refused, report.peakConnectsPerSecond);
+  printf("  discovery %u configs (%u bytes), %u states, peak %u msg/s\n",
+         report.configMessages, static_cast<unsigned>(report.configBytes),
+         report.stateMessages, report.peakPublishesPerSecond);
+  printf("  retained %u messages, %u bytes\n",
+         static_cast<unsigned>(report.retainedMessages),
+         static_cast<unsigned>(report.retainedBytes));
+  printf("  %llu steps in %.2f s host\n",
+         static_cast<unsigned long long>(report.steps),  // NOLINT
+         report.hostSeconds);
+}
+
+void setUp() { shim::setSerialEnabled(false); }
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+static const uint32_t CONNECTS_PER_SECOND = 100;
+static const uint32_t DURATION_MS = 30 * 60 * 1000;
+
+// Per device: the discovery configs and the last state for each of them
+static const size_t RETAINED_PER_DEVICE = VOLTMETER ? 2 : 4;
+
+void test_power_outage_storm() {
+  FleetConfig config = {fleetSize(), CONNECTS_PER_SECOND, 0, DURATION_MS};
+  FleetReport report = runFleet(config);
+  printReport("storm", config, report);
+
+  TEST_ASSERT_EQUAL(config.devices, report.connected);
+  TEST_ASSERT_TRUE(report.peakConnectsPerSecond <= CONNECTS_PER_SECOND);
+  TEST_ASSERT_EQUAL(config.devices * RETAINED_PER_DEVICE,
+                    report.retainedMessages);
+  if (config.devices > CONNECTS_PER_SECOND) {
+    TEST_ASSERT_TRUE(report.refused > 0);
+  }
+}
+
+void test_staggered_boot() {
+  // Spread so that the broker is never over capacity
+  uint32_t spreadMs = fleetSize() * 1000 / CONNECTS_PER_SECOND * 2;
+  FleetConfig config = {fleetSize(), CONNECTS_PER_SECOND, spreadMs,
+                        DURATION_MS};
+  FleetReport report = runFleet(config);
+  printReport("staggered", config, report);
+
+  TEST_ASSERT_EQUAL(config.devices, report.connected);
+  TEST_ASSERT_EQUAL(0, report.refused);
+  TEST_ASSERT_EQUAL(config.devices * RETAINED_PER_DEVICE,
+                    report.retainedMessages);
+}
+
+void test_unlimited_broker() {
+  FleetConfig config = {fleetSize(), 0, 0, DURATION_MS};
+  FleetReport report = runFleet(config);
+  printReport("unlimited", config, report);
+
+  TEST_ASSERT_EQUAL(0, report.refused);
+  TEST_ASSERT_EQUAL(config.devices, report.peakConnectsPerSecond);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_power_outage_storm);
+  RUN_TEST(test_staggered_boot);
+  RUN_TEST(test_unlimited_broker);
+  return UNITY_END();
+}
@@ -0,0 +1,227 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// The /history store: range queries, downsampling, the streamed output and
+// how fast a week of records is served.
+//   pio test -e native -f test_history -v
+
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "helpers/ReadingHistory.h"
+
+// Monday 2024-01-01 00:00:00 UTC
+static const uint32_t START = 1704067200;
+static const uint32_t MINUTE = 60;
+
+// Temperature ramps by 0.01 °C per minute around 20 °C, humidity stays at 50 %
+// with a spread that grows with the minute of the hour
+static void recordMinute(uint32_t minute) {
+  float temperature = 20.0f + (minute % 1000) / 100.0f;
+  float spread = (minute % 60) / 100.0f;
+  float record[HISTORY_COLUMN_COUNT] = {
+      temperature, temperature - spread, temperature + spread,
+      50.0f,       50.0f - spread,       50.0f + spread,
+  };
+  recordHistory(START + minute * MINUTE, record);
+}
+
+static void recordMinutes(uint32_t count) {
+  for (uint32_t minute = 0; minute < count; minute++) {
+    recordMinute(minute);
+  }
+}
+
+static std::string query(uint32_t from, uint32_t to, uint32_t step,
+                         HistoryFormat format, size_t *rows = nullptr,
+                         size_t *chunks = nullptr) {
+  std::string out;
+  size_t written = 0;
+  size_t count = streamHistory(from, to, step, format,
+                               [&](const char *chunk, size_t length) {
+                                 TEST_ASSERT_TRUE(length <=
+                                                  HISTORY_CHUNK_BYTES);
+                                 out.append(chunk, length);
+                                 written++;
+                               });
+  if (rows != nullptr) {
+    *rows = count;
+  }
+  if (chunks != nullptr) {
+    *chunks = written;
+  }
+  return out;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void setUp() {
+  shim::setSerialEnabled(false);
+  TEST_ASSERT_TRUE(historySetup());
+  clearHistory();
+}
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+void test_week_fits_in_psram() {
+  TEST_ASSERT_EQUAL(HISTORY_CAPACITY, historyCapacity());
+  recordMinutes(7 * 24 * 60);
+  TEST_ASSERT_EQUAL(HISTORY_CAPACITY, historySize());
+}
+
+void test_native_resolution_csv() {
+  recordMinutes(3);
+  size_t rows;
+  std::string csv = query(START, START + 2 * MINUTE, 0, HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(3, rows);
+  TEST_ASSERT_EQUAL_STRING(
+      "t,temperature,temperature_min,temperature_max,humidity,humidity_min,"
+      "humidity_max\n"
+      "1704067200,20.00,20.00,20.00,50.00,50.00,50.00\n"
+      "1704067260,20.01,20.00,20.02,50.00,49.99,50.01\n"
+      "1704067320,20.02,20.00,20.04,50.00,49.98,50.02\n",
+      csv.c_str());
+}
+
+void test_json_rows_and_nulls() {
+  recordMinute(0);
+  float missing[HISTORY_COLUMN_COUNT] = {NAN, NAN, NAN, -5.25f, -6.0f, -4.5f};
+  recordHistory(START + MINUTE, missing);
+  std::string json = query(START, START + MINUTE, 0, HISTORY_JSON);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"columns\":[\"t\",\"temperature\",\"temperature_min\","
+      "\"temperature_max\",\"humidity\",\"humidity_min\",\"humidity_max\"],"
+      "\"rows\":[[1704067200,20.00,20.00,20.00,50.00,50.00,50.00],"
+      "[1704067260,null,null,null,-5.25,-6.00,-4.50]]}",
+      json.c_str());
+  std::string csv = query(START, START + MINUTE, 0, HISTORY_CSV);
+  TEST_ASSERT_TRUE(csv.find("\n1704067260,,,,-5.25,-6.00,-4.50\n") !=
+                   std::string::npos);
+}
+
+void test_range_is_inclusive_and_binary_searched() {
+  recordMinutes(1000);
+  size_t rows;
+  query(START + 100 * MINUTE, START + 199 * MINUTE, 0, HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(100, rows);
+  // Bounds between records
+  query(START + 100 * MINUTE + 1, START + 199 * MINUTE - 1, 0, HISTORY_CSV,
+        &rows);
+  TEST_ASSERT_EQUAL(98, rows);
+  // Outside the stored range, and from after to
+  query(START - 3600, START - 1, 0, HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(0, rows);
+  query(START + 2000 * MINUTE, START + 3000 * MINUTE, 0, HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(0, rows);
+  std::string json = query(START + MINUTE, START, 0, HISTORY_JSON, &rows);
+  TEST_ASSERT_EQUAL(0, rows);
+  TEST_ASSERT_TRUE(json.find("\"rows\":[]}") != std::string::npos);
+}
+
+void test_downsampling_reduces_each_column() {
+  recordMinutes(120);
+  size_t rows;
+  std::string csv = query(START, START + 119 * MINUTE, 3600, HISTORY_CSV,
+                          &rows);
+  TEST_ASSERT_EQUAL(2, rows);
+  // First hour: mean of 20.00..20.59, lowest min at minute 0, highest max
+  // at minute 59 (20.59 + 0.59)
+  TEST_ASSERT_TRUE(csv.find("\n1704067200,20.30,20.00,21.18,50.00,49.41,"
+                            "50.59\n") != std::string::npos);
+  TEST_ASSERT_TRUE(csv.find("\n1704070800,20.90,20.60,21.78,50.00,49.41,"
+                            "50.59\n") != std::string::npos);
+}
+
+void test_buckets_start_at_from() {
+  recordMinutes(60);
+  size_t rows;
+  std::string csv = query(START + 30 * MINUTE, START + 59 * MINUTE,
+                          10 * MINUTE, HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(3, rows);
+  TEST_ASSERT_TRUE(csv.find("\n1704069000,20.35,") != std::string::npos);
+  TEST_ASSERT_TRUE(csv.find("\n1704069600,20.45,") != std::string::npos);
+  TEST_ASSERT_TRUE(csv.find("\n1704070200,20.55,") != std::string::npos);
+}
+
+void test_ring_drops_oldest() {
+  recordMinutes(HISTORY_CAPACITY + 100);
+  TEST_ASSERT_EQUAL(HISTORY_CAPACITY, historySize());
+  size_t rows;
+  query(0, UINT32_MAX, 0, HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(HISTORY_CAPACITY, rows);
+  query(START, START + 99 * MINUTE, 0, HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(0, rows);
+  std::string csv = query(START + 100 * MINUTE, START + 100 * MINUTE, 0,
+                          HISTORY_CSV, &rows);
+  TEST_ASSERT_EQUAL(1, rows);
+  TEST_ASSERT_TRUE(csv.find("\n1704073200,21.00,") != std::string::npos);
+}
+
+void test_drops_unsynced_and_out_of_order() {
+  float record[HISTORY_COLUMN_COUNT] = {20, 20, 20, 50, 50, 50};
+  // Clock not set by NTP yet
+  recordHistory(1000, record);
+  TEST_ASSERT_EQUAL(0, historySize());
+  recordHistory(START + MINUTE, record);
+  recordHistory(START + MINUTE, record);
+  recordHistory(START, record);
+  TEST_ASSERT_EQUAL(1, historySize());
+}
+
+void test_large_response_is_chunked() {
+  recordMinutes(24 * 60);
+  size_t rows;
+  size_t chunks;
+  std::string json =
+      query(START, START + 24 * 3600, 0, HISTORY_JSON, &rows, &chunks);
+  TEST_ASSERT_EQUAL(24 * 60, rows);
+  TEST_ASSERT_TRUE(chunks > json.size() / HISTORY_CHUNK_BYTES);
+  TEST_ASSERT_EQUAL('}', json.back());
+  printf("history: 1 day as JSON is %u bytes in %u chunks\n",
+         static_cast<unsigned>(json.size()), static_cast<unsigned>(chunks));
+}
+
+void test_week_query_throughput() {
+  recordMinutes(7 * 24 * 60);
+  const int RUNS = 20;
+  size_t bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < RUNS; i++) {
+    bytes += query(0, UINT32_MAX, 0, HISTORY_CSV).size();
+  }
+  double fullSeconds = secondsSince(start) / RUNS;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < RUNS; i++) {
+    query(START, START + 7 * 24 * 3600, 3600, HISTORY_JSON);
+  }
+  double hourlySeconds = secondsSince(start) / RUNS;
+
+  printf("history: week at 1 min %.2f ms (%.1f MB/s), hourly %.2f ms\n",
+         fullSeconds * 1000, bytes / RUNS / fullSeconds / 1e6,
+         hourlySeconds * 1000);
+  TEST_ASSERT_TRUE(hourlySeconds < fullSeconds);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_week_fits_in_psram);
+  RUN_TEST(test_native_resolution_csv);
+  RUN_TEST(test_json_rows_and_nulls);
+  RUN_TEST(test_range_is_inclusive_and_binary_searched);
+  RUN_TEST(test_downsampling_reduces_each_column);
+  RUN_TEST(test_buckets_start_at_from);
+  RUN_TEST(test_ring_drops_oldest);
+  RUN_TEST(test_drops_unsynced_and_out_of_order);
+  RUN_TEST(test_large_response_is_chunked);
+  RUN_TEST(test_week_query_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,214 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// End-to-end runs of the MQTT layer against the in-process broker stand-in,
+//   pio test -e native -f test_mqtt -v
+// Latency and reconnect times are on the shim clock, so they measure the
+// waits and round trips the firmware itself causes. Throughput is host time.
+
+#include <LoopbackClient.h>
+#include <MQTTBroker.h>
+#include <liz.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "helpers/MQTTHelper.h"
+
+static MQTTBroker broker;
+
+// Plays Home Assistant: watches everything under garge/devices/
+static LoopbackClient homeAssistantLink;
+static PubSubClient homeAssistant(homeAssistantLink);
+static std::vector<std::string> received;
+static uint32_t lastReceivedMs;
+
+static const char *WIZ_IP = "192.168.1.50";
+static const char *WIZ_MAC = "a8bb50d46a1c";
+static const char *WIZ_NAME = "wiz_SOCKET_a8bb50d46a1c";
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Reads every packet waiting, as the loop() calls between two of the
+// firmware's steps would; PubSubClient reads one per call
+static void loopUntilIdle(PubSubClient *client, LoopbackClient *link) {
+  while (link->available() > 0 && client->loop()) {
+  }
+}
+
+static void connectHomeAssistant() {
+  homeAssistantLink.setBroker(&broker);
+  homeAssistant.setCallback([](char *, uint8_t *payload, unsigned int length) {
+    received.push_back(std::string(reinterpret_cast<char *>(payload), length));
+    lastReceivedMs = millis();
+  });
+  homeAssistant.connect("homeassistant", "native", "native");
+  homeAssistant.subscribe("garge/devices/#");
+  loopUntilIdle(&homeAssistant, &homeAssistantLink);
+  received.clear();
+}
+
+void setUp() {
+  shim::setSerialEnabled(false);
+  broker = MQTTBroker();
+  mqttLink->setBroker(&broker);
+  mqttClient->disconnect();
+  mqttLink->published.clear();
+  liz::clearDiscoveredDevices();
+}
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+void test_connect_publishes_discovery() {
+  connectToMQTT(1);
+
+  TEST_ASSERT_TRUE(mqttStatus());
+  TEST_ASSERT_EQUAL(1, broker.stats.connects);
+  TEST_ASSERT_EQUAL(1, broker.retained().count(
+                           getSensorConfigTopic(CHIP_ID, "temperature")
+                               .c_str()));
+  TEST_ASSERT_EQUAL(1, broker.retained().count(
+                           getSensorConfigTopic(CHIP_ID, "humidity").c_str()));
+  printf("mqtt discovery %u retained messages, %u bytes\n",
+         static_cast<unsigned>(broker.retained().size()),
+         static_cast<unsigned>(broker.retainedBytes()));
+}
+
+void test_auth_failure_gives_up() {
+  broker.setCredentials("someone-else", "secret");
+
+  uint32_t start = millis();
+  connectToMQTT(3);
+
+  TEST_ASSERT_FALSE(mqttStatus());
+  TEST_ASSERT_EQUAL(MQTT_CONNECT_BAD_CREDENTIALS, mqttClient->state());
+  TEST_ASSERT_EQUAL(3, broker.stats.refused);
+  // The 5 s retry interval is waited out between attempts, not after the last
+  TEST_ASSERT_EQUAL(10000, millis() - start);
+}
+
+void test_reconnect_time() {
+  connectToMQTT(1);
+  broker.disconnectAll();
+  TEST_ASSERT_FALSE(mqttStatus());
+  TEST_ASSERT_EQUAL(MQTT_CONNECTION_LOST, mqttClient->state());
+
+  const uint32_t latencyMs = 50;
+  broker.setLatency(latencyMs);
+  broker.refuseConnects(2, MQTT_CONNECT_UNAVAILABLE);
+
+  uint32_t start = millis();
+  connectToMQTT(0);
+  uint32_t elapsed = millis() - start;
+  printf("mqtt reconnect after 2 refusals: %u ms\n", elapsed);
+
+  TEST_ASSERT_TRUE(mqttStatus());
+  // Three connects, two retry waits and the two discovery configs
+  TEST_ASSERT_EQUAL(3 * latencyMs + 2 * 5000 + 2 * latencyMs, elapsed);
+}
+
+void test_publish_throughput() {
+  connectToMQTT(1);
+  connectHomeAssistant();
+
+  const uint32_t count = 20000;
+  uint32_t deliveredBefore = broker.stats.delivered;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < count; i++) {
+    if (mqttLink->published.size() >= 1000) {
+      mqttLink->published.clear();
+    }
+    TEST_ASSERT_TRUE(publishGargeSensorState(
+        CHIP_ID, "temperature",
+        String("{\"value\":") + String(20.0f + (i % 50) / 10.0f) + "}"));
+    homeAssistant.loop();
+  }
+  double seconds = secondsSince(start);
+  printf("mqtt publish throughput %.0f msg/s, %u bytes delivered\n",
+         count / seconds, static_cast<unsigned>(broker.stats.bytesOut));
+
+  TEST_ASSERT_EQUAL(count, received.size());
+  TEST_ASSERT_EQUAL(count, broker.stats.delivered - deliveredBefore);
+}
+
+void test_set_to_state_round_trip() {
+  connectToMQTT(1);
+  liz::getDiscoveredDevices().push_back(
+      liz::Device(WIZ_IP, WIZ_MAC, "ESP25_SOCKET_01"));
+  mqttClient->subscribe(getDeviceSetTopic(WIZ_NAME).c_str());
+  connectHomeAssistant();
+
+  const uint32_t latencyMs = 20;
+  broker.setLatency(latencyMs);
+
+  const uint32_t count = 2000;
+  uint32_t totalMs = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < count; i++) {
+    const char *command = i % 2 ? "OFF" : "ON";
+    uint32_t sent = millis();
+    homeAssistant.publish(getDeviceSetTopic(WIZ_NAME).c_str(), command);
+    loopUntilIdle(mqttClient, mqttLink);
+    received.clear();
+    loopUntilIdle(&homeAssistant, &homeAssistantLink);
+
+    // Home Assistant sees its own command echoed, then the state
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING(command, received.back().c_str());
+    totalMs += lastReceivedMs - sent;
+  }
+  double seconds = secondsSince(start);
+  printf("mqtt /set -> state %u ms on the wire, %.1f us host per trip\n",
+         totalMs / count, seconds * 1e6 / count);
+
+  // The command and the state publish are the only hops
+  TEST_ASSERT_EQUAL(2 * latencyMs, totalMs / count);
+  TEST_ASSERT_EQUAL_STRING(
+      "OFF", broker.retained()
+                 .at((getBaseTopic(CHIP_ID) + WIZ_NAME + "/state").c_str())
+                 .c_str());
+}
+
+void test_publish_fails_after_disconnect() {
+  connectToMQTT(1);
+  broker.disconnect(CHIP_ID.c_str());
+
+  TEST_ASSERT_FALSE(publishGargeSensorState(CHIP_ID, "temperature",
+                                            String("{\"value\":21.5}")));
+  TEST_ASSERT_EQUAL(MQTT_CONNECTION_LOST, mqttClient->state());
+
+  connectToMQTT(1);
+  TEST_ASSERT_TRUE(publishGargeSensorState(CHIP_ID, "temperature",
+                                           String("{\"value\":21.5}")));
+}
+
+void test_client_id_takeover() {
+  connectToMQTT(1);
+
+  // A second device flashed with the same id kicks the first one off
+  LoopbackClient twinLink;
+  twinLink.setBroker(&broker);
+  PubSubClient twin(twinLink);
+  TEST_ASSERT_TRUE(twin.connect(CHIP_ID.c_str(), "native", "native"));
+
+  TEST_ASSERT_FALSE(mqttStatus());
+  TEST_ASSERT_EQUAL(1, broker.stats.takeovers);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_connect_publishes_discovery);
+  RUN_TEST(test_auth_failure_gives_up);
+  RUN_TEST(test_reconnect_time);
+  RUN_TEST(test_publish_throughput);
+  RUN_TEST(test_set_to_state_round_trip);
+  RUN_TEST(test_publish_fails_after_disconnect);
+  RUN_TEST(test_client_id_takeover);
+  return UNITY_END();
+}
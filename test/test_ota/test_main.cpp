@@ -0,0 +1,260 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// OTA inputs on the host: the manifest the whole fleet parses, and delta
+// patches in the format written by scripts/create_delta_patch.py.
+//   pio test -e native -f test_ota -v
+
+#include <unity.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "helpers/DeltaPatcher.h"
+#include "helpers/OTAManifest.h"
+
+static const char *const PRODUCTS[] = {
+    "garge_sensor_bme",     "garge_sensor_dht", "garge_voltmeter_bme",
+    "garge_universal_auto", "garge_sensor_bus",
+};
+static const int RELEASES_PER_PRODUCT = 8;
+static const int PATCHES_PER_RELEASE = 3;
+
+static String fakeSha256(const char *product, int release) {
+  char hex[65];
+  for (int i = 0; i < 64; i++) {
+    hex[i] = "0123456789abcdef"[(product[i % 8] + release * 7 + i) % 16];
+  }
+  hex[64] = '\0';
+  return String(hex);
+}
+
+static String versionName(int release) {
+  char version[24];
+  snprintf(version, sizeof(version), "v1.%d.%d", release / 3, release % 3);
+  return String(version);
+}
+
+// Every product with its release history, each entry carrying all the fields
+// the releases write plus notes the firmware does not read
+static String realisticManifest() {
+  String manifest = "[";
+  for (const char *product : PRODUCTS) {
+    for (int release = 0; release < RELEASES_PER_PRODUCT; release++) {
+      String version = versionName(release);
+      String base = String("https://github.com/sondresjolyst/garge/releases/"
+                           "download/") +
+                    version + "/" + product;
+      if (manifest.length() > 1) {
+        manifest += ",";
+      }
+      manifest += String("{\"name\":\"") + product + "\",\"version\":\"" +
+                  version + "\",\"bin_url\":\"" + base +
+                  ".bin\",\"size\":" + String(1200000 + release * 1024) +
+                  ",\"compression\":\"gzip\",\"compressed_url\":\"" + base +
+                  ".bin.gz\",\"compressed_size\":" +
+                  String(700000 + release * 512) + ",\"rollout\":" +
+                  String(release == RELEASES_PER_PRODUCT - 1 ? 25 : 100) +
+                  ",\"sha256\":\"" + fakeSha256(product, release) +
+                  "\",\"notes\":\"Bug fixes and improvements to sensor "
+                  "reporting, OTA scheduling and reconnect handling.\"" +
+                  ",\"patches\":[";
+      for (int from = release - 1;
+           from >= 0 && from >= release - PATCHES_PER_RELEASE; from--) {
+        if (from != release - 1) {
+          manifest += ",";
+        }
+        manifest += String("{\"from\":\"") + versionName(from) +
+                    "\",\"url\":\"" + base + "-from-" + versionName(from) +
+                    ".patch.gz\",\"from_sha256\":\"" +
+                    fakeSha256(product, from) + "\"}";
+      }
+      manifest += "]}";
+    }
+  }
+  return manifest + "]";
+}
+
+void setUp() { shim::setSerialEnabled(false); }
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+void test_realistic_manifest_parses() {
+  String manifest = realisticManifest();
+  // Far beyond the 4 KB document the parser used to have
+  TEST_ASSERT_TRUE(manifest.length() > 8 * 4096);
+
+  OTARelease release;
+  TEST_ASSERT_TRUE(
+      parseManifest(manifest, "garge_sensor_bus", "v1.1.1", &release));
+  String latest = versionName(RELEASES_PER_PRODUCT - 1);
+  TEST_ASSERT_EQUAL_STRING(latest.c_str(), release.version.c_str());
+  TEST_ASSERT_EQUAL_STRING(
+      "https://github.com/sondresjolyst/garge/releases/download/v1.2.1/"
+      "garge_sensor_bus.bin",
+      release.binUrl.c_str());
+  TEST_ASSERT_EQUAL(1200000 + 7 * 1024, release.size);
+  TEST_ASSERT_EQUAL_STRING("gzip", release.compression.c_str());
+  TEST_ASSERT_EQUAL(700000 + 7 * 512, release.compressedSize);
+  TEST_ASSERT_EQUAL(25, release.rollout);
+  TEST_ASSERT_EQUAL_STRING(fakeSha256("garge_sensor_bus", 7).c_str(),
+                           release.sha256.c_str());
+  TEST_ASSERT_EQUAL_STRING("v1.1.1", release.patchFrom.c_str());
+  TEST_ASSERT_EQUAL_STRING(fakeSha256("garge_sensor_bus", 4).c_str(),
+                           release.patchBaseSha256.c_str());
+}
+
+void test_manifest_without_patch_for_running_version() {
+  OTARelease release;
+  TEST_ASSERT_TRUE(parseManifest(realisticManifest(), "garge_voltmeter_bme",
+                                 "v1.0.0", &release));
+  TEST_ASSERT_EQUAL_STRING("v1.2.1", release.version.c_str());
+  TEST_ASSERT_TRUE(release.patchUrl.isEmpty());
+}
+
+void test_manifest_rejects_unknown_product_and_bad_json() {
+  String manifest = realisticManifest();
+  OTARelease release;
+  TEST_ASSERT_FALSE(
+      parseManifest(manifest, "garge_sensor_sht", "v1.0.0", &release));
+  String truncated = manifest.substring(0, manifest.length() / 2);
+  TEST_ASSERT_FALSE(
+      parseManifest(truncated, "garge_sensor_bme", "v1.0.0", &release));
+}
+
+// A base image and a target that shares most of it, with the patch built the
+// way create_delta_patch.py interleaves bsdiff control triples
+struct PatchFixture {
+  esp_partition_t base;
+  std::vector<uint8_t> target;
+  std::vector<uint8_t> patch;
+};
+
+static void appendLittleEndian32(std::vector<uint8_t> *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out->push_back(value >> (8 * i));
+  }
+}
+
+static void appendRecord(PatchFixture *fixture, uint32_t *basePos,
+                         uint32_t diffLen, const std::vector<uint8_t> &extra,
+                         int32_t seek) {
+  std::vector<uint8_t> &patch = fixture->patch;
+  appendLittleEndian32(&patch, diffLen);
+  appendLittleEndian32(&patch, extra.size());
+  appendLittleEndian32(&patch, static_cast<uint32_t>(seek));
+  for (uint32_t i = 0; i < diffLen; i++) {
+    uint8_t from = fixture->base.contents[*basePos + i];
+    uint8_t to = from + (i % 97 == 0 ? 3 : 0);
+    patch.push_back(to - from);
+    fixture->target.push_back(to);
+  }
+  patch.insert(patch.end(), extra.begin(), extra.end());
+  fixture->target.insert(fixture->target.end(), extra.begin(), extra.end());
+  *basePos += diffLen + seek;
+}
+
+static PatchFixture makePatch() {
+  PatchFixture fixture;
+  std::mt19937 rng(7);
+  fixture.base.contents.resize(8192);
+  for (uint8_t &byte : fixture.base.contents) {
+    byte = rng();
+  }
+  fixture.base.size = fixture.base.contents.size();
+
+  uint32_t basePos = 0;
+  appendRecord(&fixture, &basePos, 3000, std::vector<uint8_t>(40, 0xA5), 200);
+  appendRecord(&fixture, &basePos, 0, std::vector<uint8_t>(300, 0x5A), -1000);
+  appendRecord(&fixture, &basePos, 4000, {}, 0);
+
+  std::vector<uint8_t> header = {'G', 'D', 'P', '1'};
+  appendLittleEndian32(&header, fixture.target.size());
+  fixture.patch.insert(fixture.patch.begin(), header.begin(), header.end());
+  return fixture;
+}
+
+// Feeds the patch in chunks of chunkSize and returns whether it applied
+static bool applyPatch(const PatchFixture &fixture, size_t chunkSize,
+                       std::vector<uint8_t> *output) {
+  DeltaPatcher patcher(&fixture.base, [output](const uint8_t *data,
+                                               size_t len) {
+    output->insert(output->end(), data, data + len);
+    return true;
+  });
+  for (size_t offset = 0; offset < fixture.patch.size(); offset += chunkSize) {
+    size_t len = std::min(chunkSize, fixture.patch.size() - offset);
+    if (!patcher.write(fixture.patch.data() + offset, len)) {
+      return false;
+    }
+  }
+  return patcher.isComplete() &&
+         patcher.getTargetSize() == fixture.target.size();
+}
+
+void test_delta_patch_rebuilds_target_in_any_chunking() {
+  PatchFixture fixture = makePatch();
+  for (size_t chunkSize : {static_cast<size_t>(1), static_cast<size_t>(7),
+                           static_cast<size_t>(1024), fixture.patch.size()}) {
+    std::vector<uint8_t> output;
+    TEST_ASSERT_TRUE(applyPatch(fixture, chunkSize, &output));
+    TEST_ASSERT_EQUAL(fixture.target.size(), output.size());
+    TEST_ASSERT_EQUAL_MEMORY(fixture.target.data(), output.data(),
+                             output.size());
+  }
+}
+
+void test_delta_patch_rejects_bad_magic_and_trailing_bytes() {
+  PatchFixture fixture = makePatch();
+  std::vector<uint8_t> output;
+  fixture.patch.push_back(0);
+  TEST_ASSERT_FALSE(applyPatch(fixture, 1024, &output));
+
+  fixture = makePatch();
+  fixture.patch[3] = '2';
+  output.clear();
+  TEST_ASSERT_FALSE(applyPatch(fixture, 1024, &output));
+  TEST_ASSERT_EQUAL(0, output.size());
+}
+
+void test_delta_patch_rejects_reads_outside_the_base() {
+  PatchFixture fixture = makePatch();
+  // Second record seeks back before the start of the base image
+  size_t secondSeek = 8 + 12 + 3000 + 40 + 8;
+  uint32_t before = -4000;
+  for (int i = 0; i < 4; i++) {
+    fixture.patch[secondSeek + i] = before >> (8 * i);
+  }
+  std::vector<uint8_t> output;
+  TEST_ASSERT_FALSE(applyPatch(fixture, 1024, &output));
+
+  // A base shorter than the patch expects
+  fixture = makePatch();
+  fixture.base.size = 2000;
+  output.clear();
+  TEST_ASSERT_FALSE(applyPatch(fixture, 1024, &output));
+}
+
+void test_delta_patch_stops_when_the_sink_fails() {
+  PatchFixture fixture = makePatch();
+  size_t written = 0;
+  DeltaPatcher patcher(&fixture.base, [&written](const uint8_t *, size_t len) {
+    written += len;
+    return written < 1000;
+  });
+  TEST_ASSERT_FALSE(patcher.write(fixture.patch.data(), fixture.patch.size()));
+  TEST_ASSERT_FALSE(patcher.isComplete());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_realistic_manifest_parses);
+  RUN_TEST(test_manifest_without_patch_for_running_version);
+  RUN_TEST(test_manifest_rejects_unknown_product_and_bad_json);
+  RUN_TEST(test_delta_patch_rebuilds_target_in_any_chunking);
+  RUN_TEST(test_delta_patch_rejects_bad_magic_and_trailing_bytes);
+  RUN_TEST(test_delta_patch_rejects_reads_outside_the_base);
+  RUN_TEST(test_delta_patch_stops_when_the_sink_fails);
+  return UNITY_END();
+}
@@ -0,0 +1,197 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// Hardware detection for the universal image, on the shim clock: what each
+// board is detected as, and what a boot with the cached result costs.
+//   pio test -e native -f test_probe -v
+
+#include <Preferences.h>
+#include <unity.h>
+
+#include <cmath>
+
+#include "controllers/Device.h"
+#include "controllers/HardwareProbe.h"
+
+// The first boot of a board and every one after it
+static uint32_t timedDetect(DetectedHardware *hardware) {
+  uint32_t start = millis();
+  *hardware = detectHardware();
+  return millis() - start;
+}
+
+static bool cached(DetectedHardware *hardware) {
+  Preferences prefs;
+  prefs.begin("hardware", true);
+  bool found = prefs.isKey("detected");
+  *hardware = static_cast<DetectedHardware>(prefs.getUChar("detected"));
+  prefs.end();
+  return found;
+}
+
+static void attachBme280(uint8_t address) {
+  Wire.devices[address][BME280_CHIP_ID_REGISTER] = BME280_CHIP_ID;
+}
+
+void setUp() {
+  shim::setSerialEnabled(false);
+  shim::nvs().clear();
+  Wire.devices.clear();
+  DhtSensor::device().present = false;
+  DhtSensor::device().temperature = 21.5;
+  DhtSensor::device().humidity = 40.0;
+  shim::setAnalogMilliVolts(ANALOG_IN_PIN, 0);
+}
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+void test_detects_dht_after_its_startup() {
+  DhtSensor::device().present = true;
+  DetectedHardware hardware;
+  timedDetect(&hardware);
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, hardware);
+  // The probe waited out the sensor's first second
+  TEST_ASSERT_TRUE(millis() >= DHT_STARTUP_MS);
+  DetectedHardware stored;
+  TEST_ASSERT_TRUE(cached(&stored));
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, stored);
+}
+
+void test_detects_bme280_at_either_address() {
+  attachBme280(0x77);
+  DhtSensor::device().present = true;
+  DetectedHardware hardware;
+  uint32_t elapsed = timedDetect(&hardware);
+  TEST_ASSERT_EQUAL(HARDWARE_BME280_77, hardware);
+  // Found before the DHT probe
+  TEST_ASSERT_EQUAL(0, elapsed);
+
+  shim::nvs().clear();
+  attachBme280(0x76);
+  TEST_ASSERT_EQUAL(HARDWARE_BME280_76, detectHardware());
+}
+
+void test_detects_voltmeter_divider() {
+  shim::setAnalogMilliVolts(ANALOG_IN_PIN, 2930);  // 12.6 V battery
+  TEST_ASSERT_EQUAL(HARDWARE_VOLTMETER, detectHardware());
+  TEST_ASSERT_TRUE(UniversalDevice::isVoltmeter());
+}
+
+void test_nothing_found_is_not_cached() {
+  DetectedHardware hardware;
+  TEST_ASSERT_EQUAL(HARDWARE_NONE, detectHardware());
+  TEST_ASSERT_FALSE(cached(&hardware));
+
+  // A divider without a battery is not a voltmeter either
+  shim::setAnalogMilliVolts(ANALOG_IN_PIN, 40);
+  TEST_ASSERT_EQUAL(HARDWARE_NONE, detectHardware());
+}
+
+void test_cached_boots_are_fast() {
+  DhtSensor::device().present = true;
+  DetectedHardware hardware;
+  uint32_t first = timedDetect(&hardware);
+  uint32_t later = timedDetect(&hardware);
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, hardware);
+  printf("probe: dht first boot %u ms, cached %u ms\n",
+         static_cast<unsigned>(first), static_cast<unsigned>(later));
+  TEST_ASSERT_TRUE(first >= 25);
+  TEST_ASSERT_TRUE(later < 50);
+
+  shim::nvs().clear();
+  attachBme280(0x76);
+  detectHardware();
+  later = timedDetect(&hardware);
+  TEST_ASSERT_EQUAL(HARDWARE_BME280_76, hardware);
+  TEST_ASSERT_TRUE(later < 50);
+}
+
+void test_cached_bme280_that_is_gone_is_probed_again() {
+  attachBme280(0x76);
+  TEST_ASSERT_EQUAL(HARDWARE_BME280_76, detectHardware());
+
+  Wire.devices.clear();
+  DhtSensor::device().present = true;
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, detectHardware());
+  DetectedHardware stored;
+  TEST_ASSERT_TRUE(cached(&stored));
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, stored);
+}
+
+void test_cached_voltmeter_is_confirmed_by_its_divider() {
+  shim::setAnalogMilliVolts(ANALOG_IN_PIN, 2930);
+  DetectedHardware hardware;
+  timedDetect(&hardware);
+  uint32_t later = timedDetect(&hardware);
+  TEST_ASSERT_EQUAL(HARDWARE_VOLTMETER, hardware);
+  TEST_ASSERT_TRUE(later < 50);
+
+  // The divider reads nothing any more, e.g. a board moved to another role
+  shim::setAnalogMilliVolts(ANALOG_IN_PIN, 0);
+  DhtSensor::device().present = true;
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, detectHardware());
+}
+
+void test_sensor_board_never_becomes_voltmeter() {
+  DhtSensor::device().present = true;
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, detectHardware());
+
+  // The sensor misses a boot while the floating pin happens to read steady
+  DhtSensor::device().present = false;
+  shim::setAnalogMilliVolts(ANALOG_IN_PIN, 1500);
+  forgetDetectedHardware();
+  DetectedHardware stored;
+  TEST_ASSERT_EQUAL(HARDWARE_NONE, detectHardware());
+  TEST_ASSERT_FALSE(cached(&stored));
+
+  DhtSensor::device().present = true;
+  TEST_ASSERT_EQUAL(HARDWARE_DHT, detectHardware());
+}
+
+void test_auto_sensor_reads_the_detected_driver() {
+  DhtSensor::device().present = true;
+  detectHardware();
+  TEST_ASSERT_FALSE(UniversalDevice::isVoltmeter());
+
+  float temperature;
+  float humidity;
+  AutoSensor::read(&temperature, &humidity);
+  TEST_ASSERT_EQUAL_FLOAT(21.5f, temperature);
+  TEST_ASSERT_EQUAL_FLOAT(40.0f, humidity);
+  TEST_ASSERT_EQUAL_FLOAT(DHTtempOffset, AutoSensor::temperatureOffset());
+  TEST_ASSERT_EQUAL_FLOAT(DHThumidOffset, AutoSensor::humidityOffset());
+  // Sooner than this the DHT library returns its cached reading
+  TEST_ASSERT_EQUAL(DHT_MIN_SAMPLE_INTERVAL_MS,
+                    AutoSensor::minSampleIntervalMs());
+}
+
+void test_auto_sensor_forgets_a_sensor_that_stopped_answering() {
+  DhtSensor::device().present = true;
+  detectHardware();
+  DhtSensor::device().temperature = NAN;
+  DhtSensor::device().humidity = NAN;
+
+  float temperature;
+  float humidity;
+  DetectedHardware stored;
+  for (uint32_t i = 1; i < AUTO_SENSOR_FORGET_SAMPLES; i++) {
+    AutoSensor::read(&temperature, &humidity);
+  }
+  TEST_ASSERT_TRUE(cached(&stored));
+  AutoSensor::read(&temperature, &humidity);
+  TEST_ASSERT_FALSE(cached(&stored));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_detects_dht_after_its_startup);
+  RUN_TEST(test_detects_bme280_at_either_address);
+  RUN_TEST(test_detects_voltmeter_divider);
+  RUN_TEST(test_nothing_found_is_not_cached);
+  RUN_TEST(test_cached_boots_are_fast);
+  RUN_TEST(test_cached_bme280_that_is_gone_is_probed_again);
+  RUN_TEST(test_cached_voltmeter_is_confirmed_by_its_divider);
+  RUN_TEST(test_sensor_board_never_becomes_voltmeter);
+  RUN_TEST(test_auto_sensor_reads_the_detected_driver);
+  RUN_TEST(test_auto_sensor_forgets_a_sensor_that_stopped_answering);
+  return UNITY_END();
+}
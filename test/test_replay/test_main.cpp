@@ -0,0 +1,398 @@
+// Copyright (c) 2023-2025 Sondre Sjølyst
+
+// Replays sensor traces through the sampling, filtering and aggregation code
+// of SensorController, including the NaN restarts, so filter changes can be
+// judged offline.
+//   pio test -e native -f test_replay -v
+//   REPLAY_TRACE=trace.csv pio test -e native -f test_replay -v
+// Traces are temperature,humidity rows, one per SENSOR_SAMPLE_INTERVAL_MS, as
+// written by scripts/log_to_trace.py; nan or an empty field is a failed read.
+// Outputs are the aggregate records published once per READ_DELAY. The
+// built-in traces cover spikes, short events and dropouts.
+
+#include <LoopbackClient.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "controllers/SensorController.h"
+#include "helpers/MQTTHelper.h"
+#include "helpers/ReadingLog.h"
+
+static const size_t SAMPLES_PER_REPORT = READ_DELAY / SENSOR_SAMPLE_INTERVAL_MS;
+static const float TEMP_BASELINE = 20.0f + BMEtempOffset;
+static const float HUMID_BASELINE = 50.0f + BMEhumidOffset;
+
+struct TraceSample {
+  float temperature;
+  float humidity;
+};
+
+// One published aggregate record per quantity, NaN where none was published
+struct ReportOutput {
+  size_t sample;  // trace row that closed the interval
+  float temperature = NAN;
+  float tempMin = NAN;
+  float tempMax = NAN;
+  float tempStddev = NAN;
+  uint32_t tempCount = 0;
+  float humidity = NAN;
+};
+
+struct ReplayReport {
+  uint32_t samples = 0;
+  uint32_t nanSamples = 0;
+  uint32_t publishes = 0;
+  std::vector<size_t> restarts;  // trace row of each restart
+  std::vector<ReportOutput> outputs;
+  double hostSeconds = 0;
+};
+
+static float parseField(const std::string &field) {
+  if (field.find_first_not_of(" \t\r") == std::string::npos) {
+    return NAN;
+  }
+  return strtof(field.c_str(), nullptr);
+}
+
+static std::vector<TraceSample> parseTrace(std::istream &in) {
+  std::vector<TraceSample> trace;
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t comma = line.find(',');
+    if (comma == std::string::npos || line.compare(0, 11, "temperature") == 0) {
+      continue;
+    }
+    trace.push_back({parseField(line.substr(0, comma)),
+                     parseField(line.substr(comma + 1))});
+  }
+  return trace;
+}
+
+static std::vector<TraceSample> steadyTrace(size_t reports) {
+  return std::vector<TraceSample>(reports * SAMPLES_PER_REPORT,
+                                  TraceSample{20.0f, 50.0f});
+}
+
+static bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Picks the aggregate records out of what the sample published, if any.
+static bool collectOutput(size_t sample, ReportOutput *output) {
+  bool found = false;
+  output->sample = sample;
+  for (const auto &message : mqttLink->published) {
+    DynamicJsonDocument doc(256);
+    if (deserializeJson(doc, message.payload.c_str())) {
+      continue;
+    }
+    if (endsWith(message.topic, "_temperature/state")) {
+      output->temperature = doc["value"];
+      output->tempMin = doc["min"];
+      output->tempMax = doc["max"];
+      output->tempStddev = doc["stddev"];
+      output->tempCount = doc["count"];
+      found = true;
+    } else if (endsWith(message.topic, "_humidity/state")) {
+      output->humidity = doc["value"];
+      found = true;
+    }
+  }
+  return found;
+}
+
+// What a restart leaves behind: fresh globals, then the sensor setup that
+// seeds the filters from the current reading and starts a new interval
+static void bootPipeline(const TraceSample &sample) {
+  averageTemp = 0;
+  averageHumid = 0;
+  tempFilter.reset();
+  humidFilter.reset();
+  failedTempReadings = 0;
+  failedHumidReadings = 0;
+  BmeSensor::device().temperature = sample.temperature;
+  BmeSensor::device().humidity = sample.humidity;
+  environmentalSensorSetup<BmeSensor>();
+}
+
+static ReplayReport replay(const std::vector<TraceSample> &trace) {
+  ReplayReport report;
+  if (trace.empty()) {
+    return report;
+  }
+
+  bootPipeline(trace.front());
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < trace.size(); i++) {
+    const TraceSample &sample = trace[i];
+    BmeSensor::device().temperature = sample.temperature;
+    BmeSensor::device().humidity = sample.humidity;
+    if (std::isnan(sample.temperature) || std::isnan(sample.humidity)) {
+      report.nanSamples++;
+    }
+
+    delay(SENSOR_SAMPLE_INTERVAL_MS);
+    try {
+      readAndWriteEnvironmentalSensors<BmeSensor>();
+    } catch (const shim::Restart &) {
+      report.restarts.push_back(i);
+      bootPipeline(sample);
+    }
+
+    ReportOutput output;
+    if (collectOutput(i, &output)) {
+      report.outputs.push_back(output);
+    }
+    report.publishes += mqttLink->published.size();
+    mqttLink->published.clear();
+    report.samples++;
+  }
+  report.hostSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  return report;
+}
+
+static void printReport(const char *name, const ReplayReport &report) {
+  float minTemp = INFINITY;
+  float maxTemp = -INFINITY;
+  for (const auto &output : report.outputs) {
+    if (!std::isnan(output.temperature)) {
+      minTemp = std::min(minTemp, output.tempMin);
+      maxTemp = std::max(maxTemp, output.tempMax);
+    }
+  }
+  printf("replay %s: %u samples (%u nan), %u reports, %u publishes, "
+         "%u restarts\n",
+         name, report.samples, report.nanSamples,
+         static_cast<unsigned>(report.outputs.size()), report.publishes,
+         static_cast<unsigned>(report.restarts.size()));
+  printf("  temperature %.2f..%.2f, %.0f samples/s\n", minTemp, maxTemp,
+         report.samples / report.hostSeconds);
+}
+
+static uint32_t countDeviating(const ReplayReport &report, float expected,
+                               float tolerance) {
+  uint32_t count = 0;
+  for (const auto &output : report.outputs) {
+    if (!(std::fabs(output.temperature - expected) <= tolerance) ||
+        !(std::fabs(output.tempMax - expected) <= tolerance)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void setUp() {
+  shim::setSerialEnabled(false);
+  mqttClient->connect(CHIP_ID.c_str(), "native", "native");
+  mqttLink->published.clear();
+}
+
+void tearDown() { shim::setSerialEnabled(true); }
+
+void test_steady_trace() {
+  ReplayReport report = replay(steadyTrace(50));
+  printReport("steady", report);
+
+  TEST_ASSERT_EQUAL(0, report.restarts.size());
+  TEST_ASSERT_EQUAL(50, report.outputs.size());
+  TEST_ASSERT_EQUAL(2 * 50, report.publishes);
+  TEST_ASSERT_EQUAL(SAMPLES_PER_REPORT - 1, report.outputs.front().sample);
+  TEST_ASSERT_EQUAL(0, countDeviating(report, TEMP_BASELINE, 0.01f));
+  TEST_ASSERT_EQUAL(SAMPLES_PER_REPORT, report.outputs.back().tempCount);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.0f, report.outputs.back().tempStddev);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, HUMID_BASELINE,
+                           report.outputs.back().humidity);
+}
+
+void test_spike_is_rejected() {
+  std::vector<TraceSample> trace = steadyTrace(40);
+  trace[20 * SAMPLES_PER_REPORT + 30].temperature = 85.0f;  // a read glitch
+  ReplayReport report = replay(trace);
+  printReport("spike", report);
+
+  TEST_ASSERT_EQUAL(0, countDeviating(report, TEMP_BASELINE, 0.01f));
+  TEST_ASSERT_EQUAL(0, report.restarts.size());
+}
+
+void test_short_event_shows_in_min() {
+  std::vector<TraceSample> trace = steadyTrace(40);
+  for (size_t i = 10; i < 30; i++) {
+    // The garage door open for 20 s in winter
+    trace[20 * SAMPLES_PER_REPORT + i].temperature = 5.0f;
+  }
+  ReplayReport report = replay(trace);
+  printReport("door", report);
+
+  // The mean hardly moves, the minimum and stddev show the event
+  const ReportOutput &output = report.outputs[20];
+  TEST_ASSERT_FLOAT_WITHIN(0.01, TEMP_BASELINE - 15.0f, output.tempMin);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, TEMP_BASELINE, output.tempMax);
+  TEST_ASSERT_TRUE(output.temperature > TEMP_BASELINE - 6.0f);
+  TEST_ASSERT_TRUE(output.tempStddev > 3.0f);
+  TEST_ASSERT_EQUAL(1, countDeviating(report, TEMP_BASELINE, 0.01f));
+}
+
+void test_step_change_passes() {
+  std::vector<TraceSample> trace = steadyTrace(40);
+  for (size_t i = 20 * SAMPLES_PER_REPORT + 30; i < trace.size(); i++) {
+    trace[i].temperature = 25.0f;
+  }
+  ReplayReport report = replay(trace);
+  printReport("step", report);
+
+  const ReportOutput &output = report.outputs[20];
+  TEST_ASSERT_FLOAT_WITHIN(0.01, TEMP_BASELINE, output.tempMin);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, TEMP_BASELINE + 5.0f, output.tempMax);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, TEMP_BASELINE + 5.0f,
+                           report.outputs.back().temperature);
+}
+
+void test_single_nan_temperature_is_skipped() {
+  std::vector<TraceSample> trace = steadyTrace(40);
+  trace[10 * SAMPLES_PER_REPORT + 5].temperature = NAN;
+  ReplayReport report = replay(trace);
+  printReport("temperature dropout", report);
+
+  TEST_ASSERT_EQUAL(0, report.restarts.size());
+  TEST_ASSERT_EQUAL(2 * 40, report.publishes);
+  TEST_ASSERT_EQUAL(SAMPLES_PER_REPORT - 1, report.outputs[10].tempCount);
+  TEST_ASSERT_EQUAL(0, countDeviating(report, TEMP_BASELINE, 0.01f));
+}
+
+void test_temperature_outage_restarts() {
+  std::vector<TraceSample> trace = steadyTrace(40);
+  for (size_t i = 10 * SAMPLES_PER_REPORT; i < 20 * SAMPLES_PER_REPORT; i++) {
+    trace[i].temperature = NAN;
+  }
+  ReplayReport report = replay(trace);
+  printReport("temperature outage", report);
+
+  // Ten intervals without a good sample restart the device; nothing is
+  // published for temperature meanwhile, humidity carries on
+  TEST_ASSERT_EQUAL(1, report.restarts.size());
+  TEST_ASSERT_EQUAL(20 * SAMPLES_PER_REPORT - 1, report.restarts.front());
+  TEST_ASSERT_EQUAL(10 + 19 + 2 * 20, report.publishes);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, TEMP_BASELINE,
+                           report.outputs.back().temperature);
+}
+
+void test_nine_empty_intervals_pass() {
+  std::vector<TraceSample> trace = steadyTrace(40);
+  for (size_t i = 10 * SAMPLES_PER_REPORT; i < 19 * SAMPLES_PER_REPORT; i++) {
+    trace[i].humidity = NAN;
+  }
+  ReplayReport report = replay(trace);
+  printReport("humidity outage", report);
+
+  TEST_ASSERT_EQUAL(0, report.restarts.size());
+  TEST_ASSERT_TRUE(std::isnan(report.outputs[15].humidity));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, HUMID_BASELINE,
+                           report.outputs.back().humidity);
+}
+
+// Reports that fall in a broker outage go to the reading log, and the first
+// report after it is back sends them as backfill
+void test_broker_outage_is_backfilled() {
+  const size_t outageReports = 5;
+  TEST_ASSERT_FALSE(hasPendingReadings());
+  bootPipeline(TraceSample{20.0f, 50.0f});
+  mqttClient->disconnect();
+
+  for (size_t i = 0; i < (outageReports + 1) * SAMPLES_PER_REPORT; i++) {
+    if (i == outageReports * SAMPLES_PER_REPORT) {
+      TEST_ASSERT_TRUE(hasPendingReadings());
+      TEST_ASSERT_EQUAL(0, mqttLink->published.size());
+      mqttClient->connect(CHIP_ID.c_str(), "native", "native");
+    }
+    delay(SENSOR_SAMPLE_INTERVAL_MS);
+    readAndWriteEnvironmentalSensors<BmeSensor>();
+  }
+
+  TEST_ASSERT_FALSE(hasPendingReadings());
+  const LoopbackClient::Message *backfill = nullptr;
+  for (const auto &message : mqttLink->published) {
+    if (endsWith(message.topic, "/backfill")) {
+      backfill = &message;
+    }
+  }
+  TEST_ASSERT_NOT_NULL(backfill);
+  // Version, then the temperature section with its reading count, see
+  // ReadingCodec.h
+  const std::string &payload = backfill->payload;
+  TEST_ASSERT_TRUE(payload.size() > 3);
+  TEST_ASSERT_EQUAL(READING_TEMPERATURE, static_cast<uint8_t>(payload[1]));
+  TEST_ASSERT_EQUAL(outageReports, static_cast<uint8_t>(payload[2]));
+}
+
+void test_pipeline_throughput() {
+  std::mt19937 rng(7);
+  std::normal_distribution<float> noise(0.0f, 0.3f);
+  std::vector<TraceSample> trace;
+  for (uint32_t i = 0; i < 100 * SAMPLES_PER_REPORT; i++) {
+    trace.push_back({20.0f + noise(rng), 50.0f + noise(rng)});
+  }
+  ReplayReport report = replay(trace);
+  printReport("throughput", report);
+
+  TEST_ASSERT_EQUAL(0, report.restarts.size());
+  TEST_ASSERT_EQUAL(2 * 100, report.publishes);
+  TEST_ASSERT_TRUE(report.outputs.back().tempStddev > 0.0f);
+}
+
+void test_recorded_trace() {
+  const char *path = getenv("REPLAY_TRACE");
+  if (!path) {
+    TEST_IGNORE_MESSAGE("set REPLAY_TRACE to replay a recorded trace");
+  }
+  std::ifstream in(path);
+  TEST_ASSERT_TRUE_MESSAGE(in.good(), "REPLAY_TRACE is not readable");
+  std::vector<TraceSample> trace = parseTrace(in);
+  ReplayReport report = replay(trace);
+
+  printf("sample,temperature,min,max,stddev,count,humidity\n");
+  for (const auto &output : report.outputs) {
+    printf("%u,%.3f,%.3f,%.3f,%.3f,%u,%.3f\n",
+           static_cast<unsigned>(output.sample), output.temperature,
+           output.tempMin, output.tempMax, output.tempStddev,
+           output.tempCount, output.humidity);
+  }
+  printReport(path, report);
+}
+
+void test_trace_parsing() {
+  std::istringstream in("temperature,humidity\n21.5,40\nnan,41\n22,\n");
+  std::vector<TraceSample> trace = parseTrace(in);
+
+  TEST_ASSERT_EQUAL(3, trace.size());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 21.5, trace[0].temperature);
+  TEST_ASSERT_TRUE(std::isnan(trace[1].temperature));
+  TEST_ASSERT_TRUE(std::isnan(trace[2].humidity));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_trace_parsing);
+  RUN_TEST(test_steady_trace);
+  RUN_TEST(test_spike_is_rejected);
+  RUN_TEST(test_short_event_shows_in_min);
+  RUN_TEST(test_step_change_passes);
+  RUN_TEST(test_single_nan_temperature_is_skipped);
+  RUN_TEST(test_temperature_outage_restarts);
+  RUN_TEST(test_nine_empty_intervals_pass);
+  RUN_TEST(test_broker_outage_is_backfilled);
+  RUN_TEST(test_pipeline_throughput);
+  RUN_TEST(test_recorded_trace);
+  return UNITY_END();
+}